@@ -0,0 +1,369 @@
+//
+//  batch_consumer.h
+//
+
+#ifndef __LAZY_BATCH_CONSUMER_H__2024__
+#define __LAZY_BATCH_CONSUMER_H__2024__
+
+#include <stdint.h>
+#include <assert.h>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+
+#include "lazy_base_common.h"
+
+#include "data_queue.h"
+#include "notifier.h"
+#include "task_queue.h"
+#include "time_utils.h"
+
+namespace lazy {
+
+/*
+** 批量消费DataQueue中的数据，适合一批数据只需要处理一次的场景（比如一批数据写一次数据库）
+** 用法：
+**   BatchConsumer<Row> consumer(data_queue, task_queue, [](std::vector<Row>& batch){ db.insert(batch); });
+**   consumer.start();
+** 1、攒够batch_limit个，或者一批中的第一个数据取出之后过了max_wait_us，就把这一批交给回调，哪个先到算哪个
+** 2、回调在task_queue的线程上执行，取数据从不等待：队列为空时挂起，不占用线程，也不轮询，
+**    DataQueue写入数据时通过挂接的Notifier重新投递；攒一批的期间同样挂起，到了max_wait_us由延迟任务唤醒，
+**    同一个TaskQueue上的其他任务只会被一批数据的处理时间推迟；TaskQueue的延迟任务是毫秒精度，max_wait_us向上取整到毫秒
+** 3、设置了target_latency_us时，根据每一批的延迟（第一个数据取出到回调返回）调整batch_limit：
+**    超过目标就减半，没有超过并且这一批是满的就加上batch_step，最大是max_batch（AIMD）
+** 4、stop之后不再取数据，队列中剩下的数据留在队列中；DataQueue被stop之后也会停止
+** 5、不能在task_queue的线程上析构（包括回调中），投递出去的任务持有this
+*/
+template<class T, class Container = std::deque<T>>
+class BatchConsumer {
+public:
+    typedef DataQueue<T, Container> Queue;
+
+    struct Config {
+        // 一批最多的数据个数
+        size_t max_batch = 128;
+
+        // 一批中的第一个数据取出之后，最多再等待多久
+        uint32_t max_wait_us = 1000;
+
+        // 一批数据的目标延迟，0表示不调整batch_limit，一直是max_batch
+        uint32_t target_latency_us = 0;
+
+        // 延迟没有超过目标时，batch_limit每次增加的个数
+        size_t batch_step = 8;
+    };
+
+    struct Metrics {
+        // 交给回调的批数和数据个数
+        uint64_t batches = 0;
+        uint64_t items = 0;
+
+        // 当前一批最多的数据个数
+        size_t batch_limit = 0;
+
+        // 一批数据的延迟（第一个数据取出到回调返回）
+        uint64_t last_latency_us = 0;
+        uint64_t max_latency_us = 0;
+        uint64_t avg_latency_us = 0;
+
+        // 超过目标延迟的批数
+        uint64_t over_target = 0;
+    };
+
+    // 回调可以修改或者移走batch中的数据，返回之后batch会被清空
+    typedef std::function<void(std::vector<T>& batch)> Handler;
+
+    BatchConsumer(Queue& queue, TaskQueue& task_queue, const Handler& handler)
+    : BatchConsumer(queue, task_queue, handler, Config()) {
+    }
+
+    BatchConsumer(Queue& queue, TaskQueue& task_queue, const Handler& handler, const Config& conf)
+    : queue_(queue), task_queue_(task_queue), handler_(handler), config_(conf), stop_(true), parked_(false) {
+        if(config_.max_batch == 0){
+            config_.max_batch = 1;
+        }
+
+        if(config_.batch_step == 0){
+            config_.batch_step = 1;
+        }
+
+        batch_limit_ = config_.max_batch;
+
+        // 在DataQueue的锁内执行，只投递任务
+        notifier_.set_callback([this]{
+            wakeup();
+        });
+        queue_.attach_notifier(&notifier_);
+    }
+
+    ~BatchConsumer() {
+        // 在task_queue的线程上stop不会等待，投递出去的任务之后还会访问this
+        assert(!task_queue_.is_current());
+
+        stop();
+
+        queue_.detach_notifier(&notifier_);
+    }
+
+    bool start() {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        if(running_){
+            stop_.store(false, std::memory_order_release);
+            return true;
+        }
+
+        stop_.store(false, std::memory_order_release);
+        running_ = true;
+
+        schedule();
+
+        return true;
+    }
+
+    /* 停止消费，等待正在处理的一批结束
+     * 在回调中调用时不等待，当前这一批结束之后停止
+     */
+    void stop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        stop_.store(true, std::memory_order_release);
+
+        // 挂起的时候没有任务在跑，投递一次让它退出
+        wakeup();
+
+        if(task_queue_.is_current()){
+            return;
+        }
+
+        // 还要等延迟任务执行完，它们会访问this
+        cond_.wait(lock, [&]{
+            return !running_ && timers_ == 0;
+        });
+    }
+
+    Metrics metrics() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        Metrics m = metrics_;
+        m.batch_limit = batch_limit_;
+        m.avg_latency_us = m.batches > 0 ? total_latency_us_ / m.batches : 0;
+
+        return m;
+    }
+
+private:
+    void schedule() {
+        task_queue_.post([this]{
+            run_once();
+        });
+    }
+
+    // 挂起的消费者只被唤醒一次，可以在任意线程调用
+    void wakeup() {
+        if(parked_.load(std::memory_order_acquire) && parked_.exchange(false, std::memory_order_acq_rel)){
+            schedule();
+        }
+    }
+
+    /* 在task_queue_的线程上执行：取出队列中现有的数据（不等待），
+     * 攒够一批或者到了max_wait_us就交给回调，然后立即投递下一次；否则挂起，等写入数据或者定时器唤醒
+     */
+    void run_once() {
+        bool stopping = stop_.load(std::memory_order_acquire) || queue_.stopped();
+
+        if(!stopping){
+            if(batch_.empty()){
+                batch_target_ = current_limit();
+            }
+
+            if(batch_.size() < batch_target_){
+                queue_.try_pop_up_to(batch_target_ - batch_.size(), batch_);
+            }
+        }
+
+        if(batch_.empty()){
+            if(stopping){
+                finish();
+            }
+            else {
+                park(0);
+            }
+            return;
+        }
+
+        int64_t now_us = TimeUtil::MonoNowUs();
+
+        if(first_us_ == 0){
+            first_us_ = now_us;
+        }
+
+        int64_t deadline_us = first_us_ + config_.max_wait_us;
+
+        // 停止的时候已经取出的数据仍然交给回调
+        if(!stopping && batch_.size() < batch_target_ && now_us < deadline_us){
+            park(deadline_us);
+            return;
+        }
+
+        dispatch();
+
+        if(stopping){
+            finish();
+        }
+        else {
+            schedule();
+        }
+    }
+
+    void dispatch() {
+        size_t count = batch_.size();
+
+        handler_(batch_);
+
+        batch_.clear();
+
+        uint64_t latency_us = (uint64_t)(TimeUtil::MonoNowUs() - first_us_);
+        first_us_ = 0;
+
+        on_batch(count, batch_target_, latency_us);
+    }
+
+    void finish() {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        running_ = false;
+        cond_.notify_all();
+    }
+
+    /* 挂起，直到写入数据、停止，或者到了deadline_us（为0时没有期限）
+     * 先设置标志再检查，检查之后写入的数据一定会通过Notifier唤醒，不会丢失
+     */
+    void park(int64_t deadline_us) {
+        if(deadline_us > 0 && deadline_us != armed_deadline_us_){
+            arm_timer(deadline_us);
+        }
+
+        parked_.store(true, std::memory_order_release);
+
+        if(queue_.readable() || stop_.load(std::memory_order_acquire)){
+            wakeup();
+        }
+    }
+
+    // 同一批只设置一个定时器，写入数据唤醒之后再次挂起时不重复设置
+    void arm_timer(int64_t deadline_us) {
+        armed_deadline_us_ = deadline_us;
+
+        int64_t delay_us = deadline_us - TimeUtil::MonoNowUs();
+        uint32_t delay_ms = delay_us > 0 ? (uint32_t)((delay_us + 999) / 1000) : 1;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ++timers_;
+        }
+
+        task_queue_.post_delayed([this, deadline_us]{
+            on_timer(deadline_us);
+        }, delay_ms);
+    }
+
+    void on_timer(int64_t deadline_us) {
+        if(armed_deadline_us_ == deadline_us){
+            armed_deadline_us_ = 0;
+        }
+
+        // 之前的批次留下的定时器也只是多唤醒一次，run_once会重新检查
+        wakeup();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        --timers_;
+        cond_.notify_all();
+    }
+
+    size_t current_limit() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return batch_limit_;
+    }
+
+    // 记录统计，并且根据延迟调整batch_limit_
+    void on_batch(size_t count, size_t limit, uint64_t latency_us) {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        ++metrics_.batches;
+        metrics_.items += count;
+        metrics_.last_latency_us = latency_us;
+        if(latency_us > metrics_.max_latency_us){
+            metrics_.max_latency_us = latency_us;
+        }
+        total_latency_us_ += latency_us;
+
+        if(config_.target_latency_us == 0){
+            return;
+        }
+
+        if(latency_us > config_.target_latency_us){
+            ++metrics_.over_target;
+
+            batch_limit_ /= 2;
+            if(batch_limit_ == 0){
+                batch_limit_ = 1;
+            }
+        }
+        else if(count >= limit){
+            // 满的一批说明数据还有，增大批量可以提高吞吐
+            batch_limit_ += config_.batch_step;
+            if(batch_limit_ > config_.max_batch){
+                batch_limit_ = config_.max_batch;
+            }
+        }
+    }
+
+    Queue& queue_;
+    TaskQueue& task_queue_;
+    Handler handler_;
+    Config config_;
+
+    // 下面四个只在task_queue_的线程上使用
+    // 正在攒的一批，一直复用
+    std::vector<T> batch_;
+    // 这一批的目标个数，开始攒的时候取batch_limit_
+    size_t batch_target_ = 0;
+    // 这一批中的第一个数据取出的时刻，0表示还没有开始
+    int64_t first_us_ = 0;
+    // 已经设置了定时器的deadline
+    int64_t armed_deadline_us_ = 0;
+
+    std::atomic<bool> stop_;
+
+    // 挂起等待数据，没有投递任务；唤醒的一方把它改成false之后投递
+    std::atomic<bool> parked_;
+
+    // 挂接到queue_，写入数据或者stop时唤醒挂起的消费者
+    Notifier notifier_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+
+    // 已经投递了run_once（或者挂起），还没有退出
+    bool running_ = false;
+
+    // 还没有执行的延迟任务的个数
+    int timers_ = 0;
+
+    // 下面的成员加锁访问
+    size_t batch_limit_ = 0;
+    Metrics metrics_;
+    uint64_t total_latency_us_ = 0;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(BatchConsumer);
+};
+
+}
+
+#endif /* __LAZY_BATCH_CONSUMER_H__2024__ */
@@ -0,0 +1,411 @@
+//
+//  broadcast_channel.h
+//
+
+#ifndef __LAZY_BROADCAST_CHANNEL_H__2024__
+#define __LAZY_BROADCAST_CHANNEL_H__2024__
+
+#include <stdint.h>
+#include <assert.h>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <utility>
+#include <algorithm>
+#include <condition_variable>
+
+#include "lazy_base_common.h"
+
+namespace lazy {
+
+// 最慢的订阅者还没有读完，环形缓冲区已经写满时的处理方式
+enum BroadcastSlowPolicy {
+    // 生产者等待最慢的订阅者，不丢消息
+    BROADCAST_SLOW_BLOCK = 0,
+
+    // 生产者直接覆盖最旧的消息，被套圈的订阅者跳到还能读到的最旧的消息，并记录丢了多少条
+    BROADCAST_SLOW_LAP = 1,
+};
+
+/*
+** 广播通道：每条消息所有的订阅者都能收到（类似disruptor）
+** 1、消息只写入一次，放在环形缓冲区的槽位中（shared_ptr<const T>），订阅者拿到的是同一个对象，不做拷贝；
+**    代价是publish(T)每条消息一次make_shared的内存分配，订阅者每读一条消息修改一次引用计数
+** 2、每个订阅者有自己的读位置（序号），互不影响；生产者只有在缓冲区写满时才需要看订阅者的位置
+** 3、订阅之后只能收到之后发布的消息
+** 4、只有有人挂起时才加锁唤醒，两端都在忙的时候没有锁（多个生产者之间有一把锁）
+** 5、BROADCAST_SLOW_BLOCK策略下，生产者不会覆盖还有订阅者没读的槽位，读槽位不加锁；
+**    BROADCAST_SLOW_LAP策略下，生产者可能正在覆盖订阅者正在读的槽位，拷贝shared_ptr时需要加槽位上的自旋锁
+**    （每个槽位一把，只有读写同一个槽位时才会争抢），所以这个策略下订阅者一端不是无锁的
+** 6、没有用std::atomic_load/atomic_store读写shared_ptr：libstdc++的实现是一个全局的自旋锁池，所有的槽位共用
+*/
+template<class T>
+class BroadcastChannel {
+public:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::shared_ptr<const T> Message;
+
+    class Subscriber {
+    public:
+        ~Subscriber() {
+            channel_->unsubscribe(this);
+        }
+
+        // 等待下一条消息，stop之后返回false
+        bool next(Message& msg) {
+            return channel_->read(this, msg, true, nullptr);
+        }
+
+        // 不等待，没有新消息时返回false
+        bool try_next(Message& msg) {
+            return channel_->read(this, msg, false, nullptr);
+        }
+
+        template<class Rep, class Period>
+        bool next_for(Message& msg, const std::chrono::duration<Rep, Period>& timeout) {
+            Clock::time_point deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(timeout);
+            return channel_->read(this, msg, true, &deadline);
+        }
+
+        // 还没有读的消息数
+        uint64_t pending() const {
+            return channel_->cursor() - next_.load(std::memory_order_acquire);
+        }
+
+        // BROADCAST_SLOW_LAP策略下，因为被套圈而丢掉的消息数
+        uint64_t lagged() const {
+            return lagged_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        friend class BroadcastChannel;
+
+        Subscriber(BroadcastChannel* channel, uint64_t next) : channel_(channel), next_(next), lagged_(0) {
+        }
+
+        BroadcastChannel* channel_;
+
+        // 下一条要读的消息的序号，只有订阅者自己修改，生产者读取
+        std::atomic<uint64_t> next_;
+
+        std::atomic<uint64_t> lagged_;
+
+        LAZY_DISALLOW_COPY_AND_ASSIGN(Subscriber);
+    };
+
+    /* capacity: 缓冲区能容纳的消息数，向上取整到2的幂
+     * policy: 最慢的订阅者跟不上时的处理方式
+     */
+    explicit BroadcastChannel(size_t capacity, BroadcastSlowPolicy policy = BROADCAST_SLOW_BLOCK)
+    : policy_(policy), cursor_(0), stop_(false), subscribers_waiting_(0), producer_waiting_(false) {
+        capacity_ = 1;
+        while(capacity_ < capacity){
+            capacity_ <<= 1;
+        }
+        mask_ = capacity_ - 1;
+
+        slots_.reset(new Slot[capacity_]);
+    }
+
+    // 所有的订阅者必须在通道之前析构
+    ~BroadcastChannel() {
+        stop();
+        assert(subscribers_.empty());
+    }
+
+    bool start() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_.store(false, std::memory_order_release);
+        return true;
+    }
+
+    void stop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_.store(true, std::memory_order_release);
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+
+    // 订阅，只能收到之后发布的消息
+    std::unique_ptr<Subscriber> subscribe() {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        std::unique_ptr<Subscriber> subscriber(new Subscriber(this, cursor_.load(std::memory_order_acquire)));
+
+        subscribers_.push_back(subscriber.get());
+
+        return subscriber;
+    }
+
+    size_t subscriber_count() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return subscribers_.size();
+    }
+
+    // 发布一条消息，stop之后返回false
+    bool publish(const T& val) {
+        return publish(Message(std::make_shared<T>(val)));
+    }
+
+    bool publish(T&& val) {
+        return publish(Message(std::make_shared<T>(std::move(val))));
+    }
+
+    // 已经构造好的消息，直接放进槽位
+    bool publish(Message msg) {
+        std::unique_lock<std::mutex> publish_lock(publish_mutex_);
+
+        if(stop_.load(std::memory_order_acquire)){
+            return false;
+        }
+
+        uint64_t seq = cursor_.load(std::memory_order_relaxed);
+
+        if(policy_ == BROADCAST_SLOW_BLOCK && !wait_for_slot(seq)){
+            return false;
+        }
+
+        Slot& slot = slots_[seq & mask_];
+
+        if(policy_ == BROADCAST_SLOW_BLOCK){
+            // 所有的订阅者都已经读过了这个槽位上的旧消息，没有人会同时读
+            slot.msg.swap(msg);
+            slot.seq.store(seq, std::memory_order_release);
+        }
+        else {
+            // 订阅者可能正在读旧的消息，加锁替换；旧的消息在锁外面析构
+            slot.lock();
+            slot.msg.swap(msg);
+            slot.seq.store(seq, std::memory_order_relaxed);
+            slot.unlock();
+        }
+
+        cursor_.store(seq + 1);
+
+        wake_subscribers();
+
+        return true;
+    }
+
+    // 已经发布的消息数，也就是下一条消息的序号
+    uint64_t cursor() const {
+        return cursor_.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const {
+        return capacity_;
+    }
+
+private:
+    static const uint64_t kWriting = ~(uint64_t)0;
+
+    struct Slot {
+        Slot() : seq(kWriting) {
+            busy.clear();
+        }
+
+        // BROADCAST_SLOW_LAP策略下读写msg时加锁，临界区只是一次shared_ptr的拷贝或者交换
+        void lock() {
+            while(busy.test_and_set(std::memory_order_acquire)){
+                LAZY_CPU_RELAX();
+            }
+        }
+
+        void unlock() {
+            busy.clear(std::memory_order_release);
+        }
+
+        // 槽位中消息的序号，还没有写入时是kWriting
+        std::atomic<uint64_t> seq;
+        std::atomic_flag busy;
+        Message msg;
+    };
+
+    void unsubscribe(Subscriber* subscriber) {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        subscribers_.erase(std::remove(subscribers_.begin(), subscribers_.end(), subscriber), subscribers_.end());
+
+        // 生产者可能正在等这个订阅者
+        not_full_.notify_all();
+    }
+
+    // 加锁之后调用，所有订阅者中最小的读位置，没有订阅者时返回limit
+    uint64_t min_next_locked(uint64_t limit) const {
+        uint64_t min_next = limit;
+        for(Subscriber* subscriber : subscribers_){
+            min_next = std::min(min_next, subscriber->next_.load(std::memory_order_acquire));
+        }
+        return min_next;
+    }
+
+    // BROADCAST_SLOW_BLOCK策略：等待所有订阅者都读完了seq这个槽位上的旧消息
+    bool wait_for_slot(uint64_t seq) {
+        if(seq - gating_cache_ < capacity_){
+            return true;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        gating_cache_ = min_next_locked(seq);
+        if(seq - gating_cache_ < capacity_){
+            return true;
+        }
+
+        producer_waiting_.store(true, std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        not_full_.wait(lock, [&]{
+            gating_cache_ = min_next_locked(seq);
+            return (seq - gating_cache_ < capacity_ || stop_.load(std::memory_order_relaxed));
+        });
+
+        producer_waiting_.store(false, std::memory_order_relaxed);
+
+        return !stop_.load(std::memory_order_relaxed);
+    }
+
+    bool read(Subscriber* subscriber, Message& msg, bool block, const Clock::time_point* deadline) {
+        uint64_t next = subscriber->next_.load(std::memory_order_relaxed);
+
+        while(true){
+            if(stop_.load(std::memory_order_acquire)){
+                return false;
+            }
+
+            uint64_t cursor = cursor_.load();
+
+            if(next >= cursor){
+                if(!block || !park_subscriber(next, deadline)){
+                    return false;
+                }
+                continue;
+            }
+
+            // 被套圈了，跳到还能读到的最旧的消息
+            if(cursor - next > capacity_){
+                uint64_t oldest = cursor - capacity_;
+                subscriber->lagged_.fetch_add(oldest - next, std::memory_order_relaxed);
+                next = oldest;
+            }
+
+            Slot& slot = slots_[next & mask_];
+
+            if(policy_ == BROADCAST_SLOW_BLOCK){
+                // 游标已经超过了next，消息一定已经写入，并且在这个订阅者读完之前不会被覆盖
+                uint64_t seq = slot.seq.load(std::memory_order_acquire);
+                assert(seq == next);
+                (void)seq;
+
+                msg = slot.msg;
+            }
+            else {
+                slot.lock();
+
+                bool ok = (slot.seq.load(std::memory_order_relaxed) == next);
+                if(ok){
+                    msg = slot.msg;
+                }
+
+                slot.unlock();
+
+                if(!ok){
+                    // 槽位已经被覆盖了，重新读取游标
+                    LAZY_CPU_RELAX();
+                    continue;
+                }
+            }
+
+            subscriber->next_.store(next + 1, std::memory_order_release);
+
+            if(policy_ == BROADCAST_SLOW_BLOCK){
+                wake_producer();
+            }
+
+            return true;
+        }
+    }
+
+    // 没有新消息时挂起，返回false表示超时
+    bool park_subscriber(uint64_t next, const Clock::time_point* deadline) {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        subscribers_waiting_.fetch_add(1, std::memory_order_relaxed);
+
+        // 和wake_subscribers中的fence配对：要么这里看到新的游标，要么生产者看到有人在等待
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        auto ready = [&]{
+            return (cursor_.load(std::memory_order_relaxed) > next || stop_.load(std::memory_order_relaxed));
+        };
+
+        bool ok = true;
+
+        if(deadline){
+            ok = not_empty_.wait_until(lock, *deadline, ready);
+        }
+        else {
+            not_empty_.wait(lock, ready);
+        }
+
+        subscribers_waiting_.fetch_sub(1, std::memory_order_relaxed);
+
+        return ok;
+    }
+
+    void wake_subscribers() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if(subscribers_waiting_.load(std::memory_order_relaxed) > 0){
+            std::unique_lock<std::mutex> lock(mutex_);
+            not_empty_.notify_all();
+        }
+    }
+
+    void wake_producer() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if(producer_waiting_.load(std::memory_order_relaxed)){
+            std::unique_lock<std::mutex> lock(mutex_);
+            not_full_.notify_all();
+        }
+    }
+
+    // 只读的成员
+    std::unique_ptr<Slot[]> slots_;
+    size_t capacity_ = 0;
+    size_t mask_ = 0;
+    BroadcastSlowPolicy policy_;
+
+    char pad0_[LAZY_CACHE_LINE_SIZE];
+
+    // 下一条消息的序号
+    std::atomic<uint64_t> cursor_;
+
+    char pad1_[LAZY_CACHE_LINE_SIZE];
+
+    // 多个生产者之间互斥，下面的gating_cache_也由它保护
+    std::mutex publish_mutex_;
+
+    // 上一次计算出的订阅者的最小读位置，只有缓冲区看起来满了才重新计算
+    uint64_t gating_cache_ = 0;
+
+    mutable std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+
+    std::vector<Subscriber*> subscribers_;
+
+    std::atomic<bool> stop_;
+    std::atomic<int> subscribers_waiting_;
+    std::atomic<bool> producer_waiting_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(BroadcastChannel);
+};
+
+}
+
+#endif /* __LAZY_BROADCAST_CHANNEL_H__2024__ */
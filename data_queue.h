@@ -6,18 +6,77 @@
 #define __LAZY_DATA_QUEUE_H__2024__
 
 #include <deque>
+#include <utility>
+#include <vector>
+#include <memory>
 #include <mutex>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 
 #include "lazy_base_common.h"
 
+#include "wait_strategy.h"
+#include "notifier.h"
+
 namespace lazy {
 
+// 设置了容量的DataQueue满了之后，push_back/emplace_back的处理方式
+enum QueueFullPolicy {
+    // 等待消费者取走数据，push_back_for/push_back_until最多等到超时
+    QUEUE_FULL_BLOCK = 0,
+    
+    // 丢弃最早的数据，然后写入
+    QUEUE_FULL_DROP_OLDEST = 1,
+    
+    // 直接返回false
+    QUEUE_FULL_REJECT = 2,
+};
+
+/* DataQueue的构造函数的标记，之后的参数传给底层容器的构造函数：
+**   DataQueue<T, SpillQueue<T, Codec>> queue(container_args, directory, memory_limit)
+** 必须显式地写出来，DataQueue<int> queue(5)这样的调用不会被当成容器的参数
+*/
+struct container_args_t {
+    explicit container_args_t() {}
+};
+static const container_args_t container_args;
+
+/* pop_all一次能取出的元素个数，默认是全部
+** 底层容器有一部分数据不在内存中时（比如SpillQueue），在容器所在的命名空间中重载这个函数，
+** 只返回内存中的部分，避免pop_all把整个积压一次读进内存
+*/
+template<class Container>
+size_t drainable_size(const Container& container) {
+    return container.size();
+}
 
-template<class T>
+/*
+** 线程安全的队列
+** 1、pop_front/front/pop_all/pop_up_to：队列为空时一直等待，直到有数据或者stop
+** 2、try_xxx：不等待，队列为空时直接返回false
+** 3、xxx_for/xxx_until：最多等待到超时，超时返回false，时间使用单调时钟（steady_clock），不受系统时间调整的影响
+** 4、记录正在等待的消费者个数，没有消费者在等待时push不会调用notify
+** 5、默认不限制容量，可以通过set_capacity限制容量，满了之后的处理方式见QueueFullPolicy
+** 6、Container是底层的容器，需要支持push_back/emplace_back/front/pop_front/size/empty/swap，
+**    默认是std::deque；队列深度频繁变化时可以换成SegmentQueue<T>，稳定状态下不再分配内存
+**    内存有限、又不能丢数据时可以换成SpillQueue<T, Codec>，超过阈值的元素写入磁盘；
+**    这时pop_all只取出内存中的部分（见drainable_size），并且写磁盘/读回磁盘都在持有锁的期间进行
+*/
+template<class T, class Container = std::deque<T>>
 class DataQueue {
 public:
-    DataQueue(){
+    typedef std::chrono::steady_clock Clock;
+    
+    DataQueue() : count_(0) {
+        
+    }
+    
+    /* args传给底层容器的构造函数，见container_args_t
+     * drain_buffer_用默认构造：交换只交换数据，不交换配置，见pop_all_impl
+     */
+    template<class... Args>
+    DataQueue(container_args_t, Args&&... args) : queue_(std::forward<Args>(args)...), count_(queue_.size()) {
         
     }
     
@@ -25,62 +84,239 @@ public:
         stop();
     }
     
+    // 队列满了之后的行为由set_capacity设置的策略决定，stop或者被拒绝时返回false
     bool push_back(const T& val) {
+        return push_impl(val, nullptr);
+    }
+    
+    bool emplace_back(T&& val) {
+        return push_impl(std::forward<T>(val), nullptr);
+    }
+    
+    /* 队列满了并且策略是QUEUE_FULL_BLOCK时，最多等待timeout，超时返回false
+     * 其他策略和push_back一样，不会等待
+     */
+    template<class Rep, class Period>
+    bool push_back_for(const T& val, const std::chrono::duration<Rep, Period>& timeout) {
+        Clock::time_point deadline = deadline_after(timeout);
+        return push_impl(val, &deadline);
+    }
+    
+    template<class Rep, class Period>
+    bool push_back_for(T&& val, const std::chrono::duration<Rep, Period>& timeout) {
+        Clock::time_point deadline = deadline_after(timeout);
+        return push_impl(std::forward<T>(val), &deadline);
+    }
+    
+    bool push_back_until(const T& val, const Clock::time_point& deadline) {
+        return push_impl(val, &deadline);
+    }
+    
+    bool push_back_until(T&& val, const Clock::time_point& deadline) {
+        return push_impl(std::forward<T>(val), &deadline);
+    }
+    
+    /* 批量写入，只加一次锁
+     * 设置了容量时，QUEUE_FULL_BLOCK策略下一边写一边等待，QUEUE_FULL_REJECT策略下写不下的部分被拒绝并返回false
+     */
+    template<class Iterator>
+    bool push_range(Iterator first, Iterator last) {
+        if(first == last){
+            return true;
+        }
+        
+        spin_waiter_.on_arrival();
+        
         std::unique_lock<std::mutex> lock(mutex_);
-        if(stop_){
+        
+        while(first != last){
+            if(!reserve_slot(lock, nullptr)){
+                if(!stop_){
+                    // 第一个已经在reserve_slot中计数了
+                    for(++first; first != last; ++first){
+                        ++rejected_;
+                    }
+                }
+                return false;
+            }
+            
+            size_t pushed = 0;
+            
+            do {
+                queue_.push_back(*first);
+                ++first;
+                ++pushed;
+            } while(first != last && (capacity_ == 0 || queue_.size() < capacity_));
+            
+            on_pushed(pushed);
+        }
+        
+        return true;
+    }
+    
+    bool pop_front(T& val){
+        spin_until_ready();
+        
+        std::unique_lock<std::mutex> lock(mutex_);
+        
+        if(!wait_not_empty(lock, pop_waiters_, nullptr)){
             return false;
         }
-        queue_.push_back(val);
-        cond_.notify_all();
+        
+        take_front(val);
         
         return true;
     }
     
-    bool emplace_back(T&& val) {
+    // 不等待，队列为空或者已经stop时返回false
+    bool try_pop(T& val){
         std::unique_lock<std::mutex> lock(mutex_);
-        if(stop_){
+        
+        if(stop_ || queue_.empty()){
             return false;
         }
-        queue_.emplace_back(std::forward<T>(val));
-        cond_.notify_all();
+        
+        take_front(val);
         
         return true;
     }
     
-    bool pop_front(T& val){
+    // 最多等待timeout，超时或者stop返回false
+    template<class Rep, class Period>
+    bool pop_for(T& val, const std::chrono::duration<Rep, Period>& timeout){
+        return pop_until(val, deadline_after(timeout));
+    }
+    
+    // 最多等待到deadline，超时或者stop返回false
+    bool pop_until(T& val, const Clock::time_point& deadline){
+        spin_until_ready();
+        
         std::unique_lock<std::mutex> lock(mutex_);
         
-        if(stop_){
+        if(!wait_not_empty(lock, pop_waiters_, &deadline)){
             return false;
         }
         
-        cond_.wait(lock, [&]{
-            return (!queue_.empty() || stop_);
-        });
+        take_front(val);
         
-        if(stop_){
+        return true;
+    }
+    
+    /* 取出队列中所有的元素，追加到out的后面
+     * 和pop_front一样，队列为空时等待，stop之后返回false
+     * 加锁期间只是交换一下内部的缓冲区，元素的移动在锁外面进行
+     * 底层容器只有一部分数据在内存中时（SpillQueue），只取出内存中的部分，其余的需要再次调用
+     */
+    bool pop_all(std::vector<T>& out) {
+        spin_until_ready();
+        
+        return pop_all_impl(out, true, nullptr);
+    }
+    
+    // pop_all的非阻塞版本
+    bool try_pop_all(std::vector<T>& out) {
+        return pop_all_impl(out, false, nullptr);
+    }
+    
+    template<class Rep, class Period>
+    bool pop_all_for(std::vector<T>& out, const std::chrono::duration<Rep, Period>& timeout) {
+        return pop_all_until(out, deadline_after(timeout));
+    }
+    
+    bool pop_all_until(std::vector<T>& out, const Clock::time_point& deadline) {
+        spin_until_ready();
+        
+        return pop_all_impl(out, true, &deadline);
+    }
+    
+    /* 最多取出n个元素，追加到out的后面
+     * 和pop_front一样，队列为空时等待，stop之后返回false
+     * 适合多个消费者分摊数据的场景，避免一个消费者把数据全部取走
+     */
+    bool pop_up_to(size_t n, std::vector<T>& out) {
+        spin_until_ready();
+        
+        std::unique_lock<std::mutex> lock(mutex_);
+        
+        if(!wait_not_empty(lock, pop_waiters_, nullptr)){
             return false;
         }
         
-        val = std::move(queue_.front());
+        take_up_to(n, out);
         
-        queue_.pop_front();
+        return true;
+    }
+    
+    // pop_up_to的非阻塞版本
+    bool try_pop_up_to(size_t n, std::vector<T>& out) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        
+        if(stop_ || queue_.empty()){
+            return false;
+        }
+        
+        take_up_to(n, out);
+        
+        return true;
+    }
+    
+    template<class Rep, class Period>
+    bool pop_up_to_for(size_t n, std::vector<T>& out, const std::chrono::duration<Rep, Period>& timeout) {
+        return pop_up_to_until(n, out, deadline_after(timeout));
+    }
+    
+    bool pop_up_to_until(size_t n, std::vector<T>& out, const Clock::time_point& deadline) {
+        spin_until_ready();
+        
+        std::unique_lock<std::mutex> lock(mutex_);
+        
+        if(!wait_not_empty(lock, pop_waiters_, &deadline)){
+            return false;
+        }
+        
+        take_up_to(n, out);
         
         return true;
     }
     
     bool front(T& val) {
+        spin_until_ready();
+        
         std::unique_lock<std::mutex> lock(mutex_);
         
-        if(stop_){
+        if(!wait_not_empty(lock, front_waiters_, nullptr)){
             return false;
         }
         
-        cond_.wait(lock, [&]{
-            return (!queue_.empty() || stop_);
-        });
+        val = queue_.front();
         
-        if(stop_){
+        return true;
+    }
+    
+    // 不等待，队列为空或者已经stop时返回false
+    bool try_front(T& val) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        
+        if(stop_ || queue_.empty()){
+            return false;
+        }
+        
+        val = queue_.front();
+        
+        return true;
+    }
+    
+    template<class Rep, class Period>
+    bool front_for(T& val, const std::chrono::duration<Rep, Period>& timeout) {
+        return front_until(val, deadline_after(timeout));
+    }
+    
+    bool front_until(T& val, const Clock::time_point& deadline) {
+        spin_until_ready();
+        
+        std::unique_lock<std::mutex> lock(mutex_);
+        
+        if(!wait_not_empty(lock, front_waiters_, &deadline)){
             return false;
         }
         
@@ -113,14 +349,354 @@ public:
         stop_ = true;
         
         cond_.notify_all();
+        not_full_.notify_all();
+        
+        notifiers_.notify();
+    }
+    
+    bool stopped() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return stop_;
+    }
+    
+    // 有数据可以取，或者已经stop（pop会立即返回false），Selector用来判断是否就绪
+    bool readable() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return (!queue_.empty() || stop_);
+    }
+    
+    // 挂接通知器，之后每次写入数据或者stop都会通知它，见Selector
+    void attach_notifier(Notifier* notifier) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notifiers_.attach(notifier);
+    }
+    
+    void detach_notifier(Notifier* notifier) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notifiers_.detach(notifier);
+    }
+    
+    /* 设置容量
+     * capacity: 最多缓存的元素个数，0表示不限制（默认）
+     * policy: 队列满了之后push_back/emplace_back的处理方式
+     * 调小容量不会删除已有的数据，只是在降到容量以下之前不能再写入
+     */
+    void set_capacity(size_t capacity, QueueFullPolicy policy = QUEUE_FULL_BLOCK) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        
+        capacity_ = capacity;
+        full_policy_ = policy;
+        
+        not_full_.notify_all();
+    }
+    
+    size_t capacity() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return capacity_;
+    }
+    
+    // 队列中曾经达到的最大元素个数
+    size_t high_water_mark() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return high_water_mark_;
+    }
+    
+    // QUEUE_FULL_DROP_OLDEST策略下丢弃的元素个数
+    uint64_t dropped() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return dropped_;
+    }
+    
+    // 因为队列满了被拒绝的元素个数（QUEUE_FULL_REJECT策略，或者QUEUE_FULL_BLOCK策略下等待超时）
+    uint64_t rejected() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return rejected_;
+    }
+    
+    /* 设置消费者（pop_front/front）等待数据时的策略，默认是直接挂起
+     * 对延迟敏感的场景可以先自旋一段时间，避免挂起/唤醒带来的几十微秒的延迟，代价是消耗CPU
+     * max_spin_us: 挂起之前最多自旋的时间
+     */
+    void set_wait_strategy(WaitStrategy strategy, uint32_t max_spin_us = 50) {
+        spin_waiter_.set_strategy(strategy, max_spin_us);
     }
     
 private:
+    template<class Rep, class Period>
+    static Clock::time_point deadline_after(const std::chrono::duration<Rep, Period>& timeout) {
+        return Clock::now() + std::chrono::duration_cast<Clock::duration>(timeout);
+    }
+    
+    // 加锁之前先自旋等待，只是一个优化，之后仍然要加锁检查
+    void spin_until_ready() {
+        if(!spin_waiter_.enabled()){
+            return;
+        }
+        
+        spin_waiter_.spin([&]{
+            // stop之后pop会立即返回，不要在空队列上自旋到超时
+            return (count_.load(std::memory_order_acquire) > 0 || stop_.load(std::memory_order_relaxed));
+        });
+    }
+    
+    /* 加锁之后调用，等待队列中有数据
+     * waiters: 等待期间计入的等待者计数（pop_waiters_或者front_waiters_）
+     * deadline: 为nullptr时一直等待
+     * 返回false表示已经stop或者超时
+     */
+    bool wait_not_empty(std::unique_lock<std::mutex>& lock, int& waiters, const Clock::time_point* deadline) {
+        if(stop_){
+            return false;
+        }
+        
+        if(!queue_.empty()){
+            return true;
+        }
+        
+        ++waiters;
+        
+        if(deadline){
+            cond_.wait_until(lock, *deadline, [&]{
+                return (!queue_.empty() || stop_);
+            });
+        }
+        else {
+            cond_.wait(lock, [&]{
+                return (!queue_.empty() || stop_);
+            });
+        }
+        
+        --waiters;
+        
+        return (!stop_ && !queue_.empty());
+    }
+    
+    /* block为false时不等待；否则等待到deadline，deadline为nullptr时一直等待
+     * 加锁期间把queue_和drain_buffer_交换，然后在锁外面把drain_buffer_中的元素移动到out中，
+     * 取空的drain_buffer_下次再换回queue_，底层容器（比如SegmentQueue的空闲池）可以一直复用
+     */
+    bool pop_all_impl(std::vector<T>& out, bool block, const Clock::time_point* deadline) {
+        std::unique_lock<std::mutex> drain_lock(drain_mutex_, std::defer_lock);
+        
+        // 其他消费者正在用drain_buffer_时，临时创建一个
+        std::unique_ptr<Container> temp;
+        Container* items = nullptr;
+        
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            
+            if(block){
+                if(!wait_not_empty(lock, pop_waiters_, deadline)){
+                    return false;
+                }
+            }
+            else if(stop_ || queue_.empty()){
+                return false;
+            }
+            
+            // 只取出一部分时不能交换，在锁内移动，最多是内存中的元素个数
+            size_t limit = drainable_size(queue_);
+            if(limit < queue_.size()){
+                take_up_to(limit, out);
+                return true;
+            }
+            
+            // 持有mutex_时不能等待drain_mutex_，否则会挡住所有的生产者，这里只try_lock
+            if(drain_lock.try_lock()){
+                items = &drain_buffer_;
+            }
+            else {
+                temp.reset(new Container());
+                items = temp.get();
+            }
+            
+            items->swap(queue_);
+            
+            on_popped(items->size());
+        }
+        
+        out.reserve(out.size() + items->size());
+        
+        while(!items->empty()){
+            out.push_back(std::move(items->front()));
+            items->pop_front();
+        }
+        
+        return true;
+    }
+    
+    template<class U>
+    bool push_impl(U&& val, const Clock::time_point* deadline) {
+        spin_waiter_.on_arrival();
+        
+        std::unique_lock<std::mutex> lock(mutex_);
+        
+        if(!reserve_slot(lock, deadline)){
+            return false;
+        }
+        
+        queue_.push_back(std::forward<U>(val));
+        
+        on_pushed(1);
+        
+        return true;
+    }
+    
+    /* 加锁之后调用，为一个新元素腾出位置
+     * deadline: QUEUE_FULL_BLOCK策略下的等待期限，为nullptr时一直等待
+     * 返回false表示不能写入（已经stop、被拒绝或者等待超时）
+     */
+    bool reserve_slot(std::unique_lock<std::mutex>& lock, const Clock::time_point* deadline) {
+        if(stop_){
+            return false;
+        }
+        
+        if(has_room()){
+            return true;
+        }
+        
+        if(full_policy_ == QUEUE_FULL_DROP_OLDEST){
+            queue_.pop_front();
+            ++dropped_;
+            return true;
+        }
+        
+        if(full_policy_ == QUEUE_FULL_BLOCK){
+            ++push_waiters_;
+            
+            if(deadline){
+                not_full_.wait_until(lock, *deadline, [&]{
+                    return (has_room() || stop_);
+                });
+            }
+            else {
+                not_full_.wait(lock, [&]{
+                    return (has_room() || stop_);
+                });
+            }
+            
+            --push_waiters_;
+            
+            if(stop_){
+                return false;
+            }
+            
+            if(has_room()){
+                return true;
+            }
+        }
+        
+        ++rejected_;
+        
+        return false;
+    }
+    
+    bool has_room() const {
+        return (capacity_ == 0 || queue_.size() < capacity_);
+    }
+    
+    // 加锁之后调用，写入了pushed个元素
+    void on_pushed(size_t pushed) {
+        count_.store(queue_.size(), std::memory_order_release);
+        
+        if(queue_.size() > high_water_mark_){
+            high_water_mark_ = queue_.size();
+        }
+        
+        notify_waiters(pushed);
+        
+        if(!notifiers_.empty()){
+            notifiers_.notify();
+        }
+    }
+    
+    // 加锁之后调用，取走了popped个元素，只在有生产者等待时才唤醒
+    void on_popped(size_t popped) {
+        count_.store(queue_.size(), std::memory_order_relaxed);
+        
+        if(push_waiters_ > 0){
+            if(popped > 1){
+                not_full_.notify_all();
+            }
+            else {
+                not_full_.notify_one();
+            }
+        }
+    }
+    
+    /* 加锁之后调用，只在有人等待时才唤醒
+     * 1、有front的等待者：front不取走数据，所有的等待者都应该看到这个数据，notify_all
+     * 2、只有pop的等待者：一个数据只够一个消费者，notify_one；一次写入多个数据时notify_all
+     * 3、没有等待者：不调用notify
+     */
+    void notify_waiters(size_t pushed) {
+        if(front_waiters_ > 0 || (pushed > 1 && pop_waiters_ > 1)){
+            cond_.notify_all();
+        }
+        else if(pop_waiters_ > 0){
+            cond_.notify_one();
+        }
+    }
+    
+    void take_front(T& val) {
+        val = std::move(queue_.front());
+        
+        queue_.pop_front();
+        
+        on_popped(1);
+    }
+    
+    void take_up_to(size_t n, std::vector<T>& out) {
+        if(n > queue_.size()){
+            n = queue_.size();
+        }
+        
+        out.reserve(out.size() + n);
+        
+        for(size_t i = 0; i < n; ++i){
+            out.push_back(std::move(queue_.front()));
+            queue_.pop_front();
+        }
+        
+        on_popped(n);
+    }
+    
     mutable std::mutex mutex_;
     std::condition_variable cond_;
     
-    std::deque<T> queue_;
-    bool stop_ = false;
+    // 设置了容量时，生产者等待队列不满
+    std::condition_variable not_full_;
+    
+    Container queue_;
+    
+    // 修改时加锁；自旋等待时不加锁读取，所以是原子变量
+    std::atomic<bool> stop_ {false};
+    
+    // pop_all时和queue_交换，见pop_all_impl
+    Container drain_buffer_;
+    std::mutex drain_mutex_;
+    
+    // 容量，0表示不限制
+    size_t capacity_ = 0;
+    QueueFullPolicy full_policy_ = QUEUE_FULL_BLOCK;
+    
+    // 统计，加锁访问
+    size_t high_water_mark_ = 0;
+    uint64_t dropped_ = 0;
+    uint64_t rejected_ = 0;
+    
+    // 正在等待的消费者/生产者个数，加锁访问
+    int pop_waiters_ = 0;
+    int front_waiters_ = 0;
+    int push_waiters_ = 0;
+    
+    // 队列中元素的个数，不加锁就可以读取，用于自旋等待
+    std::atomic<size_t> count_;
+    
+    SpinWaiter spin_waiter_;
+    
+    // 挂接的通知器，加锁访问
+    NotifierList notifiers_;
     
     LAZY_DISALLOW_COPY_AND_ASSIGN(DataQueue);
 };
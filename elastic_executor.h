@@ -0,0 +1,555 @@
+//
+//  elastic_executor.h
+//
+
+#ifndef __LAZY_ELASTIC_EXECUTOR_H__2024__
+#define __LAZY_ELASTIC_EXECUTOR_H__2024__
+
+#include <stdint.h>
+#include <assert.h>
+#include <deque>
+#include <map>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+
+#include "lazy_base_common.h"
+
+#include "task_queue.h"
+#include "time_utils.h"
+
+namespace lazy {
+
+/*
+** 弹性线程池
+** 1、任务模型和TaskQueue一样（QueuedTask），支持异步的post和同步的invoke，但是不保证任务的执行顺序
+** 2、任务的排队时间超过target_wait_us，并且没有空闲线程时，增加一个线程（不超过max_threads）
+**    除了入队/出队时检查，还有一个监控线程在队头任务的排队时间将要超过target_wait_us时检查，
+**    所有线程都被长任务占住、又没有新任务投递时也能扩容；队列为空或者有空闲线程时监控线程一直挂起
+**    新建的线程开始取任务之前不再扩容，同一个排队很久的任务只会增加一个线程
+** 3、线程空闲超过idle_timeout_ms就退出（不少于min_threads）
+** 4、扩容/缩容的次数以及排队时间等通过metrics()获取，也可以设置回调实时得到通知
+** 5、stop可以在线程池的线程（任务或者回调）中调用，此时不会join调用者自己，它会在执行完剩下的任务之后退出，
+**    由之后的stop或者析构来join；析构不能在线程池的线程中执行
+*/
+class ElasticExecutor {
+public:
+    struct Config {
+        // 最少的线程数，可以为0，此时没有任务的时候所有线程都会退出
+        size_t min_threads = 1;
+
+        // 最多的线程数
+        size_t max_threads = 8;
+
+        // 任务排队等待的时间超过这个值就扩容
+        uint32_t target_wait_us = 1000;
+
+        // 线程空闲的时间超过这个值就退出
+        uint32_t idle_timeout_ms = 10000;
+    };
+
+    struct Metrics {
+        // 当前的线程数
+        size_t threads = 0;
+
+        // 当前空闲的线程数
+        size_t idle_threads = 0;
+
+        // 线程数的峰值
+        size_t peak_threads = 0;
+
+        // 扩容的次数
+        uint64_t grow_count = 0;
+
+        // 缩容的次数
+        uint64_t shrink_count = 0;
+
+        // 投递的任务数
+        uint64_t posted = 0;
+
+        // 执行完的任务数
+        uint64_t executed = 0;
+
+        // 正在排队的任务数
+        size_t pending = 0;
+
+        // 任务排队的时间
+        uint64_t max_wait_us = 0;
+        uint64_t avg_wait_us = 0;
+    };
+
+    // 扩容或者缩容之后的回调，grow等于true表示扩容，threads是调整之后的线程数
+    // 注意回调是在线程池自己的线程（或者调用post的线程）上执行的，不能阻塞
+    typedef std::function<void(bool grow, size_t threads)> ResizeCallback;
+
+    ElasticExecutor() : ElasticExecutor(Config()) {}
+
+    explicit ElasticExecutor(const Config& conf) : config_(conf) {
+        if(config_.max_threads == 0){
+            config_.max_threads = 1;
+        }
+
+        if(config_.min_threads > config_.max_threads){
+            config_.min_threads = config_.max_threads;
+        }
+    }
+
+    ~ElasticExecutor() {
+        // 在自己的线程里析构，线程函数返回时访问的是已经释放的对象
+        assert(!is_current());
+
+        stop();
+    }
+
+    // 创建min_threads个线程；不调用start的话，第一次post时也会创建线程
+    void start() {
+        std::vector<std::thread> exited;
+        size_t grown = 0;
+        size_t threads = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+
+            stop_ = false;
+
+            while(threads_ < config_.min_threads){
+                grow_locked();
+                ++grown;
+            }
+
+            start_monitor_locked();
+
+            threads = threads_;
+            exited.swap(exited_);
+        }
+
+        join_all(exited);
+
+        for(size_t i = 0; i < grown; ++i){
+            notify_resize(true, threads);
+        }
+    }
+
+    // 执行完所有排队的任务，然后退出所有线程
+    void stop() {
+        std::vector<std::thread> threads;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+
+            stop_ = true;
+
+            std::thread::id self = std::this_thread::get_id();
+
+            // 在线程池的线程中调用时，留下调用者自己，它退出时会把自己放进exited_
+            for(auto it = workers_.begin(); it != workers_.end();){
+                if(it->second.get_id() == self){
+                    ++it;
+                    continue;
+                }
+
+                threads.push_back(std::move(it->second));
+                it = workers_.erase(it);
+            }
+
+            for(auto& t : exited_){
+                threads.push_back(std::move(t));
+            }
+            exited_.clear();
+
+            // 在监控线程中（扩容的回调里）调用时同样不能join自己
+            if(monitor_.joinable() && monitor_.get_id() != self){
+                threads.push_back(std::move(monitor_));
+            }
+
+            cond_.notify_all();
+            monitor_cond_.notify_all();
+        }
+
+        join_all(threads);
+    }
+
+    // 判断当前线程是否为线程池中的线程
+    bool is_current() const {
+        return current_executor() == this;
+    }
+
+    void set_resize_callback(const ResizeCallback& cb) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        resize_cb_ = cb;
+    }
+
+    // 添加异步任务，stop之后返回false
+    template <class Closure>
+    bool post(Closure&& closure) {
+        std::shared_ptr<QueuedTask> task = MakeSharedClosure<void, Closure>(std::forward<Closure>(closure));
+        task->is_sync = false;
+
+        return enqueue(std::move(task));
+    }
+
+    // 执行同步任务，在线程池的线程中调用时直接执行
+    template <class ReturnT, class Closure>
+    ReturnT invoke(Closure&& closure) {
+        if(is_current()){
+            return closure();
+        }
+
+        std::shared_ptr<QueuedTask> task = MakeSharedClosure<ReturnT, Closure>(std::forward<Closure>(closure));
+        task->is_sync = true;
+        task->finished = false;
+
+        if(enqueue(task)){
+            // 等待任务执行结束
+            std::unique_lock<std::mutex> guard(sync_mutex_);
+            sync_cond_.wait(guard, [&] {
+                return task->finished;
+            });
+        }
+        else {
+            // 已经停止了，在当前线程执行
+            task->run();
+        }
+
+        ClosureTask<ReturnT, Closure>* ptr = (ClosureTask<ReturnT, Closure>*)task.get();
+        return ptr->move_result();
+    }
+
+    Metrics metrics() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        Metrics m = metrics_;
+        m.threads = threads_;
+        m.idle_threads = idle_;
+        m.pending = queue_.size();
+        m.avg_wait_us = m.executed > 0 ? total_wait_us_ / m.executed : 0;
+
+        return m;
+    }
+
+private:
+    struct Item {
+        std::shared_ptr<QueuedTask> task;
+
+        // 入队的时刻（单调时钟）
+        int64_t enqueue_time_us = 0;
+    };
+
+    bool enqueue(std::shared_ptr<QueuedTask> task) {
+        std::vector<std::thread> exited;
+        bool grown = false;
+        size_t threads = 0;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+
+            if(stop_){
+                return false;
+            }
+
+            Item item;
+            item.task = std::move(task);
+            item.enqueue_time_us = TimeUtil::MonoNowUs();
+            queue_.push_back(std::move(item));
+
+            ++metrics_.posted;
+
+            start_monitor_locked();
+
+            if(monitor_parked_){
+                monitor_cond_.notify_one();
+            }
+
+            if(idle_ > 0){
+                cond_.notify_one();
+            }
+            else {
+                // 没有空闲的线程，检查队头的任务等待了多久
+                int64_t wait_us = TimeUtil::MonoNowUs() - queue_.front().enqueue_time_us;
+                grown = maybe_grow_locked(wait_us);
+            }
+
+            threads = threads_;
+
+            if(grown){
+                exited.swap(exited_);
+            }
+        }
+
+        if(grown){
+            join_all(exited);
+            notify_resize(true, threads);
+        }
+
+        return true;
+    }
+
+    // 需要持有锁
+    bool maybe_grow_locked(int64_t wait_us) {
+        if(threads_ >= config_.max_threads){
+            return false;
+        }
+
+        // 上一次新建的线程还没有开始取任务，它会取走队头，不能因为同一个任务连续扩容
+        if(starting_ > 0){
+            return false;
+        }
+
+        // 没有线程的时候（min_threads等于0，或者还没有start），直接创建
+        if(threads_ > 0 && wait_us < (int64_t)config_.target_wait_us){
+            return false;
+        }
+
+        grow_locked();
+
+        return true;
+    }
+
+    // 需要持有锁
+    void start_monitor_locked() {
+        if(monitor_running_){
+            return;
+        }
+
+        // 上一个监控线程已经退出（stop是在它里面调用的），交给下一次扩容或者stop来join
+        if(monitor_.joinable()){
+            exited_.push_back(std::move(monitor_));
+        }
+
+        monitor_running_ = true;
+        monitor_ = std::thread(std::bind(&ElasticExecutor::monitor, this));
+    }
+
+    // 监控线程：所有线程都在忙、队列不为空时，在队头任务的排队时间到达target_wait_us的时刻检查是否需要扩容
+    void monitor() {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        while(!stop_){
+            // 队列为空、有空闲线程或者已经到了上限，扩容没有意义，等入队/出队时唤醒
+            if(queue_.empty() || idle_ > 0 || starting_ > 0 || threads_ >= config_.max_threads){
+                monitor_parked_ = true;
+                monitor_cond_.wait(lock);
+                monitor_parked_ = false;
+                continue;
+            }
+
+            int64_t wait_us = TimeUtil::MonoNowUs() - queue_.front().enqueue_time_us;
+
+            if(wait_us < (int64_t)config_.target_wait_us){
+                monitor_cond_.wait_for(lock, std::chrono::microseconds(config_.target_wait_us - wait_us));
+                continue;
+            }
+
+            grow_locked();
+
+            size_t threads = threads_;
+            std::vector<std::thread> exited;
+            exited.swap(exited_);
+
+            lock.unlock();
+
+            join_all(exited);
+            notify_resize(true, threads);
+
+            lock.lock();
+        }
+
+        monitor_running_ = false;
+    }
+
+    // 需要持有锁
+    void grow_locked() {
+        uint64_t id = next_worker_id_++;
+
+        ++threads_;
+        ++starting_;
+        ++metrics_.grow_count;
+
+        if(threads_ > metrics_.peak_threads){
+            metrics_.peak_threads = threads_;
+        }
+
+        workers_[id] = std::thread(std::bind(&ElasticExecutor::run, this, id));
+    }
+
+    // 线程函数
+    void run(uint64_t id) {
+        current_executor() = this;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        --starting_;
+
+        // 扩容之后监控线程在等新线程启动，队头仍然没有被取走的话交给它重新检查
+        if(!queue_.empty() && monitor_parked_){
+            monitor_cond_.notify_one();
+        }
+
+        bool retired = false;
+
+        while(true){
+            if(queue_.empty()){
+                if(stop_){
+                    break;
+                }
+
+                ++idle_;
+                bool ready = cond_.wait_for(lock, std::chrono::milliseconds(config_.idle_timeout_ms), [&]{
+                    return (!queue_.empty() || stop_);
+                });
+                --idle_;
+
+                // 空闲超时，退出
+                if(!ready && threads_ > config_.min_threads){
+                    retired = true;
+                    break;
+                }
+
+                continue;
+            }
+
+            Item item = std::move(queue_.front());
+            queue_.pop_front();
+
+            // 新的队头可能已经等了很久，交给监控线程检查
+            if(!queue_.empty() && monitor_parked_){
+                monitor_cond_.notify_one();
+            }
+
+            int64_t wait_us = TimeUtil::MonoNowUs() - item.enqueue_time_us;
+
+            total_wait_us_ += wait_us;
+
+            if((uint64_t)wait_us > metrics_.max_wait_us){
+                metrics_.max_wait_us = wait_us;
+            }
+
+            // 队列里还有任务，但是没有空闲的线程了，并且排队时间已经超过目标
+            bool grown = false;
+            size_t threads = 0;
+            std::vector<std::thread> exited;
+            if(!stop_ && !queue_.empty() && idle_ == 0){
+                grown = maybe_grow_locked(wait_us);
+                threads = threads_;
+                if(grown){
+                    exited.swap(exited_);
+                }
+            }
+
+            lock.unlock();
+
+            if(grown){
+                join_all(exited);
+                notify_resize(true, threads);
+            }
+
+            item.task->run();
+
+            // 对于同步任务，在这里进行唤醒操作
+            if(item.task->is_sync){
+                std::unique_lock<std::mutex> guard(sync_mutex_);
+                item.task->finished = true;
+                sync_cond_.notify_all();
+            }
+
+            item.task.reset();
+
+            lock.lock();
+
+            ++metrics_.executed;
+        }
+
+        --threads_;
+
+        // 自己不能join自己，交给下一次扩容或者stop来join
+        auto it = workers_.find(id);
+        if(it != workers_.end()){
+            exited_.push_back(std::move(it->second));
+            workers_.erase(it);
+        }
+
+        if(retired){
+            ++metrics_.shrink_count;
+
+            size_t threads = threads_;
+
+            lock.unlock();
+
+            notify_resize(false, threads);
+        }
+
+        current_executor() = nullptr;
+    }
+
+    void notify_resize(bool grow, size_t threads) {
+        ResizeCallback cb;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cb = resize_cb_;
+        }
+
+        if(cb){
+            cb(grow, threads);
+        }
+    }
+
+    static void join_all(std::vector<std::thread>& threads) {
+        for(auto& t : threads){
+            if(t.joinable()){
+                t.join();
+            }
+        }
+        threads.clear();
+    }
+
+    static const ElasticExecutor*& current_executor() {
+        static thread_local const ElasticExecutor* executor = nullptr;
+        return executor;
+    }
+
+    Config config_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+
+    std::deque<Item> queue_;
+
+    std::map<uint64_t, std::thread> workers_;
+
+    // 监控队头排队时间的线程
+    std::thread monitor_;
+    std::condition_variable monitor_cond_;
+    bool monitor_running_ = false;
+    // 监控线程在无限期地等待（没有设置超时）
+    bool monitor_parked_ = false;
+
+    // 已经退出、等待join的线程
+    std::vector<std::thread> exited_;
+
+    uint64_t next_worker_id_ = 0;
+
+    size_t threads_ = 0;
+    size_t idle_ = 0;
+    // 已经创建、还没有开始取任务的线程个数，扩容时当作空闲的线程
+    size_t starting_ = 0;
+
+    bool stop_ = false;
+
+    Metrics metrics_;
+    uint64_t total_wait_us_ = 0;
+
+    ResizeCallback resize_cb_;
+
+    std::mutex sync_mutex_;
+    std::condition_variable sync_cond_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(ElasticExecutor);
+};
+
+}
+
+#endif /* __LAZY_ELASTIC_EXECUTOR_H__2024__ */
@@ -5,63 +5,200 @@
 #ifndef _LAZY_EVENT_H_2024_
 #define _LAZY_EVENT_H_2024_
 
+#include <stdint.h>
 #include <mutex>
-#include <condition_variable>
+#include <atomic>
 #include <chrono>
 
 #include "lazy_base_common.h"
 
+#include "futex.h"
+#include "notifier.h"
+
 namespace lazy {
 
+// Event被wait到之后是否自动复位
+enum EventResetMode {
+    // 一次wake_up只让一个wait返回，返回的时候自动复位（默认）
+    EVENT_AUTO_RESET = 0,
+
+    // wake_up之后所有的wait都立即返回，直到调用reset
+    EVENT_MANUAL_RESET = 1,
+};
+
 /**
  * 所谓假唤醒，有两种说法（场景：一个生产者、多个消费者）：
  * 1、生产者产生一个数据，使用notify_all把所有的消费者唤醒，但是队列中只有一个数据，只有一个消费者能取出数据，对于其他消费者来说，这就是假唤醒
  * 2、由于系统的调度，阻塞的消费者线程被临时唤醒
  * 3、解决假唤醒的方法是，在被唤醒之后，检查某个标识是否被设置，如果被设置了，那么表示真的被唤醒，否则是假唤醒
+ *
+ * 实现：状态放在一个32位的原子变量中，最低位表示已经wake_up，其余的位是正在挂起的wait的个数，挂起/唤醒使用futex
+ * 1、没有人在等待时，wake_up只是一次原子操作，不加锁，也没有系统调用
+ * 2、已经wake_up时，wait只是一次CAS
+ * 3、检查状态和挂起在同一个原子变量上，wake_up发生在检查之后、挂起之前时futex不会挂起，不会丢失唤醒
  */
 class Event {
 public:
-    Event(){
-        
+    explicit Event(EventResetMode mode = EVENT_AUTO_RESET) : mode_(mode), state_(0), has_notifiers_(false) {
+
     }
-    
+
     ~Event(){
     }
-    
+
+    /* 等待wake_up
+     * timeout_ms: 小于0表示一直等待，等于0表示不等待
+     * 返回true表示等到了wake_up，false表示超时
+     * 自动复位模式下返回true的同时复位，同一次wake_up只有一个wait能返回true
+     */
     bool wait(int32_t timeout_ms = -1){
-        std::unique_lock<std::mutex> lock(mutex_);
-        
-        if(timeout_ms > 0){
-            cond_.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&]{return state_ == STATE_WAKEUP;});
+        if(try_wait()){
+            return true;
         }
-        else {
-            cond_.wait(lock,[&]{return (state_ == STATE_WAKEUP);});
+
+        if(timeout_ms == 0){
+            return false;
+        }
+
+        if(timeout_ms < 0){
+            return wait_impl(nullptr);
         }
-        
-        state_ = STATE_WAIT;
-        
-        return true;
+
+        Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+
+        return wait_impl(&deadline);
     }
-    
+
+    // 不等待
+    bool try_wait(){
+        uint32_t state = state_.load(std::memory_order_acquire);
+
+        while(state & kSignaled){
+            if(mode_ == EVENT_MANUAL_RESET){
+                return true;
+            }
+
+            if(state_.compare_exchange_weak(state, state & ~kSignaled, std::memory_order_acquire)){
+                return true;
+            }
+        }
+
+        return false;
+    }
+
     void wake_up(){
+        uint32_t old = state_.fetch_or(kSignaled);
+
+        // 只有有人挂起时才调用futex；已经是wake_up的状态时，挂起的wait已经被唤醒过了
+        if((old & kSignaled) == 0 && old >= kWaiter){
+            if(mode_ == EVENT_MANUAL_RESET){
+                Futex::wake_all(state_);
+            }
+            else {
+                Futex::wake(state_, 1);
+            }
+        }
+
+        // 和attach_notifier配对（都是seq_cst）：要么这里看到通知器，要么Selector检查时看到wake_up的状态
+        if(has_notifiers_.load()){
+            std::unique_lock<std::mutex> lock(mutex_);
+            notifiers_.notify();
+        }
+    }
+
+    // 复位，只在手动复位模式下需要
+    void reset(){
+        state_.fetch_and(~kSignaled, std::memory_order_release);
+    }
+
+    // 已经被wake_up，并且还没有被wait（自动复位模式）或者reset（手动复位模式）
+    bool is_set() const {
+        return (state_.load() & kSignaled) != 0;
+    }
+
+    // 挂接通知器，之后每次wake_up都会通知它，见Selector
+    void attach_notifier(Notifier* notifier) {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        notifiers_.attach(notifier);
+
+        has_notifiers_.store(true);
+    }
+
+    void detach_notifier(Notifier* notifier) {
         std::unique_lock<std::mutex> lock(mutex_);
-        
-        state_ = STATE_WAKEUP;
-        
-        cond_.notify_all();
+
+        notifiers_.detach(notifier);
+
+        has_notifiers_.store(!notifiers_.empty());
     }
-    
+
 private:
-    enum State{
-        STATE_WAIT = 0,
-        STATE_WAKEUP = 1,
-    };
-    
+    typedef std::chrono::steady_clock Clock;
+
+    // 最低位：已经wake_up
+    static const uint32_t kSignaled = 1;
+
+    // 其余的位：挂起的wait的个数
+    static const uint32_t kWaiter = 2;
+
+    bool wait_impl(const Clock::time_point* deadline){
+        state_.fetch_add(kWaiter, std::memory_order_relaxed);
+
+        bool timeout = false;
+
+        while(true){
+            uint32_t state = state_.load(std::memory_order_acquire);
+
+            if(state & kSignaled){
+                // 自动复位模式下，复位和退出等待一起完成
+                uint32_t next = (mode_ == EVENT_MANUAL_RESET) ? state - kWaiter : (state & ~kSignaled) - kWaiter;
+
+                if(state_.compare_exchange_weak(state, next, std::memory_order_acquire)){
+                    return true;
+                }
+                continue;
+            }
+
+            if(timeout){
+                // 退出之前还没有wake_up，才算超时
+                if(state_.compare_exchange_weak(state, state - kWaiter, std::memory_order_relaxed)){
+                    return false;
+                }
+                continue;
+            }
+
+            if(deadline){
+                Clock::time_point now = Clock::now();
+
+                if(now >= *deadline){
+                    timeout = true;
+                    continue;
+                }
+
+                std::chrono::nanoseconds left = std::chrono::duration_cast<std::chrono::nanoseconds>(*deadline - now);
+
+                Futex::wait(state_, state, &left);
+            }
+            else {
+                Futex::wait(state_, state);
+            }
+        }
+    }
+
+    EventResetMode mode_;
+
+    std::atomic<uint32_t> state_;
+
+    // 有挂接的通知器，不加锁就可以判断
+    std::atomic<bool> has_notifiers_;
+
+    // 保护notifiers_
     std::mutex mutex_;
-    std::condition_variable cond_;
-    
-    State state_ = STATE_WAIT;
-    
+
+    // 挂接的通知器，加锁访问
+    NotifierList notifiers_;
+
     LAZY_DISALLOW_COPY_AND_ASSIGN(Event);
 };
 
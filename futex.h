@@ -0,0 +1,122 @@
+//
+//  futex.h
+//
+
+#ifndef __LAZY_FUTEX_H__2024__
+#define __LAZY_FUTEX_H__2024__
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+
+#if defined(__linux__)
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#else
+#include <mutex>
+#include <condition_variable>
+#endif
+
+#include "lazy_base_common.h"
+
+namespace lazy {
+
+/*
+** 在一个32位的原子变量（字）上等待/唤醒，类似C++20的atomic::wait/notify
+** 1、wait(word, expected)：字的值还等于expected时才挂起，检查和挂起是原子的，不会丢失唤醒
+** 2、修改字的值之后调用wake唤醒挂起的线程
+** 3、Linux上直接用futex系统调用，不需要额外的锁；shared为true时字可以放在共享内存中，用于进程间同步
+** 4、其他平台用按地址散列的mutex+条件变量模拟，只能用于进程内（shared无效）
+*/
+class Futex {
+public:
+    /* 字的值等于expected时挂起，直到被wake或者超时
+     * timeout: 为nullptr时一直等待
+     * 返回false表示超时；被唤醒、值已经改变或者被信号打断都返回true，调用者需要重新检查条件
+     */
+    static bool wait(std::atomic<uint32_t>& word, uint32_t expected,
+                     const std::chrono::nanoseconds* timeout = nullptr, bool shared = false) {
+#if defined(__linux__)
+        struct timespec ts;
+        struct timespec* pts = nullptr;
+
+        if(timeout){
+            int64_t ns = timeout->count() > 0 ? (int64_t)timeout->count() : 0;
+            ts.tv_sec = (time_t)(ns / 1000000000);
+            ts.tv_nsec = (long)(ns % 1000000000);
+            pts = &ts;
+        }
+
+        long ret = syscall(SYS_futex, address(word), shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, expected, pts, nullptr, 0);
+
+        return !(ret != 0 && errno == ETIMEDOUT);
+#else
+        (void)shared;
+
+        Bucket& bucket = bucket_of(word);
+
+        std::unique_lock<std::mutex> lock(bucket.mutex);
+
+        if(word.load() != expected){
+            return true;
+        }
+
+        if(timeout){
+            return bucket.cond.wait_for(lock, *timeout) != std::cv_status::timeout;
+        }
+
+        bucket.cond.wait(lock);
+
+        return true;
+#endif
+    }
+
+    // 最多唤醒count个挂起的线程，返回唤醒的个数（模拟实现中不准确）
+    static int wake(std::atomic<uint32_t>& word, int count, bool shared = false) {
+#if defined(__linux__)
+        long ret = syscall(SYS_futex, address(word), shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+        return ret > 0 ? (int)ret : 0;
+#else
+        (void)shared;
+
+        Bucket& bucket = bucket_of(word);
+
+        // 加锁保证等待者要么还没有检查字的值，要么已经挂起了
+        std::unique_lock<std::mutex> lock(bucket.mutex);
+
+        // 同一个桶中可能有等待其他字的线程，只能全部唤醒
+        bucket.cond.notify_all();
+
+        return count;
+#endif
+    }
+
+    static int wake_all(std::atomic<uint32_t>& word, bool shared = false) {
+        return wake(word, 0x7fffffff, shared);
+    }
+
+private:
+#if defined(__linux__)
+    static uint32_t* address(std::atomic<uint32_t>& word) {
+        static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be 32 bits");
+        return reinterpret_cast<uint32_t*>(&word);
+    }
+#else
+    struct Bucket {
+        std::mutex mutex;
+        std::condition_variable cond;
+    };
+
+    static Bucket& bucket_of(std::atomic<uint32_t>& word) {
+        static Bucket buckets[64];
+        return buckets[(reinterpret_cast<uintptr_t>(&word) / sizeof(uint32_t)) % 64];
+    }
+#endif
+};
+
+}
+
+#endif /* __LAZY_FUTEX_H__2024__ */
@@ -7,188 +7,474 @@
 
 #include "lazy_base_common.h"
 
+#include <string.h>
 #include <unordered_map>
 #include <string>
+#include <set>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
 #include <mutex>
+#include <atomic>
+#include <type_traits>
+
+#include "rcu.h"
+#include "task_queue.h"
 
 namespace lazy {
 
+// ConfigKey的值的类别，和GlobalConfig里按类型分开的几张表对应，同名不同类别的配置互不相干
+enum ConfigValueType {
+    CONFIG_TYPE_INT64 = 0,
+    CONFIG_TYPE_UINT64 = 1,
+    CONFIG_TYPE_BOOL = 2,
+    CONFIG_TYPE_DOUBLE = 3,
+    CONFIG_TYPE_COUNT = 4,
+};
+
+// 值和64位原子变量之间的转换，storage_type是GlobalConfig::set/get使用的类型
+template<class T, class Enable = void>
+struct ConfigValueTraits;
+
+template<class T>
+struct ConfigValueTraits<T, typename std::enable_if<std::is_same<T, bool>::value>::type> {
+    typedef bool storage_type;
+    static const ConfigValueType kType = CONFIG_TYPE_BOOL;
+
+    static uint64_t encode(T v) { return v ? 1 : 0; }
+    static T decode(uint64_t bits) { return bits != 0; }
+};
+
+template<class T>
+struct ConfigValueTraits<T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type> {
+    typedef int64_t storage_type;
+    static const ConfigValueType kType = CONFIG_TYPE_INT64;
+
+    static uint64_t encode(T v) { return (uint64_t)(int64_t)v; }
+    static T decode(uint64_t bits) { return (T)(int64_t)bits; }
+};
+
+template<class T>
+struct ConfigValueTraits<T, typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value && !std::is_same<T, bool>::value>::type> {
+    typedef uint64_t storage_type;
+    static const ConfigValueType kType = CONFIG_TYPE_UINT64;
+
+    static uint64_t encode(T v) { return (uint64_t)v; }
+    static T decode(uint64_t bits) { return (T)bits; }
+};
+
+template<class T>
+struct ConfigValueTraits<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+    typedef double storage_type;
+    static const ConfigValueType kType = CONFIG_TYPE_DOUBLE;
+
+    static uint64_t encode(T v) {
+        double d = v;
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        return bits;
+    }
+
+    static T decode(uint64_t bits) {
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        return (T)d;
+    }
+};
+
+class GlobalConfig;
+
+/*
+** 预先解析好的配置句柄
+** 1、由GlobalConfig::key注册得到，注册时按名字找到（或者分配）一个64位的原子变量，之后读只是一次原子load，不哈希字符串，也不进入RCU
+** 2、GlobalConfig::set同名同类别的配置时会同步更新这个原子变量，ConfigKey::set也会更新GlobalConfig里的表，两边看到的值是一致的
+** 3、只支持整数、bool、浮点数，字符串仍然用GlobalConfig::get
+** 4、可以拷贝，不能比注册它的GlobalConfig活得更久
+*/
+template<class T>
+class ConfigKey {
+public:
+    typedef ConfigValueTraits<T> Traits;
+
+    ConfigKey() : config_(nullptr), name_(nullptr), slot_(nullptr) {
+    }
+
+    T get() const {
+        return Traits::decode(slot_->load(std::memory_order_acquire));
+    }
+
+    // 和GlobalConfig::set(name(), value)一样
+    void set(const T& value) const;
+
+    const std::string& name() const {
+        return *name_;
+    }
+
+    // 是否已经注册
+    bool valid() const {
+        return slot_ != nullptr;
+    }
+
+private:
+    friend class GlobalConfig;
+
+    ConfigKey(GlobalConfig* config, const std::string* name, std::atomic<uint64_t>* slot)
+    : config_(config), name_(name), slot_(slot) {
+    }
+
+    GlobalConfig* config_;
+    const std::string* name_;
+    std::atomic<uint64_t>* slot_;
+};
+
+/*
+** 全局配置
+** 1、所有的配置放在一份不可变的快照里，通过原子指针发布；读的一方在RCU临界区内查快照，不加锁
+** 2、set拷贝一份快照、修改、发布，等已经在读旧快照的线程全部离开之后再释放旧快照（写时拷贝）
+** 3、写的开销和配置的个数成正比，适合读多写少
+** 4、get返回的是值的拷贝，不会引用到已经释放的快照
+** 5、热路径上用key注册ConfigKey，读的时候不用每次构造、哈希字符串
+** 6、subscribe/subscribe_prefix订阅变化，set之后在订阅者的TaskQueue上回调，不用定时轮询；
+**    回调执行之前的多次变化合并成一次，回调参数是这期间变化过的配置名，回调里读到的是最新的值
+*/
 class GlobalConfig {
 public:
+    // 参数是合并之后变化过的配置名（有序、不重复）
+    typedef std::function<void(const std::vector<std::string>& keys)> ChangeCallback;
+    
     static GlobalConfig& instance(){
         static GlobalConfig inst;
         return inst;
     }
     
-    GlobalConfig(){
+    GlobalConfig() : snapshot_(new Snapshot()){
         
     }
     
     ~GlobalConfig(){
-        
+        delete snapshot_.load();
     }
     
     void set(const std::string& key, uint64_t val){
-        std::unique_lock<std::mutex> lock(mutex_);
-        uint64_map_[key] = val;
+        update(&Snapshot::uint64_map, key, val);
     }
     
     void set(const std::string& key, int64_t val){
-        std::unique_lock<std::mutex> lock(mutex_);
-        int64_map_[key] = val;
+        update(&Snapshot::int64_map, key, val);
     }
     
     void set(const std::string& key, unsigned int val){
-        std::unique_lock<std::mutex> lock(mutex_);
-        uint64_map_[key] = val;
+        update(&Snapshot::uint64_map, key, (uint64_t)val);
     }
     
     void set(const std::string& key, int val){
-        std::unique_lock<std::mutex> lock(mutex_);
-        int64_map_[key] = val;
+        update(&Snapshot::int64_map, key, (int64_t)val);
     }
     
     void set(const std::string& key, bool val){
-        std::unique_lock<std::mutex> lock(mutex_);
-        bool_map_[key] = val;
+        update(&Snapshot::bool_map, key, val);
     }
     
     void set(const std::string& key, const std::string& val){
-        std::unique_lock<std::mutex> lock(mutex_);
-        str_map_[key] = val;
+        update(&Snapshot::str_map, key, val);
     }
     
     void set(const std::string& key, const double& val){
-        std::unique_lock<std::mutex> lock(mutex_);
-        float_map_[key] = val;
+        update(&Snapshot::float_map, key, val);
     }
     
     uint64_t get(const std::string& key, uint64_t default_val){
-        std::unique_lock<std::mutex> lock(mutex_);
+        return lookup(&Snapshot::uint64_map, key, default_val);
+    }
+    
+    int get(const std::string& key, int default_val){
+        return (int)lookup(&Snapshot::int64_map, key, (int64_t)default_val);
+    }
+    
+    unsigned int get(const std::string& key, unsigned int default_val){
+        return (unsigned int)lookup(&Snapshot::uint64_map, key, (uint64_t)default_val);
+    }
+    
+    int64_t get(const std::string& key, int64_t default_val){
+        return lookup(&Snapshot::int64_map, key, default_val);
+    }
+    
+    bool get(const std::string& key, bool default_val){
+        return lookup(&Snapshot::bool_map, key, default_val);
+    }
+    
+    // 返回拷贝：快照随时可能被替换、释放
+    std::string get(const std::string& key, const std::string& default_val){
+        return lookup(&Snapshot::str_map, key, default_val);
+    }
+    
+    std::string get(const std::string& key, const char* default_val){
+        RcuReadGuard guard(rcu_);
         
-        auto* m = &uint64_map_;
+        const Snapshot* snapshot = snapshot_.load();
         
-        auto it = m->find(key);
+        auto it = snapshot->str_map.find(key);
         
-        if(it == m->end()){
-            return default_val;
+        if(it == snapshot->str_map.end()){
+            return default_val ? default_val : "";
         }
         
         return it->second;
     }
     
-    int get(const std::string& key, int default_val){
+    double get(const std::string& key, double default_val){
+        return lookup(&Snapshot::float_map, key, default_val);
+    }
+    
+    /* 注册一个配置句柄，同名同类别的配置共用一个原子变量
+     * default_val: 还没有set过时的值；已经注册过时以第一次注册的为准
+     */
+    template<class T>
+    ConfigKey<T> key(const std::string& name, const T& default_val = T()){
+        typedef ConfigValueTraits<T> Traits;
+        typedef typename Traits::storage_type S;
+        
         std::unique_lock<std::mutex> lock(mutex_);
         
-        auto* m = &int64_map_;
+        auto& index = slot_index_[Traits::kType];
         
-        auto it = m->find(key);
+        auto it = index.find(name);
         
-        if(it == m->end()){
-            return default_val;
+        if(it == index.end()){
+            slots_.emplace_back();
+            
+            std::atomic<uint64_t>* slot = &slots_.back();
+            
+            // 已经set过就用set的值
+            S val = lookup(field_of(S()), name, (S)default_val);
+            slot->store(ConfigValueTraits<S>::encode(val));
+            
+            it = index.emplace(name, slot).first;
         }
         
-        return (int)it->second;
+        return ConfigKey<T>(this, &it->first, it->second);
     }
     
-    unsigned int get(const std::string& key, unsigned int default_val){
+    /* 订阅一个配置的变化（不区分类型），返回订阅ID，用于unsubscribe
+     * queue: 回调在这个任务队列上执行，必须比订阅活得更久（或者先unsubscribe）
+     */
+    uint64_t subscribe(const std::string& key, TaskQueue& queue, const ChangeCallback& callback){
+        return add_subscription(key, false, queue, callback);
+    }
+    
+    // 订阅所有以prefix开头的配置的变化，比如"net."
+    uint64_t subscribe_prefix(const std::string& prefix, TaskQueue& queue, const ChangeCallback& callback){
+        return add_subscription(prefix, true, queue, callback);
+    }
+    
+    // 取消订阅；在订阅者的任务队列上调用时，返回之后不会再有回调
+    void unsubscribe(uint64_t id){
         std::unique_lock<std::mutex> lock(mutex_);
         
-        auto* m = &uint64_map_;
-        
-        auto it = m->find(key);
-        
-        if(it == m->end()){
-            return default_val;
+        for(auto it = subscriptions_.begin(); it != subscriptions_.end(); ++it){
+            if((*it)->id == id){
+                (*it)->active.store(false);
+                subscriptions_.erase(it);
+                return;
+            }
         }
-        
-        return (unsigned int)it->second;
     }
+private:
     
-    int64_t get(const std::string& key, int64_t default_val){
-        std::unique_lock<std::mutex> lock(mutex_);
+    LAZY_DISALLOW_COPY_AND_ASSIGN(GlobalConfig);
+    
+    // 发布之后不再修改
+    struct Snapshot {
+        std::unordered_map<std::string, uint64_t> uint64_map;
+        std::unordered_map<std::string, int64_t> int64_map;
         
-        auto* m = &int64_map_;
+        std::unordered_map<std::string, bool> bool_map;
+        std::unordered_map<std::string, std::string> str_map;
         
-        auto it = m->find(key);
+        std::unordered_map<std::string, double> float_map;
+    };
+    
+    template<class Map, class V>
+    V lookup(Map Snapshot::* field, const std::string& key, const V& default_val){
+        RcuReadGuard guard(rcu_);
+        
+        // seq_cst，见RcuDomain
+        const Map& m = snapshot_.load()->*field;
         
-        if(it == m->end()){
+        auto it = m.find(key);
+        
+        if(it == m.end()){
             return default_val;
         }
         
         return it->second;
     }
     
-    bool get(const std::string& key, bool default_val){
+    struct Subscription {
+        uint64_t id;
+        std::string pattern;
+        bool prefix;
+        TaskQueue* queue;
+        ChangeCallback callback;
+        
+        std::atomic<bool> active;
+        
+        // 保护pending和scheduled
+        std::mutex mutex;
+        // 还没有回调的变化
+        std::set<std::string> pending;
+        // 已经向任务队列投递了回调，还没有执行
+        bool scheduled = false;
+        
+        bool match(const std::string& key) const {
+            if(prefix){
+                return key.compare(0, pattern.size(), pattern) == 0;
+            }
+            return key == pattern;
+        }
+    };
+    
+    uint64_t add_subscription(const std::string& pattern, bool prefix, TaskQueue& queue, const ChangeCallback& callback){
+        std::shared_ptr<Subscription> sub = std::make_shared<Subscription>();
+        sub->pattern = pattern;
+        sub->prefix = prefix;
+        sub->queue = &queue;
+        sub->callback = callback;
+        sub->active.store(true);
+        
         std::unique_lock<std::mutex> lock(mutex_);
         
-        auto* m = &bool_map_;
+        sub->id = ++next_subscription_id_;
         
-        auto it = m->find(key);
+        subscriptions_.push_back(sub);
         
-        if(it == m->end()){
-            return default_val;
+        return sub->id;
+    }
+    
+    // 持有mutex_时调用；已经有回调在排队的订阅只记录配置名，不再投递
+    void notify(const std::string& key){
+        for(const std::shared_ptr<Subscription>& sub : subscriptions_){
+            if(!sub->match(key)){
+                continue;
+            }
+            
+            {
+                std::unique_lock<std::mutex> lock(sub->mutex);
+                
+                sub->pending.insert(key);
+                
+                if(sub->scheduled){
+                    continue;
+                }
+                
+                sub->scheduled = true;
+            }
+            
+            std::shared_ptr<Subscription> ref = sub;
+            
+            sub->queue->post([ref]{
+                std::vector<std::string> keys;
+                {
+                    std::unique_lock<std::mutex> lock(ref->mutex);
+                    
+                    keys.assign(ref->pending.begin(), ref->pending.end());
+                    ref->pending.clear();
+                    ref->scheduled = false;
+                }
+                
+                if(ref->active.load() && !keys.empty()){
+                    ref->callback(keys);
+                }
+            });
         }
-        
-        return it->second;
     }
     
-    const std::string& get(const std::string& key, const std::string& default_val){
-        std::unique_lock<std::mutex> lock(mutex_);
+    static std::unordered_map<std::string, int64_t> Snapshot::* field_of(int64_t){
+        return &Snapshot::int64_map;
+    }
+    
+    static std::unordered_map<std::string, uint64_t> Snapshot::* field_of(uint64_t){
+        return &Snapshot::uint64_map;
+    }
+    
+    static std::unordered_map<std::string, bool> Snapshot::* field_of(bool){
+        return &Snapshot::bool_map;
+    }
+    
+    static std::unordered_map<std::string, double> Snapshot::* field_of(double){
+        return &Snapshot::float_map;
+    }
+    
+    // 同步到注册过的ConfigKey，持有mutex_时调用
+    template<class V>
+    void store_slot(const std::string& key, const V& val){
+        typedef ConfigValueTraits<V> Traits;
         
-        auto* m = &str_map_;
+        auto& index = slot_index_[Traits::kType];
         
-        auto it = m->find(key);
+        auto it = index.find(key);
         
-        if(it == m->end()){
-            return default_val;
+        if(it != index.end()){
+            it->second->store(Traits::encode(val), std::memory_order_release);
         }
-        
-        return it->second;
     }
     
-    const char* get(const std::string& key, const char* default_val){
+    void store_slot(const std::string& key, const std::string& val){
+        (void)key;
+        (void)val;
+    }
+    
+    template<class Map, class V>
+    void update(Map Snapshot::* field, const std::string& key, const V& val){
         std::unique_lock<std::mutex> lock(mutex_);
         
-        auto* m = &str_map_;
+        Snapshot* old = snapshot_.load(std::memory_order_relaxed);
         
-        auto it = m->find(key);
-        
-        if(it == m->end()){
-            return default_val;
+        // 值没有变化时不拷贝、不通知
+        auto it = (old->*field).find(key);
+        if(it != (old->*field).end() && it->second == val){
+            return;
         }
         
-        return it->second.c_str();
-    }
-    
-    double get(const std::string& key, double default_val){
-        std::unique_lock<std::mutex> lock(mutex_);
+        Snapshot* next = new Snapshot(*old);
+        (next->*field)[key] = val;
         
-        auto* m = &float_map_;
+        snapshot_.store(next);
         
-        auto it = m->find(key);
+        store_slot(key, val);
         
-        if(it == m->end()){
-            return default_val;
-        }
+        notify(key);
         
-        return it->second;
+        // 等还在读旧快照的线程离开
+        rcu_.synchronize();
+        
+        delete old;
     }
-private:
-    
-    LAZY_DISALLOW_COPY_AND_ASSIGN(GlobalConfig);
     
+    // 写者之间串行
     std::mutex mutex_;
     
-    std::unordered_map<std::string, uint64_t> uint64_map_;
-    std::unordered_map<std::string, int64_t> int64_map_;
+    std::atomic<Snapshot*> snapshot_;
+    
+    RcuDomain rcu_;
     
-    std::unordered_map<std::string, bool> bool_map_;
-    std::unordered_map<std::string, std::string> str_map_;
+    // ConfigKey的原子变量，按类别、名字索引，持有mutex_时访问
+    std::unordered_map<std::string, std::atomic<uint64_t>*> slot_index_[CONFIG_TYPE_COUNT];
     
-    std::unordered_map<std::string, double> float_map_;
+    // 只增不减，deque在尾部追加时已有元素的地址不变，ConfigKey直接持有地址
+    std::deque<std::atomic<uint64_t>> slots_;
+    
+    // 持有mutex_时访问
+    std::vector<std::shared_ptr<Subscription>> subscriptions_;
+    uint64_t next_subscription_id_ = 0;
 };
 
+template<class T>
+void ConfigKey<T>::set(const T& value) const {
+    config_->set(*name_, (typename Traits::storage_type)value);
+}
+
 }
 
 #endif /* _LAZY_GLOBAL_CONFIG_H_ */
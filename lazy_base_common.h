@@ -13,6 +13,21 @@
     TypeName(const TypeName&) = delete;             \
     LAZY_DISALLOW_ASSIGN(TypeName)
 
+// 缓存行的大小，用于隔离被不同线程频繁修改的变量，避免伪共享
+#define LAZY_CACHE_LINE_SIZE 64
+
+// 自旋等待时使用，降低功耗，并且让出流水线给同一个核上的另一个超线程
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define LAZY_CPU_RELAX() _mm_pause()
+#elif defined(__x86_64__) || defined(__i386__)
+#define LAZY_CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define LAZY_CPU_RELAX() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define LAZY_CPU_RELAX() ((void)0)
+#endif
+
 
 #if defined(WIN32) || defined(WIN64) || defined(_WIN32) || defined(_WIN64)
 #ifndef LAZY_API
@@ -8,8 +8,10 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <string.h>
 #include <chrono>
 #include <deque>
+#include <vector>
 #include <ctime>
 #include <sstream>
 #include <iomanip>
@@ -283,15 +285,15 @@ private:
     // 写入
     void write(){
         
-        int64_t lines = log_cache_.size();
+        // 一次加锁取出所有的日志，不能阻塞日志线程
+        log_cache_.try_pop_all(write_buffer_);
         
-        while(lines > 0){
-            
-            LogLine log;
+        // 写入失败时，没有写完的日志留在write_buffer_中，下次继续写
+        size_t lines = 0;
+        
+        for(; lines < write_buffer_.size(); ++lines){
             
-            if(!log_cache_.pop_front(log)){
-                break;
-            }
+            LogLine& log = write_buffer_[lines];
             
             size_t written_size = 0;
             
@@ -315,10 +317,10 @@ private:
             }
             
             file_size_bytes_ += log.msg.size();
-            
-            --lines;
         }
         
+        write_buffer_.erase(write_buffer_.begin(), write_buffer_.begin() + lines);
+        
         if(fp_){
             fflush(fp_);
         }
@@ -368,6 +370,9 @@ private:
     
     DataQueue<LogLine> log_cache_;
     
+    // 日志线程批量取出的日志，复用内存
+    std::vector<LogLine> write_buffer_;
+    
     TaskQueue task_queue_;
     
     FILE* fp_ = nullptr;
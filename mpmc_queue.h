@@ -0,0 +1,347 @@
+//
+//  mpmc_queue.h
+//
+
+#ifndef __LAZY_MPMC_QUEUE_H__2024__
+#define __LAZY_MPMC_QUEUE_H__2024__
+
+#include <stdint.h>
+#include <assert.h>
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <utility>
+#include <type_traits>
+#include <condition_variable>
+
+#include "lazy_base_common.h"
+
+#include "wait_strategy.h"
+
+namespace lazy {
+
+/*
+** 有界的多生产者多消费者（MPMC）无锁队列（Dmitry Vyukov的算法）
+** 1、容量固定（向上取整到2的幂），构造时一次性分配
+** 2、每个槽位有一个序号：
+**    序号等于写位置，表示槽位空闲，生产者可以写入；
+**    序号等于读位置+1，表示槽位有数据，消费者可以读取
+** 3、生产者之间只在写位置上竞争（CAS），消费者之间只在读位置上竞争，生产者和消费者互不影响
+*/
+template<class T>
+class MpmcQueue {
+public:
+    explicit MpmcQueue(size_t capacity) : enqueue_pos_(0), dequeue_pos_(0) {
+        capacity_ = 2;
+        while(capacity_ < capacity){
+            capacity_ <<= 1;
+        }
+        mask_ = capacity_ - 1;
+
+        cells_ = new Cell[capacity_];
+
+        for(size_t i = 0; i < capacity_; ++i){
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~MpmcQueue() {
+        size_t enqueue_pos = enqueue_pos_.load(std::memory_order_acquire);
+        for(size_t pos = dequeue_pos_.load(std::memory_order_relaxed); pos != enqueue_pos; ++pos){
+            Cell& cell = cells_[pos & mask_];
+            if(cell.sequence.load(std::memory_order_acquire) == pos + 1){
+                cell.ptr()->~T();
+            }
+        }
+
+        delete [] cells_;
+    }
+
+    bool try_push(const T& val) {
+        return try_emplace(val);
+    }
+
+    bool try_push(T&& val) {
+        return try_emplace(std::move(val));
+    }
+
+    // 满了返回false
+    template<class... Args>
+    bool try_emplace(Args&&... args) {
+        Cell* cell = nullptr;
+
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+
+        while(true){
+            cell = &cells_[pos & mask_];
+
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+            if(diff == 0){
+                // 槽位空闲，抢占写位置
+                if(enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                    break;
+                }
+            }
+            else if(diff < 0){
+                // 槽位上还是一圈之前的数据，队列满了
+                return false;
+            }
+            else {
+                // 被其他生产者抢先了
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        new (cell->ptr()) T(std::forward<Args>(args)...);
+
+        cell->sequence.store(pos + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // 空了返回false
+    bool try_pop(T& val) {
+        Cell* cell = nullptr;
+
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+
+        while(true){
+            cell = &cells_[pos & mask_];
+
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+            if(diff == 0){
+                if(dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                    break;
+                }
+            }
+            else if(diff < 0){
+                // 槽位还没有写入，队列空了
+                return false;
+            }
+            else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        T* p = cell->ptr();
+        val = std::move(*p);
+        p->~T();
+
+        // 槽位留给下一圈的生产者
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // 近似值
+    size_t size() const {
+        size_t enqueue_pos = enqueue_pos_.load(std::memory_order_acquire);
+        size_t dequeue_pos = dequeue_pos_.load(std::memory_order_acquire);
+        return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    bool full() const {
+        return size() >= capacity_;
+    }
+
+    size_t capacity() const {
+        return capacity_;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type storage;
+
+        T* ptr() {
+            return reinterpret_cast<T*>(&storage);
+        }
+    };
+
+    // 只读的成员
+    Cell* cells_ = nullptr;
+    size_t capacity_ = 0;
+    size_t mask_ = 0;
+
+    char pad0_[LAZY_CACHE_LINE_SIZE];
+
+    std::atomic<size_t> enqueue_pos_;
+
+    char pad1_[LAZY_CACHE_LINE_SIZE];
+
+    std::atomic<size_t> dequeue_pos_;
+
+    char pad2_[LAZY_CACHE_LINE_SIZE];
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(MpmcQueue);
+};
+
+/*
+** MpmcQueue的阻塞版本，接口和DataQueue一样
+** 1、满了push_back阻塞，空了pop_front阻塞，stop之后都返回false
+** 2、记录挂起的生产者/消费者个数，没有人挂起时push/pop完全不加锁，也不调用notify
+*/
+template<class T>
+class BlockingMpmcQueue {
+public:
+    explicit BlockingMpmcQueue(size_t capacity)
+    : queue_(capacity), stop_(false), consumers_waiting_(0), producers_waiting_(0) {
+    }
+
+    ~BlockingMpmcQueue() {
+        stop();
+    }
+
+    bool start() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_.store(false, std::memory_order_release);
+        return true;
+    }
+
+    void stop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_.store(true, std::memory_order_release);
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+
+    void set_wait_strategy(WaitStrategy strategy, uint32_t max_spin_us = 50) {
+        spin_waiter_.set_strategy(strategy, max_spin_us);
+    }
+
+    bool push_back(const T& val) {
+        return emplace_back(val);
+    }
+
+    // 满了就等待，stop之后返回false
+    template<class... Args>
+    bool emplace_back(Args&&... args) {
+        spin_waiter_.on_arrival();
+
+        while(true){
+            if(stop_.load(std::memory_order_acquire)){
+                return false;
+            }
+
+            if(queue_.try_emplace(std::forward<Args>(args)...)){
+                wake(consumers_waiting_, not_empty_);
+                return true;
+            }
+
+            if(spin_waiter_.spin([&]{ return !queue_.full() || stop_.load(std::memory_order_relaxed); })){
+                continue;
+            }
+
+            park(producers_waiting_, not_full_, [&]{ return !queue_.full(); });
+        }
+    }
+
+    // 非阻塞，满了返回false
+    bool try_push(const T& val) {
+        if(stop_.load(std::memory_order_acquire) || !queue_.try_push(val)){
+            return false;
+        }
+
+        wake(consumers_waiting_, not_empty_);
+
+        return true;
+    }
+
+    // 空了就等待，stop之后返回false
+    bool pop_front(T& val) {
+        while(true){
+            if(stop_.load(std::memory_order_acquire)){
+                return false;
+            }
+
+            if(queue_.try_pop(val)){
+                wake(producers_waiting_, not_full_);
+                return true;
+            }
+
+            if(spin_waiter_.spin([&]{ return !queue_.empty() || stop_.load(std::memory_order_relaxed); })){
+                continue;
+            }
+
+            park(consumers_waiting_, not_empty_, [&]{ return !queue_.empty(); });
+        }
+    }
+
+    // 非阻塞，空了返回false
+    bool try_pop(T& val) {
+        if(!queue_.try_pop(val)){
+            return false;
+        }
+
+        wake(producers_waiting_, not_full_);
+
+        return true;
+    }
+
+    size_t size() const {
+        return queue_.size();
+    }
+
+    bool empty() const {
+        return queue_.empty();
+    }
+
+    size_t capacity() const {
+        return queue_.capacity();
+    }
+
+private:
+    // 只有有人挂起时才加锁唤醒一个
+    void wake(std::atomic<int>& waiting, std::condition_variable& cond) {
+        // 和park中的fence配对：要么这里看到waiting，要么park中看到数据
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if(waiting.load(std::memory_order_relaxed) > 0){
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond.notify_one();
+        }
+    }
+
+    template<class Ready>
+    void park(std::atomic<int>& waiting, std::condition_variable& cond, Ready ready) {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        waiting.fetch_add(1, std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        cond.wait(lock, [&]{
+            return ready() || stop_.load(std::memory_order_relaxed);
+        });
+
+        waiting.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    MpmcQueue<T> queue_;
+
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+
+    std::atomic<bool> stop_;
+    std::atomic<int> consumers_waiting_;
+    std::atomic<int> producers_waiting_;
+
+    SpinWaiter spin_waiter_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(BlockingMpmcQueue);
+};
+
+}
+
+#endif /* __LAZY_MPMC_QUEUE_H__2024__ */
@@ -0,0 +1,129 @@
+//
+//  notifier.h
+//
+
+#ifndef __LAZY_NOTIFIER_H__2024__
+#define __LAZY_NOTIFIER_H__2024__
+
+#include <stdint.h>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+#include "lazy_base_common.h"
+
+namespace lazy {
+
+/*
+** 通知器：多个数据源（DataQueue、Event）共享的唤醒机制，Selector用它同时等待多个数据源
+** 1、内部是一个计数（epoch），数据源的状态变化之后调用notify()把计数加一
+** 2、等待的一方先读取计数，再检查所有数据源，都没有就绪才wait(计数)，
+**    检查期间发生的变化会让计数改变，wait会立即返回，不会丢失通知
+** 3、没有人等待时notify()不加锁
+** 4、不想占用一个线程等待时可以设置回调，每次notify都会调用（比如把任务投递到TaskQueue），见BatchConsumer
+*/
+class Notifier {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    Notifier() : epoch_(0), waiters_(0) {
+    }
+
+    uint64_t epoch() const {
+        return epoch_.load();
+    }
+
+    void notify() {
+        epoch_.fetch_add(1);
+
+        // 和wait中对waiters_的修改配对（都是seq_cst）：要么这里看到有人在等，要么wait看到新的计数
+        if(waiters_.load() > 0){
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.notify_all();
+        }
+
+        if(callback_){
+            callback_();
+        }
+    }
+
+    /* 设置notify之后调用的回调，需要在挂接到数据源之前设置
+     * 回调在notify的线程上、数据源的锁内执行，不能再访问这个数据源，也不能做耗时的操作
+     */
+    void set_callback(const std::function<void()>& callback) {
+        callback_ = callback;
+    }
+
+    /* 等待计数不再等于seen_epoch
+     * deadline: 为nullptr时一直等待
+     * 返回false表示超时
+     */
+    bool wait(uint64_t seen_epoch, const Clock::time_point* deadline = nullptr) {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        waiters_.fetch_add(1);
+
+        auto changed = [&]{
+            return epoch_.load() != seen_epoch;
+        };
+
+        bool ok = true;
+
+        if(deadline){
+            ok = cond_.wait_until(lock, *deadline, changed);
+        }
+        else {
+            cond_.wait(lock, changed);
+        }
+
+        waiters_.fetch_sub(1);
+
+        return ok;
+    }
+
+private:
+    std::atomic<uint64_t> epoch_;
+    std::atomic<int> waiters_;
+
+    std::function<void()> callback_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(Notifier);
+};
+
+/*
+** 数据源中挂接的通知器列表，数据源在自己的锁内调用
+*/
+class NotifierList {
+public:
+    void attach(Notifier* notifier) {
+        notifiers_.push_back(notifier);
+    }
+
+    void detach(Notifier* notifier) {
+        notifiers_.erase(std::remove(notifiers_.begin(), notifiers_.end(), notifier), notifiers_.end());
+    }
+
+    void notify() {
+        for(Notifier* notifier : notifiers_){
+            notifier->notify();
+        }
+    }
+
+    bool empty() const {
+        return notifiers_.empty();
+    }
+
+private:
+    std::vector<Notifier*> notifiers_;
+};
+
+}
+
+#endif /* __LAZY_NOTIFIER_H__2024__ */
@@ -0,0 +1,594 @@
+//
+//  pipeline.h
+//
+
+#ifndef __LAZY_PIPELINE_H__2024__
+#define __LAZY_PIPELINE_H__2024__
+
+#include <stdint.h>
+#include <assert.h>
+#include <map>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <utility>
+#include <type_traits>
+#include <condition_variable>
+
+#include "lazy_base_common.h"
+
+#include "data_queue.h"
+#include "thread_utils.h"
+#include "time_utils.h"
+
+namespace lazy {
+
+struct PipelineStageOptions {
+    // 这一级的工作线程数
+    size_t workers = 1;
+
+    // 这一级的输入队列的容量，满了之后上一级（或者Pipeline::push）等待
+    size_t queue_capacity = 1024;
+
+    // 多个工作线程时，是否按输入的顺序输出
+    bool preserve_order = false;
+};
+
+struct PipelineStageStats {
+    std::string name;
+    size_t workers = 0;
+
+    // 处理完的数据个数
+    uint64_t processed = 0;
+
+    // 每个数据在处理函数中花费的时间
+    uint64_t avg_latency_us = 0;
+    uint64_t max_latency_us = 0;
+
+    // 输入队列当前的深度和容量
+    size_t queue_depth = 0;
+    size_t queue_capacity = 0;
+
+    // 因为下一级的队列满了而等待的时间（所有工作线程累计）
+    uint64_t blocked_us = 0;
+
+    // 工作线程忙于处理的时间占比（0~1），最高的一级就是瓶颈
+    double utilization = 0;
+
+    // 从start到现在的吞吐量（个/秒）
+    double throughput = 0;
+};
+
+/*
+** 多级流水线：每一级有自己的工作线程，级与级之间用有界的DataQueue连接
+** 用法：
+**   Pipeline<int> pipeline;
+**   pipeline.then("parse", [](int x){ return std::to_string(x); }, options)
+**           .then("upper", [](std::string s){ ...; return s; })
+**           .sink("write", [](std::string s){ ... });
+**   pipeline.start();
+**   pipeline.push(1);
+**   pipeline.stop();   // 等待已经写入的数据全部处理完
+** 1、then添加一个转换的级，处理函数的返回值就是下一级的输入；sink是最后一级，处理函数没有返回值
+** 2、级与级之间的队列满了之后上一级等待（背压），一直传到Pipeline::push
+** 3、preserve_order的级用一个重排缓冲区按输入的顺序输出，重排缓冲区最多queue_capacity个数据，
+**    超过之后先做完的工作线程等待
+** 4、stats()返回每一级的吞吐量、延迟、队列深度、阻塞时间和忙碌的比例，bottleneck()返回最忙的一级
+** 5、数据的类型需要可以默认构造；所有的级都要在start之前添加，stop之后不能再start
+*/
+template<class In>
+class Pipeline {
+private:
+    template<class T>
+    struct Envelope {
+        // 在这一级的输入中的序号，从0开始连续递增，队列中按序号从小到大排列
+        uint64_t seq = 0;
+
+        // 结束标记，每个工作线程收到一个之后退出
+        bool end = false;
+
+        T value;
+    };
+
+    // 两级之间的连接
+    template<class T>
+    struct Link {
+        DataQueue<Envelope<T>> queue;
+
+        // 下一级的工作线程数，上一级结束时发送这么多个结束标记
+        size_t consumers = 0;
+    };
+
+public:
+    // 添加下一级用的句柄，T是上一级的输出类型
+    template<class T>
+    class Builder {
+    public:
+        template<class F>
+        Builder<typename std::decay<typename std::result_of<F(T&&)>::type>::type>
+        then(const std::string& name, F fn, const PipelineStageOptions& options = PipelineStageOptions()) {
+            typedef typename std::decay<typename std::result_of<F(T&&)>::type>::type Out;
+
+            std::shared_ptr<Link<Out>> output(new Link<Out>());
+
+            pipeline_->add_stage(new TransformStage<T, Out, F>(name, options, link_, output, fn));
+
+            return Builder<Out>(pipeline_, output);
+        }
+
+        template<class F>
+        void sink(const std::string& name, F fn, const PipelineStageOptions& options = PipelineStageOptions()) {
+            pipeline_->add_stage(new SinkStage<T, F>(name, options, link_, fn));
+            pipeline_->complete_ = true;
+        }
+
+    private:
+        friend class Pipeline;
+
+        Builder(Pipeline* pipeline, const std::shared_ptr<Link<T>>& link) : pipeline_(pipeline), link_(link) {
+        }
+
+        Pipeline* pipeline_;
+        std::shared_ptr<Link<T>> link_;
+    };
+
+    Pipeline() : input_(new Link<In>()) {
+    }
+
+    ~Pipeline() {
+        stop();
+    }
+
+    // 第一级
+    template<class F>
+    Builder<typename std::decay<typename std::result_of<F(In&&)>::type>::type>
+    then(const std::string& name, F fn, const PipelineStageOptions& options = PipelineStageOptions()) {
+        return Builder<In>(this, input_).then(name, fn, options);
+    }
+
+    // 只有一级
+    template<class F>
+    void sink(const std::string& name, F fn, const PipelineStageOptions& options = PipelineStageOptions()) {
+        Builder<In>(this, input_).sink(name, fn, options);
+    }
+
+    // 启动所有级的工作线程，最后一级不是sink或者已经启动过时返回false（stop之后不能再启动）
+    bool start() {
+        std::unique_lock<std::mutex> lock(input_mutex_);
+
+        if(started_ || !complete_){
+            return false;
+        }
+
+        started_ = true;
+        start_us_ = TimeUtil::MonoNowUs();
+
+        for(auto& stage : stages_){
+            stage->start();
+        }
+
+        running_ = true;
+        closed_ = false;
+
+        return true;
+    }
+
+    // 写入一个数据，第一级的队列满了就等待，stop之后返回false
+    bool push(const In& val) {
+        Envelope<In> envelope;
+        envelope.value = val;
+        return push_envelope(envelope);
+    }
+
+    bool push(In&& val) {
+        Envelope<In> envelope;
+        envelope.value = std::move(val);
+        return push_envelope(envelope);
+    }
+
+    // 不再接受新的数据，等待已经写入的数据全部处理完，然后退出所有的工作线程
+    void stop() {
+        {
+            std::unique_lock<std::mutex> lock(input_mutex_);
+
+            if(!running_ || closed_){
+                return;
+            }
+
+            closed_ = true;
+
+            send_end(*input_);
+        }
+
+        join_all();
+    }
+
+    // 立即退出所有的工作线程，丢掉还没有处理的数据
+    void abort() {
+        // 先让等待中的push返回，再加锁
+        input_->queue.stop();
+
+        {
+            std::unique_lock<std::mutex> lock(input_mutex_);
+
+            if(!running_){
+                return;
+            }
+
+            closed_ = true;
+        }
+
+        for(auto& stage : stages_){
+            stage->abort();
+        }
+
+        join_all();
+    }
+
+    std::vector<PipelineStageStats> stats() const {
+        std::vector<PipelineStageStats> result;
+
+        int64_t elapsed_us = start_us_ > 0 ? TimeUtil::MonoNowUs() - start_us_ : 0;
+
+        for(auto& stage : stages_){
+            result.push_back(stage->stats(elapsed_us));
+        }
+
+        return result;
+    }
+
+    // 忙碌比例最高的一级的名字，还没有数据时返回空字符串
+    std::string bottleneck() const {
+        std::string name;
+        double max_utilization = 0;
+
+        for(const PipelineStageStats& s : stats()){
+            if(s.processed > 0 && s.utilization > max_utilization){
+                max_utilization = s.utilization;
+                name = s.name;
+            }
+        }
+
+        return name;
+    }
+
+private:
+    // 工作线程的公共部分：从输入队列取数据，交给process，收到结束标记退出
+    class StageBase {
+    public:
+        StageBase(const std::string& name, const PipelineStageOptions& options)
+        : name_(name), options_(options), processed_(0), busy_ns_(0), max_latency_ns_(0), blocked_ns_(0), active_(0) {
+            if(options_.workers == 0){
+                options_.workers = 1;
+            }
+
+            if(options_.queue_capacity == 0){
+                options_.queue_capacity = 1;
+            }
+        }
+
+        virtual ~StageBase() {
+        }
+
+        void start() {
+            active_.store(options_.workers);
+
+            for(size_t i = 0; i < options_.workers; ++i){
+                threads_.push_back(std::thread([this]{
+                    ThreadUtil::SetCurrentName(name_);
+                    run();
+
+                    // 最后一个退出的工作线程通知下一级
+                    if(active_.fetch_sub(1) == 1){
+                        finish();
+                    }
+                }));
+            }
+        }
+
+        void join() {
+            for(auto& t : threads_){
+                t.join();
+            }
+            threads_.clear();
+        }
+
+        virtual void abort() = 0;
+
+        PipelineStageStats stats(int64_t elapsed_us) const {
+            PipelineStageStats s;
+            s.name = name_;
+            s.workers = options_.workers;
+            s.processed = processed_.load(std::memory_order_relaxed);
+
+            uint64_t busy_ns = busy_ns_.load(std::memory_order_relaxed);
+
+            s.avg_latency_us = s.processed > 0 ? busy_ns / s.processed / 1000 : 0;
+            s.max_latency_us = max_latency_ns_.load(std::memory_order_relaxed) / 1000;
+            s.queue_depth = queue_depth();
+            s.queue_capacity = options_.queue_capacity;
+            s.blocked_us = blocked_ns_.load(std::memory_order_relaxed) / 1000;
+
+            if(elapsed_us > 0){
+                s.utilization = (double)busy_ns / 1000.0 / (double)elapsed_us / (double)options_.workers;
+                s.throughput = (double)s.processed * 1000000.0 / (double)elapsed_us;
+            }
+
+            return s;
+        }
+
+    protected:
+        virtual void run() = 0;
+
+        // 所有的工作线程都退出了
+        virtual void finish() = 0;
+
+        virtual size_t queue_depth() const = 0;
+
+        void record(int64_t latency_ns) {
+            processed_.fetch_add(1, std::memory_order_relaxed);
+            busy_ns_.fetch_add((uint64_t)latency_ns, std::memory_order_relaxed);
+
+            uint64_t cur = max_latency_ns_.load(std::memory_order_relaxed);
+            while((uint64_t)latency_ns > cur && !max_latency_ns_.compare_exchange_weak(cur, (uint64_t)latency_ns)){
+            }
+        }
+
+        void record_blocked(int64_t ns) {
+            blocked_ns_.fetch_add((uint64_t)ns, std::memory_order_relaxed);
+        }
+
+        std::string name_;
+        PipelineStageOptions options_;
+
+        std::vector<std::thread> threads_;
+
+        std::atomic<uint64_t> processed_;
+        std::atomic<uint64_t> busy_ns_;
+        std::atomic<uint64_t> max_latency_ns_;
+        std::atomic<uint64_t> blocked_ns_;
+
+        // 还没有退出的工作线程数
+        std::atomic<size_t> active_;
+    };
+
+    template<class I>
+    class InputStage : public StageBase {
+    public:
+        InputStage(const std::string& name, const PipelineStageOptions& options, const std::shared_ptr<Link<I>>& input)
+        : StageBase(name, options), input_(input) {
+            input_->consumers = this->options_.workers;
+            input_->queue.set_capacity(this->options_.queue_capacity);
+        }
+
+        virtual void abort() override {
+            input_->queue.stop();
+        }
+
+    protected:
+        virtual void run() override {
+            Envelope<I> envelope;
+
+            while(input_->queue.pop_front(envelope)){
+                if(envelope.end){
+                    break;
+                }
+
+                int64_t t1 = TimeUtil::MonoNowNs();
+
+                int64_t blocked = process(envelope);
+
+                // 等待下一级的时间单独统计，不算在处理时间里
+                this->record(TimeUtil::MonoNowNs() - t1 - blocked);
+                this->record_blocked(blocked);
+            }
+        }
+
+        virtual size_t queue_depth() const override {
+            return input_->queue.size();
+        }
+
+        // 返回之前必须把结果交给下一级，返回等待下一级的队列的时间（纳秒）
+        virtual int64_t process(Envelope<I>& envelope) = 0;
+
+        std::shared_ptr<Link<I>> input_;
+    };
+
+    template<class I, class O, class F>
+    class TransformStage : public InputStage<I> {
+    public:
+        TransformStage(const std::string& name, const PipelineStageOptions& options,
+                       const std::shared_ptr<Link<I>>& input, const std::shared_ptr<Link<O>>& output, F fn)
+        : InputStage<I>(name, options, input), output_(output), fn_(fn) {
+        }
+
+        virtual void abort() override {
+            InputStage<I>::abort();
+
+            std::unique_lock<std::mutex> lock(emit_mutex_);
+            aborted_ = true;
+            window_cond_.notify_all();
+        }
+
+    protected:
+        virtual int64_t process(Envelope<I>& envelope) override {
+            Envelope<O> out;
+            out.value = fn_(std::move(envelope.value));
+
+            int64_t t1 = TimeUtil::MonoNowNs();
+
+            emit(envelope.seq, out);
+
+            return TimeUtil::MonoNowNs() - t1;
+        }
+
+        virtual void finish() override {
+            std::unique_lock<std::mutex> lock(emit_mutex_);
+            send_end(*output_);
+        }
+
+    private:
+        /* 写入下一级的队列，保证下一级的队列中序号连续递增
+         * 不保持顺序时按完成的顺序重新编号；保持顺序时按输入的序号重排
+         */
+        void emit(uint64_t seq, Envelope<O>& out) {
+            std::unique_lock<std::mutex> lock(emit_mutex_);
+
+            if(!this->options_.preserve_order || this->options_.workers == 1){
+                out.seq = next_out_++;
+                output_->queue.emplace_back(std::move(out));
+                return;
+            }
+
+            // 输入中序号是连续递增的，等待的线程手里的序号都比next_out_大，持有next_out_的线程不会等待
+            window_cond_.wait(lock, [&]{
+                return (seq < next_out_ + this->options_.queue_capacity || aborted_);
+            });
+
+            if(seq != next_out_){
+                out.seq = seq;
+                pending_.insert(std::make_pair(seq, std::move(out)));
+                return;
+            }
+
+            out.seq = seq;
+            output_->queue.emplace_back(std::move(out));
+            ++next_out_;
+
+            while(!pending_.empty() && pending_.begin()->first == next_out_){
+                output_->queue.emplace_back(std::move(pending_.begin()->second));
+                pending_.erase(pending_.begin());
+                ++next_out_;
+            }
+
+            window_cond_.notify_all();
+        }
+
+        std::shared_ptr<Link<O>> output_;
+        F fn_;
+
+        std::mutex emit_mutex_;
+        std::condition_variable window_cond_;
+
+        // 下一个写入下一级的序号
+        uint64_t next_out_ = 0;
+
+        // 重排缓冲区
+        std::map<uint64_t, Envelope<O>> pending_;
+
+        bool aborted_ = false;
+    };
+
+    template<class I, class F>
+    class SinkStage : public InputStage<I> {
+    public:
+        SinkStage(const std::string& name, const PipelineStageOptions& options,
+                  const std::shared_ptr<Link<I>>& input, F fn)
+        : InputStage<I>(name, options, input), fn_(fn) {
+        }
+
+        virtual void abort() override {
+            InputStage<I>::abort();
+
+            std::unique_lock<std::mutex> lock(order_mutex_);
+            aborted_ = true;
+            order_cond_.notify_all();
+        }
+
+    protected:
+        // 保持顺序时多个工作线程按序号轮流调用处理函数，相当于串行
+        virtual int64_t process(Envelope<I>& envelope) override {
+            if(this->options_.preserve_order && this->options_.workers > 1){
+                std::unique_lock<std::mutex> lock(order_mutex_);
+                order_cond_.wait(lock, [&]{
+                    return (next_ == envelope.seq || aborted_);
+                });
+
+                if(aborted_){
+                    return 0;
+                }
+
+                fn_(std::move(envelope.value));
+
+                ++next_;
+                order_cond_.notify_all();
+                return 0;
+            }
+
+            fn_(std::move(envelope.value));
+
+            return 0;
+        }
+
+        virtual void finish() override {
+        }
+
+    private:
+        F fn_;
+
+        std::mutex order_mutex_;
+        std::condition_variable order_cond_;
+        uint64_t next_ = 0;
+        bool aborted_ = false;
+    };
+
+    template<class T>
+    static void send_end(Link<T>& link) {
+        for(size_t i = 0; i < link.consumers; ++i){
+            Envelope<T> envelope;
+            envelope.end = true;
+            link.queue.emplace_back(std::move(envelope));
+        }
+    }
+
+    void add_stage(StageBase* stage) {
+        assert(!running_ && !complete_);
+        stages_.push_back(std::unique_ptr<StageBase>(stage));
+    }
+
+    bool push_envelope(Envelope<In>& envelope) {
+        // 加锁保证输入队列中的序号连续递增，队列满了时其他写入的线程也在这里等待
+        std::unique_lock<std::mutex> lock(input_mutex_);
+
+        if(!running_ || closed_){
+            return false;
+        }
+
+        envelope.seq = next_input_++;
+
+        return input_->queue.emplace_back(std::move(envelope));
+    }
+
+    void join_all() {
+        for(auto& stage : stages_){
+            stage->join();
+        }
+
+        std::unique_lock<std::mutex> lock(input_mutex_);
+        running_ = false;
+    }
+
+    std::shared_ptr<Link<In>> input_;
+
+    std::vector<std::unique_ptr<StageBase>> stages_;
+
+    // 最后一级是sink
+    bool complete_ = false;
+
+    std::mutex input_mutex_;
+    uint64_t next_input_ = 0;
+    bool started_ = false;
+    bool running_ = false;
+    bool closed_ = false;
+
+    int64_t start_us_ = 0;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(Pipeline);
+};
+
+}
+
+#endif /* __LAZY_PIPELINE_H__2024__ */
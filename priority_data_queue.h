@@ -0,0 +1,542 @@
+//
+//  priority_data_queue.h
+//
+
+#ifndef __LAZY_PRIORITY_DATA_QUEUE_H__2024__
+#define __LAZY_PRIORITY_DATA_QUEUE_H__2024__
+
+#include <stdint.h>
+#include <assert.h>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <utility>
+#include <functional>
+#include <condition_variable>
+
+#include "lazy_base_common.h"
+
+namespace lazy {
+
+/*
+** d叉堆，语义和std::priority_queue一样：Compare(a, b)为true表示a的优先级比b低，top是优先级最高的元素
+** 1、每个节点有D个孩子，D=4时树的高度只有二叉堆的一半，
+**    并且同一个节点的孩子在内存中是连续的，下沉时比较孩子基本都在同一个缓存行中
+** 2、上浮/下沉时先把元素移出来留下一个“空位”，路径上的元素只移动一次，不做交换
+*/
+template<class T, class Compare = std::less<T>, size_t D = 4>
+class DaryHeap {
+public:
+    explicit DaryHeap(const Compare& comp = Compare()) : comp_(comp) {
+        static_assert(D >= 2, "D must be at least 2");
+    }
+
+    void push(const T& val) {
+        items_.push_back(val);
+        sift_up(items_.size() - 1);
+    }
+
+    void push(T&& val) {
+        items_.push_back(std::move(val));
+        sift_up(items_.size() - 1);
+    }
+
+    const T& top() const {
+        assert(!items_.empty());
+        return items_.front();
+    }
+
+    // 取出优先级最高的元素
+    void pop(T& val) {
+        assert(!items_.empty());
+
+        val = std::move(items_.front());
+
+        pop();
+    }
+
+    void pop() {
+        assert(!items_.empty());
+
+        if(items_.size() > 1){
+            T last = std::move(items_.back());
+            items_.pop_back();
+            sift_down(0, std::move(last));
+        }
+        else {
+            items_.pop_back();
+        }
+    }
+
+    size_t size() const {
+        return items_.size();
+    }
+
+    bool empty() const {
+        return items_.empty();
+    }
+
+    void clear() {
+        items_.clear();
+    }
+
+    void reserve(size_t n) {
+        items_.reserve(n);
+    }
+
+private:
+    void sift_up(size_t index) {
+        T val = std::move(items_[index]);
+
+        while(index > 0){
+            size_t parent = (index - 1) / D;
+
+            if(!comp_(items_[parent], val)){
+                break;
+            }
+
+            items_[index] = std::move(items_[parent]);
+            index = parent;
+        }
+
+        items_[index] = std::move(val);
+    }
+
+    /* 把val放到index这个空位上，然后下沉
+     * 先让空位一直沿着优先级最高的孩子走到叶子，再把val从叶子上浮到合适的位置：
+     * 从堆尾拿来的val通常优先级很低，最终会落在靠近叶子的地方，这样每一层省掉了val和孩子的比较
+     */
+    void sift_down(size_t index, T&& val) {
+        const size_t size = items_.size();
+
+        while(true){
+            size_t first_child = index * D + 1;
+
+            if(first_child >= size){
+                break;
+            }
+
+            // 找出优先级最高的孩子
+            size_t last_child = first_child + D < size ? first_child + D : size;
+            size_t best = first_child;
+
+            for(size_t child = first_child + 1; child < last_child; ++child){
+                if(comp_(items_[best], items_[child])){
+                    best = child;
+                }
+            }
+
+            items_[index] = std::move(items_[best]);
+            index = best;
+        }
+
+        items_[index] = std::move(val);
+
+        sift_up(index);
+    }
+
+    std::vector<T> items_;
+    Compare comp_;
+};
+
+/*
+** 按优先级出队的线程安全队列，接口和生命周期和DataQueue一样
+** 1、pop_front取出优先级最高的元素（Compare的语义和std::priority_queue一样），优先级相同时不保证先进先出
+** 2、队列为空时pop_front一直等待，直到有数据或者stop
+*/
+template<class T, class Compare = std::less<T>>
+class PriorityDataQueue {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    explicit PriorityDataQueue(const Compare& comp = Compare()) : heap_(comp) {
+
+    }
+
+    ~PriorityDataQueue(){
+        stop();
+    }
+
+    bool push_back(const T& val) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if(stop_){
+            return false;
+        }
+        heap_.push(val);
+        notify_waiters();
+
+        return true;
+    }
+
+    bool emplace_back(T&& val) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if(stop_){
+            return false;
+        }
+        heap_.push(std::forward<T>(val));
+        notify_waiters();
+
+        return true;
+    }
+
+    bool pop_front(T& val) {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        if(!wait_not_empty(lock, pop_waiters_, nullptr)){
+            return false;
+        }
+
+        heap_.pop(val);
+
+        return true;
+    }
+
+    // 不等待，队列为空或者已经stop时返回false
+    bool try_pop(T& val) {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        if(stop_ || heap_.empty()){
+            return false;
+        }
+
+        heap_.pop(val);
+
+        return true;
+    }
+
+    template<class Rep, class Period>
+    bool pop_for(T& val, const std::chrono::duration<Rep, Period>& timeout) {
+        return pop_until(val, Clock::now() + std::chrono::duration_cast<Clock::duration>(timeout));
+    }
+
+    bool pop_until(T& val, const Clock::time_point& deadline) {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        if(!wait_not_empty(lock, pop_waiters_, &deadline)){
+            return false;
+        }
+
+        heap_.pop(val);
+
+        return true;
+    }
+
+    // 查看优先级最高的元素，不取出
+    bool front(T& val) {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        if(!wait_not_empty(lock, front_waiters_, nullptr)){
+            return false;
+        }
+
+        val = heap_.top();
+
+        return true;
+    }
+
+    size_t size() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return heap_.size();
+    }
+
+    bool empty() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return heap_.empty();
+    }
+
+    bool start(){
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        stop_ = false;
+
+        return true;
+    }
+
+    void stop(){
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        stop_ = true;
+
+        cond_.notify_all();
+    }
+
+private:
+    /* 加锁之后调用，等待队列中有数据
+     * waiters: 等待期间计入的等待者计数（pop_waiters_或者front_waiters_）
+     * deadline: 为nullptr时一直等待
+     * 返回false表示已经stop或者超时
+     */
+    bool wait_not_empty(std::unique_lock<std::mutex>& lock, int& waiters, const Clock::time_point* deadline) {
+        auto ready = [&]{
+            return (!heap_.empty() || stop_);
+        };
+
+        ++waiters;
+
+        if(deadline){
+            cond_.wait_until(lock, *deadline, ready);
+        }
+        else {
+            cond_.wait(lock, ready);
+        }
+
+        --waiters;
+
+        return (!stop_ && !heap_.empty());
+    }
+
+    /* 写入一个元素之后调用，需要持有锁
+     * front的等待者和pop的等待者在同一个条件变量上，notify_one可能只唤醒了front的等待者，
+     * 它不取走数据，pop的等待者就一直睡下去，所以有front的等待者时全部唤醒
+     */
+    void notify_waiters() {
+        if(front_waiters_ > 0){
+            cond_.notify_all();
+        }
+        else if(pop_waiters_ > 0){
+            cond_.notify_one();
+        }
+    }
+
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+
+    DaryHeap<T, Compare> heap_;
+    bool stop_ = false;
+
+    // 正在等待的消费者个数，加锁访问
+    int pop_waiters_ = 0;
+    int front_waiters_ = 0;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(PriorityDataQueue);
+};
+
+/*
+** 延迟队列：每个元素有一个就绪时间，到了就绪时间才能被取出（比如带退避的重试队列）
+** 1、就绪时间使用单调时钟（steady_clock），就绪时间相同的元素先进先出
+** 2、pop_front一直等待到最早的元素就绪；等待期间写入了更早的元素，会重新计算等待时间
+** 3、多个消费者时只有一个（leader）按最早的就绪时间定时等待，其他的消费者一直等待，
+**    leader取走元素之后再唤醒下一个，避免所有消费者在同一时刻一起醒来
+*/
+template<class T>
+class DelayQueue {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    DelayQueue() {
+
+    }
+
+    ~DelayQueue(){
+        stop();
+    }
+
+    // delay之后就绪
+    template<class Rep, class Period>
+    bool push_back(const T& val, const std::chrono::duration<Rep, Period>& delay) {
+        return push_back_at(val, Clock::now() + std::chrono::duration_cast<Clock::duration>(delay));
+    }
+
+    template<class Rep, class Period>
+    bool emplace_back(T&& val, const std::chrono::duration<Rep, Period>& delay) {
+        return emplace_back_at(std::forward<T>(val), Clock::now() + std::chrono::duration_cast<Clock::duration>(delay));
+    }
+
+    // 到ready_time时就绪
+    bool push_back_at(const T& val, const Clock::time_point& ready_time) {
+        return push_impl(Entry(val, ready_time));
+    }
+
+    bool emplace_back_at(T&& val, const Clock::time_point& ready_time) {
+        return push_impl(Entry(std::forward<T>(val), ready_time));
+    }
+
+    // 等待到最早的元素就绪，stop之后返回false
+    bool pop_front(T& val) {
+        return pop_impl(val, nullptr);
+    }
+
+    // 不等待，没有就绪的元素或者已经stop时返回false
+    bool try_pop(T& val) {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        if(stop_ || heap_.empty() || heap_.top().ready_time > Clock::now()){
+            return false;
+        }
+
+        take(val);
+
+        return true;
+    }
+
+    template<class Rep, class Period>
+    bool pop_for(T& val, const std::chrono::duration<Rep, Period>& timeout) {
+        return pop_until(val, Clock::now() + std::chrono::duration_cast<Clock::duration>(timeout));
+    }
+
+    // 最多等待到deadline，期间没有元素就绪返回false
+    bool pop_until(T& val, const Clock::time_point& deadline) {
+        return pop_impl(val, &deadline);
+    }
+
+    // 最早的元素的就绪时间，队列为空时返回false
+    bool next_ready_time(Clock::time_point& ready_time) const {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        if(heap_.empty()){
+            return false;
+        }
+
+        ready_time = heap_.top().ready_time;
+
+        return true;
+    }
+
+    // 包括还没有就绪的元素
+    size_t size() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return heap_.size();
+    }
+
+    bool empty() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return heap_.empty();
+    }
+
+    bool start(){
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        stop_ = false;
+
+        return true;
+    }
+
+    void stop(){
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        stop_ = true;
+
+        cond_.notify_all();
+    }
+
+private:
+    struct Entry {
+        Entry() {}
+
+        template<class U>
+        Entry(U&& v, const Clock::time_point& t) : val(std::forward<U>(v)), ready_time(t) {}
+
+        T val;
+        Clock::time_point ready_time;
+
+        // 写入的顺序，就绪时间相同时先进先出
+        uint64_t seq = 0;
+    };
+
+    // 就绪时间越早优先级越高
+    struct Later {
+        bool operator()(const Entry& a, const Entry& b) const {
+            if(a.ready_time != b.ready_time){
+                return a.ready_time > b.ready_time;
+            }
+            return a.seq > b.seq;
+        }
+    };
+
+    bool push_impl(Entry&& entry) {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        if(stop_){
+            return false;
+        }
+
+        uint64_t seq = next_seq_++;
+        entry.seq = seq;
+
+        heap_.push(std::move(entry));
+
+        // 新元素成了最早就绪的元素：当前leader等待的时间太长了，让一个消费者重新计算
+        if(heap_.top().seq == seq){
+            leader_ = std::thread::id();
+            cond_.notify_one();
+        }
+
+        return true;
+    }
+
+    bool pop_impl(T& val, const Clock::time_point* deadline) {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        bool got = false;
+
+        while(!stop_){
+            Clock::time_point now = Clock::now();
+
+            if(!heap_.empty() && heap_.top().ready_time <= now){
+                take(val);
+                got = true;
+                break;
+            }
+
+            if(deadline && *deadline <= now){
+                break;
+            }
+
+            if(heap_.empty() || leader_ != std::thread::id()){
+                // 没有元素，或者已经有leader在定时等待了
+                if(deadline){
+                    cond_.wait_until(lock, *deadline);
+                }
+                else {
+                    cond_.wait(lock);
+                }
+                continue;
+            }
+
+            // 成为leader，等待到最早的元素就绪
+            std::thread::id self = std::this_thread::get_id();
+            leader_ = self;
+
+            Clock::time_point wake_time = heap_.top().ready_time;
+            if(deadline && *deadline < wake_time){
+                wake_time = *deadline;
+            }
+
+            cond_.wait_until(lock, wake_time);
+
+            if(leader_ == self){
+                leader_ = std::thread::id();
+            }
+        }
+
+        // 没有leader了，并且还有元素：唤醒一个消费者接替leader
+        if(!stop_ && leader_ == std::thread::id() && !heap_.empty()){
+            cond_.notify_one();
+        }
+
+        return got;
+    }
+
+    void take(T& val) {
+        Entry entry;
+        heap_.pop(entry);
+        val = std::move(entry.val);
+    }
+
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+
+    DaryHeap<Entry, Later> heap_;
+    uint64_t next_seq_ = 0;
+    bool stop_ = false;
+
+    // 正在按最早的就绪时间定时等待的消费者
+    std::thread::id leader_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(DelayQueue);
+};
+
+}
+
+#endif /* __LAZY_PRIORITY_DATA_QUEUE_H__2024__ */
@@ -0,0 +1,127 @@
+//
+//  rcu.h
+//
+
+#ifndef __LAZY_RCU_H__2024__
+#define __LAZY_RCU_H__2024__
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+
+#include "lazy_base_common.h"
+
+#include "rw_lock.h"
+#include "sync.h"
+
+namespace lazy {
+
+/*
+** 读-拷贝-更新（RCU）的宽限期：读者不需要登记线程，进入/离开只是给当前CPU的计数加一/减一
+** 用法：
+**   读：uint32_t token = rcu.read_lock(); T* p = ptr.load(); ...访问p... rcu.read_unlock(token);
+**   写：拷贝一份新的数据，ptr.store(新的)，rcu.synchronize()，然后delete旧的
+** 实现（类似Linux的SRCU）：
+** 1、两组按CPU分散的读者计数，当前阶段（phase）决定读者加在哪一组上
+** 2、synchronize翻转阶段，新来的读者加到另一组，然后等旧的一组的和变成0；
+**    读者读阶段和加计数之间可能被切走，加到了已经翻转过去的那一组，所以要翻转、等待两次，两组都等一遍
+** 3、写者等待读者时在futex上挂起，读者离开时只有发现有写者在等才会唤醒
+** 4、读者永远不会等待写者（wait-free），写者的开销和CPU个数成正比，只适合读远多于写的场景
+** 5、读的临界区内不能调用synchronize，否则会死锁
+*/
+class RcuDomain {
+public:
+    /* slots: 每组读者计数的个数，为0时按CPU个数
+     */
+    explicit RcuDomain(uint32_t slots = 0) : phase_(0), synchronizing_(false), drain_seq_(0) {
+        readers_[0].reset(new PerCpuCounters(slots));
+        readers_[1].reset(new PerCpuCounters(slots));
+    }
+
+    // 进入读的临界区，返回值交给read_unlock
+    uint32_t read_lock() {
+        uint32_t phase = phase_.load(std::memory_order_relaxed);
+
+        PerCpuCounters& readers = *readers_[phase];
+        uint32_t slot = readers.current_slot();
+
+        // seq_cst：之后读共享指针不会排到加计数之前，写者求和时没有看到这次加一，就一定能读到新的指针
+        readers.at(slot).fetch_add(1);
+
+        return (slot << 1) | phase;
+    }
+
+    void read_unlock(uint32_t token) {
+        readers_[token & 1]->at(token >> 1).fetch_sub(1);
+
+        // 和synchronize配对（都是seq_cst）：要么这里看到写者在等，要么写者求和时看到这次减一
+        if(synchronizing_.load()){
+            drain_seq_.fetch_add(1);
+
+            drain_waiter_.wake_all(drain_seq_);
+        }
+    }
+
+    // 等待调用之前已经进入临界区的读者全部离开
+    void synchronize() {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        synchronizing_.store(true);
+
+        for(int i = 0; i < 2; ++i){
+            uint32_t old = phase_.load(std::memory_order_relaxed);
+
+            phase_.store(old ^ 1);
+
+            PerCpuCounters& readers = *readers_[old];
+
+            drain_waiter_.wait(drain_seq_, [&readers](uint32_t){ return readers.sum() == 0; }, nullptr);
+        }
+
+        synchronizing_.store(false);
+    }
+
+    // 写者等待读者离开时，先自旋再挂起，见WaitStrategy
+    void set_wait_strategy(WaitStrategy strategy, uint32_t max_spin_us = 50) {
+        drain_waiter_.set_wait_strategy(strategy, max_spin_us);
+    }
+
+private:
+    std::unique_ptr<PerCpuCounters> readers_[2];
+
+    // 读者每次都要读，写者很少修改
+    std::atomic<uint32_t> phase_;
+    std::atomic<bool> synchronizing_;
+
+    char pad0_[LAZY_CACHE_LINE_SIZE];
+
+    // 写者等待期间读者离开时加一
+    std::atomic<uint32_t> drain_seq_;
+    FutexWaiter drain_waiter_;
+
+    // 写者之间串行
+    std::mutex mutex_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(RcuDomain);
+};
+
+// 读的临界区的RAII
+class RcuReadGuard {
+public:
+    explicit RcuReadGuard(RcuDomain& rcu) : rcu_(rcu), token_(rcu.read_lock()) {
+    }
+
+    ~RcuReadGuard() {
+        rcu_.read_unlock(token_);
+    }
+
+private:
+    RcuDomain& rcu_;
+    uint32_t token_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(RcuReadGuard);
+};
+
+}
+
+#endif /* __LAZY_RCU_H__2024__ */
@@ -0,0 +1,638 @@
+//
+//  reactor_task_queue.h
+//
+
+#ifndef __LAZY_REACTOR_TASK_QUEUE_H__2024__
+#define __LAZY_REACTOR_TASK_QUEUE_H__2024__
+
+#if defined(__linux__)
+
+#include <assert.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <mutex>
+#include <deque>
+#include <map>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+
+#include "lazy_base_common.h"
+
+#include "task_queue.h"
+#include "thread_utils.h"
+#include "time_utils.h"
+
+namespace lazy {
+
+/*
+** Reactor模式的任务队列（仅Linux）
+** 1、接口和TaskQueue一样（post/post_delayed/add_timer/invoke...），同一个线程上按顺序执行
+** 2、投递任务通过eventfd唤醒线程，延迟任务/定时器通过timerfd唤醒，不需要轮询
+** 3、可以通过watch_fd监听fd的读写事件，回调和任务在同一个线程上执行，
+**    网络代码不再需要单独的epoll线程，也就没有线程切换
+*/
+class ReactorTaskQueue {
+public:
+    // fd的事件回调，events是EPOLLIN/EPOLLOUT/EPOLLERR等的组合
+    typedef std::function<void(int fd, uint32_t events)> FdCallback;
+
+    ReactorTaskQueue() : thread_id_(std::thread::id()) {
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+        assert(epoll_fd_ >= 0 && event_fd_ >= 0 && timer_fd_ >= 0);
+
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = make_tag(event_fd_, 0);
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &ev);
+
+        ev.events = EPOLLIN;
+        ev.data.u64 = make_tag(timer_fd_, 0);
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, timer_fd_, &ev);
+    }
+
+    ~ReactorTaskQueue() {
+        stop();
+
+        close(timer_fd_);
+        close(event_fd_);
+        close(epoll_fd_);
+    }
+
+    void start() {
+        maybe_create_thread();
+    }
+
+    // 执行完已经投递的任务（延迟任务也会立即执行），然后退出线程
+    // 不能在任务队列的线程中调用
+    void stop() {
+        assert(!is_current());
+
+        {
+            std::unique_lock<std::mutex> guard(mutex_);
+
+            if(!thread_.joinable()){
+                return;
+            }
+
+            quit_ = true;
+        }
+
+        wakeup();
+
+        thread_.join();
+
+        std::unique_lock<std::mutex> guard(mutex_);
+        thread_ = std::thread();
+        quit_ = false;
+    }
+
+    // 判断当前所在的线程是否和任务队列的线程为同一个
+    bool is_current() const {
+        return std::this_thread::get_id() == thread_id_.load(std::memory_order_acquire);
+    }
+
+    // 设置名字，同时也会设置为线程的名字
+    void set_name(const std::string& name) {
+        bool running = false;
+        {
+            std::unique_lock<std::mutex> guard(mutex_);
+            name_ = name;
+            running = thread_.joinable();
+        }
+
+        if(running){
+            apply_on_thread([&]{
+                ThreadUtil::SetCurrentName(name);
+            });
+        }
+    }
+
+    const std::string& name() const {
+        return name_;
+    }
+
+    // 设置线程的CPU亲和性、NUMA节点、nice值以及调度策略
+    // 线程还没有创建时，在线程启动的时候设置，返回true
+    // 返回false表示有参数设置失败，比如没有权限设置实时调度、CPU编号不存在
+    bool set_thread_options(const ThreadOptions& options) {
+        bool running = false;
+        {
+            std::unique_lock<std::mutex> guard(mutex_);
+            thread_options_ = options;
+            running = thread_.joinable();
+        }
+
+        if(!running){
+            return true;
+        }
+
+        // 没有指定的参数恢复成默认值，可以撤销之前的设置
+        bool ok = false;
+        apply_on_thread([&]{
+            ok = ThreadUtil::ApplyToCurrent(options, true);
+        });
+
+        return ok;
+    }
+
+    // 添加异步任务，和post效果一样
+    template <class Closure>
+    void add_task(Closure&& closure, uint64_t task_id = INVALID_ID) {
+        post_delayed_internal(std::forward<Closure>(closure), 0, task_id, 0);
+    }
+
+    // 添加异步任务
+    template <class Closure>
+    void post(Closure&& closure, uint64_t task_id = INVALID_ID) {
+        post_delayed_internal(std::forward<Closure>(closure), 0, task_id, 0);
+    }
+
+    // 添加带延迟的异步任务
+    template <class Closure>
+    void post_delayed(Closure&& closure, uint32_t delay_or_interval_ms, uint64_t task_id = INVALID_ID) {
+        post_delayed_internal(std::forward<Closure>(closure), delay_or_interval_ms, task_id, 0);
+    }
+
+    // 添加带延迟的重复任务，repeat_num的含义和TaskQueue一样
+    template <class Closure>
+    void post_delayed_and_repeat(Closure&& closure,
+                                 uint32_t delay_or_interval_ms,
+                                 uint64_t task_id,
+                                 uint64_t repeat_num) {
+        post_delayed_internal(std::forward<Closure>(closure), delay_or_interval_ms, task_id, repeat_num);
+    }
+
+    // 取消一个异步任务
+    void cancel(uint64_t task_id) {
+        if(task_id == INVALID_ID){
+            return;
+        }
+
+        std::unique_lock<std::mutex> guard(mutex_);
+
+        for(auto it = delayed_task_map_.begin(); it != delayed_task_map_.end(); ++it){
+            if(it->second->task_id == task_id){
+                delayed_task_map_.erase(it);
+                break;
+            }
+        }
+
+        // 任务可能正在执行，执行结束后不要再放回延迟队列
+        if(running_task_id_ == task_id){
+            running_task_canceled_ = true;
+        }
+    }
+
+    // 添加定时器，需要明确指定一个id
+    template <class Closure>
+    bool add_timer(Closure&& closure, uint32_t interval_ms, uint64_t task_id) {
+        if(interval_ms == 0 || task_id == INVALID_ID){
+            return false;
+        }
+
+        post_delayed_internal(std::forward<Closure>(closure), interval_ms, task_id, -1);
+
+        return true;
+    }
+
+    // 移除定时器
+    void remove_timer(uint64_t task_id) {
+        return cancel(task_id);
+    }
+
+    // 执行同步任务，在任务队列的线程中调用时直接执行
+    template <class ReturnT, class Closure>
+    ReturnT invoke(Closure&& closure) {
+        if(is_current()){
+            return closure();
+        }
+
+        maybe_create_thread();
+
+        std::shared_ptr<QueuedTask> task = MakeSharedClosure<ReturnT, Closure>(std::forward<Closure>(closure));
+        task->finished = false;
+        task->task_id = INVALID_ID;
+        task->is_sync = true;
+        task->repeat_num = 0;
+
+        {
+            std::unique_lock<std::mutex> guard(mutex_);
+            task_list_.push_back(task);
+        }
+
+        wakeup();
+
+        {
+            // 等待任务执行结束
+            std::unique_lock<std::mutex> guard(sync_mutex_);
+            sync_cond_.wait(guard, [&] {
+                return task->finished;
+            });
+        }
+
+        ClosureTask<ReturnT, Closure>* ptr = (ClosureTask<ReturnT, Closure>*)task.get();
+        return ptr->move_result();
+    }
+
+    /* 监听fd的事件，回调在任务队列的线程上执行
+     * fd: 需要监听的fd，一般是非阻塞的socket
+     * events: EPOLLIN/EPOLLOUT等，可以带上EPOLLET
+     * cb: 事件回调
+     * 同一个fd重复调用时，替换原来的事件和回调
+     * fd没有unwatch_fd就被关闭、编号又被新的fd复用时，丢掉旧的记录，按新的fd（新的generation）监听
+     */
+    bool watch_fd(int fd, uint32_t events, const FdCallback& cb) {
+        if(fd < 0 || !cb){
+            return false;
+        }
+
+        if(!is_current()){
+            maybe_create_thread();
+            return invoke<bool>([&]{
+                return watch_fd(fd, events, cb);
+            });
+        }
+
+        auto it = watchers_.find(fd);
+
+        epoll_event ev;
+        ev.events = events;
+
+        if(it != watchers_.end()){
+            ev.data.u64 = make_tag(fd, it->second->generation);
+
+            if(epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev) == 0){
+                // 回调可能正在执行，不能直接修改，换一个新的
+                std::shared_ptr<Watcher> watcher(new Watcher(*it->second));
+                watcher->events = events;
+                watcher->cb = cb;
+                it->second = watcher;
+
+                return true;
+            }
+
+            if(errno != ENOENT){
+                return false;
+            }
+
+            // 旧的fd关闭时已经从epoll中移除了，这是一个复用了编号的新fd；
+            // 旧的generation作废，已经取出的旧事件会被忽略
+            watchers_.erase(it);
+        }
+
+        std::shared_ptr<Watcher> watcher(new Watcher());
+        watcher->events = events;
+        watcher->cb = cb;
+        watcher->generation = next_generation_++;
+
+        ev.data.u64 = make_tag(fd, watcher->generation);
+
+        if(epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0){
+            return false;
+        }
+
+        watchers_[fd] = watcher;
+
+        return true;
+    }
+
+    // 取消监听，返回之后回调不会再被调用；需要在close(fd)之前调用
+    bool unwatch_fd(int fd) {
+        if(!is_current()){
+            if(!thread_.joinable()){
+                return false;
+            }
+
+            return invoke<bool>([&]{
+                return unwatch_fd(fd);
+            });
+        }
+
+        auto it = watchers_.find(fd);
+
+        if(it == watchers_.end()){
+            return false;
+        }
+
+        watchers_.erase(it);
+
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+
+        return true;
+    }
+
+private:
+    struct Watcher {
+        uint32_t events = 0;
+        FdCallback cb;
+
+        // 同一个fd关闭之后可能被复用，用generation区分新旧的事件
+        uint32_t generation = 0;
+    };
+
+    // epoll_event.data中保存fd和generation
+    static uint64_t make_tag(int fd, uint32_t generation) {
+        return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
+    }
+
+    template <class Closure>
+    void apply_on_thread(Closure&& closure) {
+        if(is_current()){
+            closure();
+            return;
+        }
+
+        invoke<void>(std::forward<Closure>(closure));
+    }
+
+    template <class Closure>
+    void post_delayed_internal(Closure&& closure, uint32_t delay_or_interval_ms, uint64_t task_id, uint64_t repeat_num) {
+        maybe_create_thread();
+
+        std::shared_ptr<QueuedTask> task = MakeSharedClosure<void, Closure>(std::forward<Closure>(closure));
+        task->finished = false;
+        task->task_id = task_id;
+        task->enqueue_time_ms = TimeUtil::MonoNowMs();
+        task->delay_ms = delay_or_interval_ms;
+        task->is_sync = false;
+        task->repeat_num = repeat_num;
+        task->invoke_count = 0;
+
+        bool need_wakeup = false;
+        {
+            std::unique_lock<std::mutex> guard(mutex_);
+
+            if(delay_or_interval_ms == 0){
+                task_list_.push_back(std::move(task));
+                need_wakeup = true;
+            }
+            else {
+                int64_t target_time_ms = task->enqueue_time_ms + task->delay_ms;
+
+                auto it = delayed_task_map_.insert(std::make_pair(target_time_ms, std::move(task)));
+
+                // 只有最早的延迟任务变化了，才需要重新设置timerfd
+                need_wakeup = (it == delayed_task_map_.begin());
+            }
+        }
+
+        // 在任务队列的线程中投递时也要唤醒：任务里投递的任务不在这一轮run_tasks取出的列表里，
+        // 不唤醒的话要等到下一个事件才会执行；wakeup_pending_保证每一轮最多写一次eventfd，
+        // 而且任务里不断投递新任务时，fd的事件也能在两轮之间得到处理
+        if(need_wakeup){
+            wakeup();
+        }
+    }
+
+    // 唤醒线程，已经有唤醒在路上时不再写eventfd
+    void wakeup() {
+        if(wakeup_pending_.exchange(true, std::memory_order_acq_rel)){
+            return;
+        }
+
+        uint64_t one = 1;
+        ssize_t ret = write(event_fd_, &one, sizeof(one));
+        (void)ret;
+    }
+
+    void maybe_create_thread() {
+        if(thread_id_.load(std::memory_order_acquire) != std::thread::id()){
+            return;
+        }
+
+        std::unique_lock<std::mutex> guard(mutex_);
+
+        if(thread_.joinable()){
+            return;
+        }
+
+        thread_ = std::thread(std::bind(&ReactorTaskQueue::run, this));
+
+        thread_id_.store(thread_.get_id(), std::memory_order_release);
+    }
+
+    // 把timerfd设置为最早的延迟任务的时间，需要持有锁
+    void rearm_timer_locked() {
+        int64_t deadline_ms = delayed_task_map_.empty() ? 0 : delayed_task_map_.begin()->first;
+
+        if(deadline_ms == armed_deadline_ms_){
+            return;
+        }
+
+        armed_deadline_ms_ = deadline_ms;
+
+        itimerspec spec;
+        memset(&spec, 0, sizeof(spec));
+
+        if(deadline_ms > 0){
+            spec.it_value.tv_sec = deadline_ms / 1000;
+            spec.it_value.tv_nsec = (deadline_ms % 1000) * 1000000;
+        }
+
+        // it_value全为0表示停止定时器
+        timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+
+    // 执行已经到期的任务
+    void run_tasks(bool flush) {
+        std::deque<std::shared_ptr<QueuedTask>> tasks;
+        {
+            std::unique_lock<std::mutex> guard(mutex_);
+
+            int64_t now_ms = TimeUtil::MonoNowMs();
+
+            for(auto it = delayed_task_map_.begin(); it != delayed_task_map_.end();){
+                if(it->first <= now_ms || flush){
+                    task_list_.push_back(std::move(it->second));
+                    it = delayed_task_map_.erase(it);
+                }
+                else {
+                    break;
+                }
+            }
+
+            tasks.swap(task_list_);
+        }
+
+        for(auto& task : tasks){
+            bool repeat = !task->is_sync && task->repeat_num != 0 && task->delay_ms > 0;
+
+            // 只有重复任务需要记录，普通任务不额外加锁
+            if(repeat){
+                std::unique_lock<std::mutex> guard(mutex_);
+                running_task_id_ = task->task_id;
+                running_task_canceled_ = false;
+            }
+
+            task->run();
+
+            // 对于同步任务，在这里进行唤醒操作
+            if(task->is_sync){
+                std::unique_lock<std::mutex> guard(sync_mutex_);
+                task->finished = true;
+                sync_cond_.notify_all();
+                continue;
+            }
+
+            if(!repeat){
+                continue;
+            }
+
+            std::unique_lock<std::mutex> guard(mutex_);
+
+            running_task_id_ = INVALID_ID;
+
+            // 如果是重复任务
+            if(!flush && !running_task_canceled_){
+                ++task->invoke_count;
+
+                if(task->invoke_count < task->repeat_num){
+                    task->enqueue_time_ms = TimeUtil::MonoNowMs();
+
+                    int64_t target_time_ms = task->enqueue_time_ms + task->delay_ms;
+
+                    delayed_task_map_.insert(std::make_pair(target_time_ms, std::move(task)));
+                }
+            }
+        }
+    }
+
+    // 任务队列线程函数
+    void run() {
+        std::string name;
+        ThreadOptions options;
+        {
+            std::unique_lock<std::mutex> guard(mutex_);
+            name = name_;
+            options = thread_options_;
+        }
+
+        if(!name.empty()){
+            ThreadUtil::SetCurrentName(name);
+        }
+
+        ThreadUtil::ApplyToCurrent(options);
+
+        const int max_events = 64;
+        epoll_event events[max_events];
+
+        while(true){
+            int n = epoll_wait(epoll_fd_, events, max_events, -1);
+
+            if(n < 0 && errno != EINTR){
+                break;
+            }
+
+            for(int i = 0; i < n; ++i){
+                int fd = static_cast<int>(events[i].data.u64 & 0xffffffff);
+                uint32_t generation = static_cast<uint32_t>(events[i].data.u64 >> 32);
+
+                if(fd == event_fd_ && generation == 0){
+                    uint64_t value = 0;
+                    ssize_t ret = read(event_fd_, &value, sizeof(value));
+                    (void)ret;
+
+                    // 先清除标识再取任务，之后投递的任务会重新唤醒
+                    wakeup_pending_.store(false, std::memory_order_release);
+                    continue;
+                }
+
+                if(fd == timer_fd_ && generation == 0){
+                    uint64_t expirations = 0;
+                    ssize_t ret = read(timer_fd_, &expirations, sizeof(expirations));
+                    (void)ret;
+                    continue;
+                }
+
+                auto it = watchers_.find(fd);
+
+                // 已经被取消了，或者是旧的fd的事件
+                if(it == watchers_.end() || it->second->generation != generation){
+                    continue;
+                }
+
+                // 回调中可能会unwatch_fd，所以先持有一份
+                std::shared_ptr<Watcher> watcher = it->second;
+                watcher->cb(fd, events[i].events);
+            }
+
+            bool quit = false;
+            {
+                std::unique_lock<std::mutex> guard(mutex_);
+                quit = quit_;
+            }
+
+            run_tasks(quit);
+
+            if(quit){
+                break;
+            }
+
+            std::unique_lock<std::mutex> guard(mutex_);
+            rearm_timer_locked();
+        }
+
+        std::unique_lock<std::mutex> guard(mutex_);
+        armed_deadline_ms_ = -1;
+        rearm_timer_locked();
+        thread_id_.store(std::thread::id(), std::memory_order_release);
+    }
+
+    const static uint64_t INVALID_ID = static_cast<uint64_t>(-1);
+
+    int epoll_fd_ = -1;
+    int event_fd_ = -1;
+    int timer_fd_ = -1;
+
+    std::mutex mutex_;
+
+    std::thread thread_;
+    std::atomic<std::thread::id> thread_id_;
+
+    std::atomic<bool> wakeup_pending_ {false};
+
+    std::deque<std::shared_ptr<QueuedTask>> task_list_;
+
+    // 按单调时钟排序的延迟任务
+    std::multimap<int64_t/*time ms*/, std::shared_ptr<QueuedTask>> delayed_task_map_;
+
+    // timerfd当前设置的时间，0表示没有设置
+    int64_t armed_deadline_ms_ = 0;
+
+    uint64_t running_task_id_ = INVALID_ID;
+    bool running_task_canceled_ = false;
+
+    bool quit_ = false;
+
+    std::mutex sync_mutex_;
+    std::condition_variable sync_cond_;
+
+    // 只在任务队列的线程中访问
+    std::map<int, std::shared_ptr<Watcher>> watchers_;
+    uint32_t next_generation_ = 1;
+
+    std::string name_ = "";
+
+    ThreadOptions thread_options_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(ReactorTaskQueue);
+};
+
+}
+
+#endif // __linux__
+
+#endif /* __LAZY_REACTOR_TASK_QUEUE_H__2024__ */
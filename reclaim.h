@@ -0,0 +1,578 @@
+//
+//  reclaim.h
+//
+
+#ifndef __LAZY_RECLAIM_H__2024__
+#define __LAZY_RECLAIM_H__2024__
+
+#include <stdint.h>
+#include <assert.h>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+
+#include "lazy_base_common.h"
+
+namespace lazy {
+
+// 等待释放的对象
+struct RetiredObject {
+    void* ptr;
+    void (*deleter)(void*);
+    // 基于纪元的回收：retire时的全局纪元
+    uint64_t epoch;
+};
+
+template<class T>
+void ReclaimDelete(void* ptr) {
+    delete static_cast<T*>(ptr);
+}
+
+/*
+** 基于纪元的内存回收（Epoch-Based Reclamation），给无锁数据结构用
+** 问题：无锁结构里把一个节点摘下来之后，其他线程可能刚刚读到它的指针、还在访问，不能立即delete
+** 做法：
+** 1、全局有一个纪元号。线程访问共享结构之前用Guard进入临界区，登记当前的纪元；离开时清除登记
+** 2、摘下来的节点不直接delete，而是retire：记下当时的全局纪元e，放进本线程的待释放列表
+** 3、所有处于临界区的线程都登记了当前纪元时，全局纪元才能加一；全局纪元到了e+2时，
+**    retire之前就进入临界区的线程一定都已经离开，这时释放是安全的
+** 4、待释放的对象攒够batch_size个才尝试推进纪元、批量释放，摊薄扫描所有线程的开销
+** 特点：读的一方进入/离开临界区只是一次store，开销极小；但是一个线程长时间停在临界区里会阻止所有的释放，
+**      内存没有上限，这种场景用HazardPointerDomain
+** 用法：
+**   EpochDomain domain;
+**   // 每个线程一个Handle（线程登记）
+**   EpochDomain::Handle handle(domain);
+**   {
+**       EpochDomain::Guard guard(handle);
+**       Node* node = head.load();
+**       ...  // 摘下node
+**       handle.retire(node);
+**   }
+*/
+class EpochDomain {
+public:
+    /* batch_size: 每个线程待释放的对象达到这个数量时，尝试批量释放
+     */
+    explicit EpochDomain(size_t batch_size = 64)
+    : batch_size_(batch_size > 0 ? batch_size : 1),
+      epoch_(kFirstEpoch), records_(nullptr), retired_(0), reclaimed_(0) {
+    }
+
+    // 析构时所有的Handle都必须已经析构，剩下的对象全部释放
+    ~EpochDomain() {
+        for(RetiredObject& r : orphans_){
+            r.deleter(r.ptr);
+        }
+
+        Record* record = records_.load();
+        while(record){
+            assert(!record->in_use.load());
+
+            Record* next = record->next;
+            delete record;
+            record = next;
+        }
+    }
+
+private:
+    struct Record;
+
+public:
+    class Handle;
+
+    // 临界区，可以嵌套
+    class Guard {
+    public:
+        explicit Guard(Handle& handle) : handle_(handle) {
+            handle_.enter();
+        }
+
+        ~Guard() {
+            handle_.leave();
+        }
+
+    private:
+        Handle& handle_;
+
+        LAZY_DISALLOW_COPY_AND_ASSIGN(Guard);
+    };
+
+    // 线程登记，只能在创建它的线程里使用
+    class Handle {
+    public:
+        explicit Handle(EpochDomain& domain) : domain_(domain), record_(domain.acquire_record()), depth_(0) {
+        }
+
+        // 还不能释放的对象交给domain，由其他线程或者domain的析构释放
+        ~Handle() {
+            assert(depth_ == 0);
+
+            flush();
+
+            domain_.release_record(record_, retired_);
+        }
+
+        void enter() {
+            if(depth_++ > 0){
+                return;
+            }
+
+            // 登记之后全局纪元没有变化才算进入，否则推进纪元的一方可能没有看到这次登记
+            uint64_t epoch = domain_.epoch_.load();
+
+            while(true){
+                record_->state.store(epoch | kActive);
+
+                uint64_t now = domain_.epoch_.load();
+                if(now == epoch){
+                    break;
+                }
+
+                epoch = now;
+            }
+        }
+
+        void leave() {
+            assert(depth_ > 0);
+
+            if(--depth_ > 0){
+                return;
+            }
+
+            record_->state.store(0, std::memory_order_release);
+
+            if(retired_.size() >= domain_.batch_size_){
+                collect();
+            }
+        }
+
+        bool active() const {
+            return depth_ > 0;
+        }
+
+        // 释放时调用delete
+        template<class T>
+        void retire(T* ptr) {
+            retire(ptr, &ReclaimDelete<T>);
+        }
+
+        /* 对象已经从共享结构中摘下来，等没有线程能访问它的时候调用deleter(ptr)
+         */
+        void retire(void* ptr, void (*deleter)(void*)) {
+            // 摘下之后再读纪元：能看到这个对象的线程登记的纪元都不会比它大
+            RetiredObject r = {ptr, deleter, domain_.epoch_.load()};
+
+            retired_.push_back(r);
+
+            domain_.retired_.fetch_add(1, std::memory_order_relaxed);
+
+            if(retired_.size() >= domain_.batch_size_){
+                collect();
+            }
+        }
+
+        // 尝试推进纪元，释放所有已经安全的对象
+        void flush() {
+            collect();
+            collect();
+        }
+
+        // 本线程还没有释放的对象个数
+        size_t pending() const {
+            return retired_.size();
+        }
+
+    private:
+        void collect() {
+            domain_.try_advance();
+
+            uint64_t epoch = domain_.epoch_.load();
+
+            size_t freed = free_before(retired_, epoch);
+
+            freed += domain_.collect_orphans(epoch);
+
+            domain_.reclaimed_.fetch_add(freed, std::memory_order_relaxed);
+        }
+
+        EpochDomain& domain_;
+
+        Record* record_;
+
+        uint32_t depth_;
+
+        // 按retire的顺序，纪元从小到大
+        std::vector<RetiredObject> retired_;
+
+        LAZY_DISALLOW_COPY_AND_ASSIGN(Handle);
+    };
+
+    // 当前的全局纪元
+    uint64_t epoch() const {
+        return epoch_.load(std::memory_order_relaxed) >> 1;
+    }
+
+    // 累计retire的个数
+    uint64_t retired() const {
+        return retired_.load(std::memory_order_relaxed);
+    }
+
+    // 累计释放的个数
+    uint64_t reclaimed() const {
+        return reclaimed_.load(std::memory_order_relaxed);
+    }
+
+private:
+    // 纪元左移一位存放，最低位表示线程在临界区内
+    static const uint64_t kActive = 1;
+    static const uint64_t kEpochStep = 2;
+    static const uint64_t kFirstEpoch = kEpochStep * 2;
+
+    struct Record {
+        Record() : state(0), in_use(true), next(nullptr) {
+        }
+
+        // 0表示不在临界区内
+        std::atomic<uint64_t> state;
+        std::atomic<bool> in_use;
+        Record* next;
+
+        char pad_[LAZY_CACHE_LINE_SIZE];
+    };
+
+    // 线程的登记记录只增不减，Handle析构之后留给下一个Handle复用
+    Record* acquire_record() {
+        for(Record* record = records_.load(); record; record = record->next){
+            bool expected = false;
+            if(!record->in_use.load(std::memory_order_relaxed) && record->in_use.compare_exchange_strong(expected, true)){
+                return record;
+            }
+        }
+
+        Record* record = new Record();
+
+        Record* head = records_.load();
+        do {
+            record->next = head;
+        } while(!records_.compare_exchange_weak(head, record));
+
+        return record;
+    }
+
+    void release_record(Record* record, std::vector<RetiredObject>& retired) {
+        if(!retired.empty()){
+            std::unique_lock<std::mutex> lock(mutex_);
+            orphans_.insert(orphans_.end(), retired.begin(), retired.end());
+            retired.clear();
+        }
+
+        record->state.store(0);
+        record->in_use.store(false, std::memory_order_release);
+    }
+
+    // 所有在临界区内的线程都登记了当前纪元时，全局纪元加一
+    void try_advance() {
+        uint64_t epoch = epoch_.load();
+
+        for(Record* record = records_.load(); record; record = record->next){
+            uint64_t state = record->state.load();
+
+            if((state & kActive) && (state & ~kActive) != epoch){
+                return;
+            }
+        }
+
+        epoch_.compare_exchange_strong(epoch, epoch + kEpochStep);
+    }
+
+    // 释放纪元比当前纪元小2以上的对象，返回释放的个数
+    static size_t free_before(std::vector<RetiredObject>& retired, uint64_t epoch) {
+        size_t n = 0;
+
+        while(n < retired.size() && retired[n].epoch + kEpochStep * 2 <= epoch){
+            retired[n].deleter(retired[n].ptr);
+            ++n;
+        }
+
+        retired.erase(retired.begin(), retired.begin() + n);
+
+        return n;
+    }
+
+    size_t collect_orphans(uint64_t epoch) {
+        std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+
+        if(!lock.owns_lock() || orphans_.empty()){
+            return 0;
+        }
+
+        // 不同线程交过来的对象纪元不是有序的
+        std::stable_sort(orphans_.begin(), orphans_.end(), [](const RetiredObject& a, const RetiredObject& b){
+            return a.epoch < b.epoch;
+        });
+
+        return free_before(orphans_, epoch);
+    }
+
+    const size_t batch_size_;
+
+    std::atomic<uint64_t> epoch_;
+
+    std::atomic<Record*> records_;
+
+    // 已经析构的Handle留下的对象
+    std::mutex mutex_;
+    std::vector<RetiredObject> orphans_;
+
+    std::atomic<uint64_t> retired_;
+    std::atomic<uint64_t> reclaimed_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(EpochDomain);
+};
+
+/*
+** 风险指针（Hazard Pointer）
+** 和EpochDomain的用法类似，区别是保护的粒度是单个对象而不是一段临界区：
+** 1、每个线程有slots个风险指针，访问一个对象之前先把它的地址写进风险指针（protect），访问完清除
+** 2、retire的对象攒够一批之后，收集所有线程的风险指针，没有被任何风险指针指向的对象才释放
+** 3、一个线程停住最多只会挡住它保护的几个对象，待释放的内存有上限；代价是每次protect都要一次全屏障
+*/
+class HazardPointerDomain {
+public:
+    /* slots: 每个线程的风险指针个数（同时保护的对象个数）
+     * batch_size: 每个线程待释放的对象达到这个数量时，扫描一次风险指针
+     */
+    explicit HazardPointerDomain(size_t slots = 2, size_t batch_size = 64)
+    : slots_(slots > 0 ? slots : 1), batch_size_(batch_size > 0 ? batch_size : 1),
+      records_(nullptr), record_count_(0), retired_(0), reclaimed_(0) {
+    }
+
+    // 析构时所有的Handle都必须已经析构，剩下的对象全部释放
+    ~HazardPointerDomain() {
+        for(RetiredObject& r : orphans_){
+            r.deleter(r.ptr);
+        }
+
+        Record* record = records_.load();
+        while(record){
+            assert(!record->in_use.load());
+
+            Record* next = record->next;
+            delete record;
+            record = next;
+        }
+    }
+
+private:
+    struct Record;
+
+public:
+    // 线程登记，只能在创建它的线程里使用
+    class Handle {
+    public:
+        explicit Handle(HazardPointerDomain& domain) : domain_(domain), record_(domain.acquire_record()) {
+        }
+
+        ~Handle() {
+            for(size_t i = 0; i < domain_.slots_; ++i){
+                clear(i);
+            }
+
+            flush();
+
+            domain_.release_record(record_, retired_);
+        }
+
+        /* 读src并用第slot个风险指针保护读到的对象，返回之后直到clear(slot)之前都可以安全访问
+         */
+        template<class T>
+        T* protect(size_t slot, const std::atomic<T*>& src) {
+            assert(slot < domain_.slots_);
+
+            T* ptr = src.load(std::memory_order_relaxed);
+
+            while(true){
+                record_->hazards[slot].store(ptr);
+
+                // 发布之后src没有变化，说明发布时对象还没有被摘下，retire的一方扫描时一定能看到
+                T* now = src.load();
+                if(now == ptr){
+                    return ptr;
+                }
+
+                ptr = now;
+            }
+        }
+
+        void clear(size_t slot) {
+            record_->hazards[slot].store(nullptr, std::memory_order_release);
+        }
+
+        template<class T>
+        void retire(T* ptr) {
+            retire(ptr, &ReclaimDelete<T>);
+        }
+
+        void retire(void* ptr, void (*deleter)(void*)) {
+            RetiredObject r = {ptr, deleter, 0};
+
+            retired_.push_back(r);
+
+            domain_.retired_.fetch_add(1, std::memory_order_relaxed);
+
+            // 至少是风险指针总数的两倍，保证每次扫描都能释放一半以上
+            size_t threshold = std::max(domain_.batch_size_, domain_.record_count_.load(std::memory_order_relaxed) * domain_.slots_ * 2);
+
+            if(retired_.size() >= threshold){
+                flush();
+            }
+        }
+
+        // 释放所有没有被保护的对象
+        void flush() {
+            size_t freed = domain_.scan(retired_);
+
+            freed += domain_.collect_orphans();
+
+            domain_.reclaimed_.fetch_add(freed, std::memory_order_relaxed);
+        }
+
+        size_t pending() const {
+            return retired_.size();
+        }
+
+    private:
+        HazardPointerDomain& domain_;
+
+        Record* record_;
+
+        std::vector<RetiredObject> retired_;
+
+        LAZY_DISALLOW_COPY_AND_ASSIGN(Handle);
+    };
+
+    uint64_t retired() const {
+        return retired_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t reclaimed() const {
+        return reclaimed_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Record {
+        explicit Record(size_t slots) : hazards(new std::atomic<void*>[slots]), in_use(true), next(nullptr) {
+            for(size_t i = 0; i < slots; ++i){
+                hazards[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        ~Record() {
+            delete[] hazards;
+        }
+
+        std::atomic<void*>* hazards;
+        std::atomic<bool> in_use;
+        Record* next;
+
+        char pad_[LAZY_CACHE_LINE_SIZE];
+    };
+
+    Record* acquire_record() {
+        for(Record* record = records_.load(); record; record = record->next){
+            bool expected = false;
+            if(!record->in_use.load(std::memory_order_relaxed) && record->in_use.compare_exchange_strong(expected, true)){
+                return record;
+            }
+        }
+
+        Record* record = new Record(slots_);
+
+        Record* head = records_.load();
+        do {
+            record->next = head;
+        } while(!records_.compare_exchange_weak(head, record));
+
+        record_count_.fetch_add(1, std::memory_order_relaxed);
+
+        return record;
+    }
+
+    void release_record(Record* record, std::vector<RetiredObject>& retired) {
+        if(!retired.empty()){
+            std::unique_lock<std::mutex> lock(mutex_);
+            orphans_.insert(orphans_.end(), retired.begin(), retired.end());
+            retired.clear();
+        }
+
+        record->in_use.store(false, std::memory_order_release);
+    }
+
+    // 释放retired中没有被保护的对象，返回释放的个数
+    size_t scan(std::vector<RetiredObject>& retired) {
+        if(retired.empty()){
+            return 0;
+        }
+
+        std::vector<void*> hazards;
+
+        for(Record* record = records_.load(); record; record = record->next){
+            for(size_t i = 0; i < slots_; ++i){
+                void* p = record->hazards[i].load();
+                if(p){
+                    hazards.push_back(p);
+                }
+            }
+        }
+
+        std::sort(hazards.begin(), hazards.end());
+
+        size_t kept = 0;
+        size_t freed = 0;
+
+        for(size_t i = 0; i < retired.size(); ++i){
+            if(std::binary_search(hazards.begin(), hazards.end(), retired[i].ptr)){
+                retired[kept++] = retired[i];
+            }
+            else {
+                retired[i].deleter(retired[i].ptr);
+                ++freed;
+            }
+        }
+
+        retired.resize(kept);
+
+        return freed;
+    }
+
+    size_t collect_orphans() {
+        std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+
+        if(!lock.owns_lock()){
+            return 0;
+        }
+
+        return scan(orphans_);
+    }
+
+    const size_t slots_;
+    const size_t batch_size_;
+
+    std::atomic<Record*> records_;
+    std::atomic<size_t> record_count_;
+
+    // 已经析构的Handle留下的对象
+    std::mutex mutex_;
+    std::vector<RetiredObject> orphans_;
+
+    std::atomic<uint64_t> retired_;
+    std::atomic<uint64_t> reclaimed_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(HazardPointerDomain);
+};
+
+}
+
+#endif /* __LAZY_RECLAIM_H__2024__ */
@@ -0,0 +1,361 @@
+//
+//  ring_buffer.h
+//
+
+#ifndef __LAZY_RING_BUFFER_H__2024__
+#define __LAZY_RING_BUFFER_H__2024__
+
+#include <stdint.h>
+#include <assert.h>
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <utility>
+#include <type_traits>
+#include <condition_variable>
+
+#include "lazy_base_common.h"
+
+#include "wait_strategy.h"
+
+namespace lazy {
+
+/*
+** 单生产者单消费者（SPSC）的无锁环形缓冲区
+** 1、容量固定（向上取整到2的幂），构造时一次性分配，之后push/pop不会再分配内存
+** 2、push只能在一个线程中调用，pop只能在另一个线程中调用，两者都是wait-free的
+** 3、读写位置放在不同的缓存行中，并且各自缓存一份对方的位置，
+**    只有缓存的位置显示已满/已空时才去读对方的缓存行
+*/
+template<class T>
+class SpscRingBuffer {
+public:
+    explicit SpscRingBuffer(size_t capacity) : head_(0), tail_(0) {
+        capacity_ = 1;
+        while(capacity_ < capacity){
+            capacity_ <<= 1;
+        }
+        mask_ = capacity_ - 1;
+
+        slots_ = new Slot[capacity_];
+    }
+
+    ~SpscRingBuffer() {
+        size_t tail = tail_.load(std::memory_order_acquire);
+        for(size_t i = head_.load(std::memory_order_relaxed); i != tail; ++i){
+            slot(i)->~T();
+        }
+
+        delete [] slots_;
+    }
+
+    // 生产者调用，满了返回false
+    bool push(const T& val) {
+        return emplace(val);
+    }
+
+    // 生产者调用，满了返回false
+    bool push(T&& val) {
+        return emplace(std::move(val));
+    }
+
+    // 生产者调用，满了返回false
+    template<class... Args>
+    bool emplace(Args&&... args) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+
+        if(tail - producer_cached_head_ == capacity_){
+            producer_cached_head_ = head_.load(std::memory_order_acquire);
+
+            if(tail - producer_cached_head_ == capacity_){
+                return false;
+            }
+        }
+
+        new (slot(tail)) T(std::forward<Args>(args)...);
+
+        tail_.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // 生产者调用，批量写入，返回实际写入的个数
+    size_t push_n(const T* data, size_t n) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+
+        size_t free_slots = capacity_ - (tail - producer_cached_head_);
+
+        if(free_slots < n){
+            producer_cached_head_ = head_.load(std::memory_order_acquire);
+            free_slots = capacity_ - (tail - producer_cached_head_);
+        }
+
+        if(n > free_slots){
+            n = free_slots;
+        }
+
+        for(size_t i = 0; i < n; ++i){
+            new (slot(tail + i)) T(data[i]);
+        }
+
+        // 只发布一次
+        tail_.store(tail + n, std::memory_order_release);
+
+        return n;
+    }
+
+    // 消费者调用，空了返回false
+    bool pop(T& val) {
+        size_t head = head_.load(std::memory_order_relaxed);
+
+        if(head == consumer_cached_tail_){
+            consumer_cached_tail_ = tail_.load(std::memory_order_acquire);
+
+            if(head == consumer_cached_tail_){
+                return false;
+            }
+        }
+
+        T* p = slot(head);
+        val = std::move(*p);
+        p->~T();
+
+        head_.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // 消费者调用，批量读取，返回实际读取的个数
+    size_t pop_n(T* out, size_t n) {
+        size_t head = head_.load(std::memory_order_relaxed);
+
+        size_t available = consumer_cached_tail_ - head;
+
+        if(available < n){
+            consumer_cached_tail_ = tail_.load(std::memory_order_acquire);
+            available = consumer_cached_tail_ - head;
+        }
+
+        if(n > available){
+            n = available;
+        }
+
+        for(size_t i = 0; i < n; ++i){
+            T* p = slot(head + i);
+            out[i] = std::move(*p);
+            p->~T();
+        }
+
+        head_.store(head + n, std::memory_order_release);
+
+        return n;
+    }
+
+    // 近似值，两端都在修改时只能作为参考
+    size_t size() const {
+        size_t head = head_.load(std::memory_order_acquire);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        return tail >= head ? tail - head : 0;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    bool full() const {
+        return size() >= capacity_;
+    }
+
+    size_t capacity() const {
+        return capacity_;
+    }
+
+private:
+    typedef typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type Slot;
+
+    T* slot(size_t index) {
+        return reinterpret_cast<T*>(&slots_[index & mask_]);
+    }
+
+    // 只读的成员
+    Slot* slots_ = nullptr;
+    size_t capacity_ = 0;
+    size_t mask_ = 0;
+
+    char pad0_[LAZY_CACHE_LINE_SIZE];
+
+    // 消费者修改的成员
+    std::atomic<size_t> head_;
+    size_t consumer_cached_tail_ = 0;
+
+    char pad1_[LAZY_CACHE_LINE_SIZE];
+
+    // 生产者修改的成员
+    std::atomic<size_t> tail_;
+    size_t producer_cached_head_ = 0;
+
+    char pad2_[LAZY_CACHE_LINE_SIZE];
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(SpscRingBuffer);
+};
+
+/*
+** SpscRingBuffer的阻塞版本，接口和DataQueue一样
+** 1、满了push_back阻塞，空了pop_front阻塞，stop之后都返回false
+** 2、只有对方真的挂起了才会加锁唤醒，两端都在忙的时候和SpscRingBuffer一样没有锁
+** 3、挂起之前的自旋策略可以通过set_wait_strategy设置
+*/
+template<class T>
+class BlockingSpscRingBuffer {
+public:
+    explicit BlockingSpscRingBuffer(size_t capacity)
+    : ring_(capacity), stop_(false), consumer_waiting_(false), producer_waiting_(false) {
+    }
+
+    ~BlockingSpscRingBuffer() {
+        stop();
+    }
+
+    bool start() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_.store(false, std::memory_order_release);
+        return true;
+    }
+
+    void stop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_.store(true, std::memory_order_release);
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+
+    void set_wait_strategy(WaitStrategy strategy, uint32_t max_spin_us = 50) {
+        spin_waiter_.set_strategy(strategy, max_spin_us);
+    }
+
+    bool push_back(const T& val) {
+        return emplace_back(val);
+    }
+
+    // 满了就等待，stop之后返回false
+    template<class... Args>
+    bool emplace_back(Args&&... args) {
+        spin_waiter_.on_arrival();
+
+        while(true){
+            if(stop_.load(std::memory_order_acquire)){
+                return false;
+            }
+
+            if(ring_.emplace(std::forward<Args>(args)...)){
+                wake(consumer_waiting_, not_empty_);
+                return true;
+            }
+
+            if(spin_waiter_.spin([&]{ return !ring_.full() || stop_.load(std::memory_order_relaxed); })){
+                continue;
+            }
+
+            park(producer_waiting_, not_full_, [&]{ return !ring_.full(); });
+        }
+    }
+
+    // 非阻塞，满了返回false
+    bool try_push(const T& val) {
+        if(stop_.load(std::memory_order_acquire) || !ring_.push(val)){
+            return false;
+        }
+
+        wake(consumer_waiting_, not_empty_);
+
+        return true;
+    }
+
+    // 空了就等待，stop之后返回false
+    bool pop_front(T& val) {
+        while(true){
+            if(stop_.load(std::memory_order_acquire)){
+                return false;
+            }
+
+            if(ring_.pop(val)){
+                wake(producer_waiting_, not_full_);
+                return true;
+            }
+
+            if(spin_waiter_.spin([&]{ return !ring_.empty() || stop_.load(std::memory_order_relaxed); })){
+                continue;
+            }
+
+            park(consumer_waiting_, not_empty_, [&]{ return !ring_.empty(); });
+        }
+    }
+
+    // 非阻塞，空了返回false
+    bool try_pop(T& val) {
+        if(!ring_.pop(val)){
+            return false;
+        }
+
+        wake(producer_waiting_, not_full_);
+
+        return true;
+    }
+
+    size_t size() const {
+        return ring_.size();
+    }
+
+    bool empty() const {
+        return ring_.empty();
+    }
+
+    size_t capacity() const {
+        return ring_.capacity();
+    }
+
+private:
+    // 对方修改了环形缓冲区之后调用，只有对方挂起了才加锁唤醒
+    void wake(std::atomic<bool>& waiting, std::condition_variable& cond) {
+        // 和park中的fence配对：要么这里看到waiting，要么park中看到数据
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if(waiting.load(std::memory_order_relaxed)){
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond.notify_one();
+        }
+    }
+
+    template<class Ready>
+    void park(std::atomic<bool>& waiting, std::condition_variable& cond, Ready ready) {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        waiting.store(true, std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        cond.wait(lock, [&]{
+            return ready() || stop_.load(std::memory_order_relaxed);
+        });
+
+        waiting.store(false, std::memory_order_relaxed);
+    }
+
+    SpscRingBuffer<T> ring_;
+
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+
+    std::atomic<bool> stop_;
+    std::atomic<bool> consumer_waiting_;
+    std::atomic<bool> producer_waiting_;
+
+    SpinWaiter spin_waiter_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(BlockingSpscRingBuffer);
+};
+
+}
+
+#endif /* __LAZY_RING_BUFFER_H__2024__ */
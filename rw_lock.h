@@ -0,0 +1,248 @@
+//
+//  rw_lock.h
+//
+
+#ifndef __LAZY_RW_LOCK_H__2024__
+#define __LAZY_RW_LOCK_H__2024__
+
+#include <stdint.h>
+#include <assert.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "lazy_base_common.h"
+
+#include "sync.h"
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace lazy {
+
+/*
+** 按CPU分散的计数器：每个CPU一个计数，各占一个缓存行
+** 1、修改只碰当前CPU的计数，不同CPU上的线程之间没有缓存行争抢
+** 2、线程可能在加和减之间换了CPU，单个计数会变成负数，只有总和有意义
+*/
+class PerCpuCounters {
+public:
+    /* slots: 计数的个数，为0时按CPU个数，向上取整到2的幂
+     */
+    explicit PerCpuCounters(uint32_t slots = 0) {
+        if(slots == 0){
+            slots = std::thread::hardware_concurrency();
+        }
+
+        // 向上取整到2的幂，取模变成与运算
+        uint32_t count = 1;
+        while(count < slots){
+            count <<= 1;
+        }
+
+        // 多分配一个缓存行，用来对齐
+        buffer_.reset(new std::atomic<int64_t>[(count + 1) * kStride]);
+
+        uintptr_t addr = (uintptr_t)buffer_.get();
+        uintptr_t aligned = (addr + LAZY_CACHE_LINE_SIZE - 1) & ~(uintptr_t)(LAZY_CACHE_LINE_SIZE - 1);
+        counters_ = buffer_.get() + (aligned - addr) / sizeof(std::atomic<int64_t>);
+
+        for(uint32_t i = 0; i < count; ++i){
+            at(i).store(0, std::memory_order_relaxed);
+        }
+
+        slot_mask_ = count - 1;
+    }
+
+    uint32_t slots() const {
+        return slot_mask_ + 1;
+    }
+
+    // 当前线程所在CPU对应的计数
+    uint32_t current_slot() const {
+#if defined(__linux__)
+        // glibc 2.35之后由rseq提供，只是读一次线程局部变量
+        int cpu = sched_getcpu();
+        if(cpu >= 0){
+            return (uint32_t)cpu & slot_mask_;
+        }
+#endif
+        // 拿不到CPU编号时，按线程轮流分配
+        static std::atomic<uint32_t> next_slot(0);
+        static thread_local uint32_t slot = next_slot.fetch_add(1, std::memory_order_relaxed);
+
+        return slot & slot_mask_;
+    }
+
+    std::atomic<int64_t>& at(uint32_t slot) {
+        return counters_[slot * kStride];
+    }
+
+    // 所有计数的和，逐个读取，不是一个原子的快照
+    int64_t sum() {
+        int64_t sum = 0;
+
+        for(uint32_t i = 0; i <= slot_mask_; ++i){
+            sum += at(i).load();
+        }
+
+        return sum;
+    }
+
+private:
+    // 每个计数独占一个缓存行
+    static const size_t kStride = LAZY_CACHE_LINE_SIZE / sizeof(std::atomic<int64_t>);
+
+    std::unique_ptr<std::atomic<int64_t>[]> buffer_;
+    std::atomic<int64_t>* counters_;
+    uint32_t slot_mask_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(PerCpuCounters);
+};
+
+/*
+** 偏向读者的读写锁：读者计数按CPU分散到不同的缓存行
+** 1、普通的读写锁（包括pthread_rwlock）所有读者都要修改同一个计数，线程多了之后这个缓存行在CPU之间来回传递，读也不能并行扩展
+** 2、这里每个CPU一个读者计数，读者加锁/解锁只修改自己所在CPU的计数，不和其他CPU上的读者争抢
+** 3、写者先设置写标志，之后新来的读者退回去等待写者（写者优先，不会被源源不断的读者饿死），
+**    然后等待所有计数的和变成0，也就是已经进入的读者全部离开
+** 4、读者解锁时可能已经换了CPU，加在一个计数上、减在另一个计数上，单个计数会变成负数，但是总和仍然正确
+** 5、写锁的开销和CPU个数成正比，只适合读远多于写的场景（路由表、配置等）
+** 6、不可重入，读锁也不能升级成写锁
+*/
+class PerCpuRWLock {
+public:
+    /* slots: 读者计数的个数，为0时按CPU个数
+     */
+    explicit PerCpuRWLock(uint32_t slots = 0) : readers_(slots), writer_(0), drain_seq_(0) {
+    }
+
+    void lock_shared() {
+        while(!try_lock_shared()){
+            // 等写者释放
+            writer_waiter_.wait(writer_, [](uint32_t value){ return value == 0; }, nullptr);
+        }
+    }
+
+    // 有写者持有或者等待时返回false
+    bool try_lock_shared() {
+        std::atomic<int64_t>& c = readers_.at(readers_.current_slot());
+
+        // 和写者配对（都是seq_cst）：要么写者求和时看到这次加一，要么这里看到写标志
+        c.fetch_add(1);
+
+        if(writer_.load() == 0){
+            return true;
+        }
+
+        // 退回去，写者可能正在等这个计数
+        c.fetch_sub(1);
+        notify_writer();
+
+        return false;
+    }
+
+    void unlock_shared() {
+        readers_.at(readers_.current_slot()).fetch_sub(1);
+
+        if(writer_.load() != 0){
+            notify_writer();
+        }
+    }
+
+    void lock() {
+        // 写者之间互斥
+        writer_waiter_.wait(writer_, [this](uint32_t value){
+            return value == 0 && writer_.compare_exchange_strong(value, 1);
+        }, nullptr);
+
+        // 等已经进入的读者全部离开；每次读者离开都会修改drain_seq_，先读drain_seq_再求和，不会丢失唤醒
+        drain_waiter_.wait(drain_seq_, [this](uint32_t){ return readers() == 0; }, nullptr);
+    }
+
+    bool try_lock() {
+        uint32_t expected = 0;
+
+        if(!writer_.compare_exchange_strong(expected, 1)){
+            return false;
+        }
+
+        if(readers() == 0){
+            return true;
+        }
+
+        unlock();
+        return false;
+    }
+
+    void unlock() {
+        writer_.store(0);
+
+        writer_waiter_.wake_all(writer_);
+    }
+
+    // 写者等待读者离开时，先自旋再挂起，见WaitStrategy
+    void set_wait_strategy(WaitStrategy strategy, uint32_t max_spin_us = 50) {
+        drain_waiter_.set_wait_strategy(strategy, max_spin_us);
+        writer_waiter_.set_wait_strategy(strategy, max_spin_us);
+    }
+
+    uint32_t slots() const {
+        return readers_.slots();
+    }
+
+private:
+    // 读者的个数，只有写者设置了写标志之后才是准确的
+    int64_t readers() {
+        int64_t sum = readers_.sum();
+
+        assert(sum >= 0);
+
+        return sum;
+    }
+
+    void notify_writer() {
+        drain_seq_.fetch_add(1);
+
+        drain_waiter_.wake_all(drain_seq_);
+    }
+
+    PerCpuCounters readers_;
+
+    // 读者每次都要读，写者很少修改，和读者计数不在同一个缓存行
+    char pad0_[LAZY_CACHE_LINE_SIZE];
+
+    // 1: 有写者持有或者正在等待读者离开
+    std::atomic<uint32_t> writer_;
+    FutexWaiter writer_waiter_;
+
+    char pad1_[LAZY_CACHE_LINE_SIZE];
+
+    // 写者等待期间读者离开时加一
+    std::atomic<uint32_t> drain_seq_;
+    FutexWaiter drain_waiter_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(PerCpuRWLock);
+};
+
+// 读锁的RAII，写锁直接用std::unique_lock
+class ReadLockGuard {
+public:
+    explicit ReadLockGuard(PerCpuRWLock& lock) : lock_(lock) {
+        lock_.lock_shared();
+    }
+
+    ~ReadLockGuard() {
+        lock_.unlock_shared();
+    }
+
+private:
+    PerCpuRWLock& lock_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(ReadLockGuard);
+};
+
+}
+
+#endif /* __LAZY_RW_LOCK_H__2024__ */
@@ -0,0 +1,213 @@
+//
+//  segment_queue.h
+//
+
+#ifndef __LAZY_SEGMENT_QUEUE_H__2024__
+#define __LAZY_SEGMENT_QUEUE_H__2024__
+
+#include <stdint.h>
+#include <assert.h>
+#include <new>
+#include <atomic>
+#include <utility>
+#include <type_traits>
+
+#include "lazy_base_common.h"
+
+namespace lazy {
+
+/*
+** 分段的先进先出队列，可以作为DataQueue的底层容器：DataQueue<T, SegmentQueue<T>>
+** 1、元素存放在固定大小的段（每段SegmentSize个元素）组成的单链表中，从尾部写入，从头部取出
+** 2、头部的段取空之后不释放，放进队列自己的空闲池，尾部需要新段时优先从空闲池中取，
+**    队列深度稳定时不会再分配/释放内存（std::deque会随着队列在空和非空之间来回变化不停地分配/释放）
+** 3、空闲池最多保留max_free_segments个段，多出来的才释放，避免一次突发之后一直占着内存
+** 4、不是线程安全的，需要外部加锁
+*/
+template<class T, size_t SegmentSize = 64>
+class SegmentQueue {
+public:
+    explicit SegmentQueue(size_t max_free_segments = 16) : max_free_segments_(max_free_segments) {
+        static_assert(SegmentSize > 0, "SegmentSize must be positive");
+    }
+
+    ~SegmentQueue() {
+        clear();
+
+        // clear之后最多剩下一个段
+        release(head_);
+
+        while(free_list_){
+            Segment* next = free_list_->next;
+            release(free_list_);
+            free_list_ = next;
+        }
+    }
+
+    void push_back(const T& val) {
+        emplace_back(val);
+    }
+
+    void push_back(T&& val) {
+        emplace_back(std::move(val));
+    }
+
+    template<class... Args>
+    void emplace_back(Args&&... args) {
+        if(tail_ == nullptr || tail_index_ == SegmentSize){
+            Segment* segment = acquire();
+
+            if(tail_){
+                tail_->next = segment;
+            }
+            else {
+                head_ = segment;
+                head_index_ = 0;
+            }
+
+            tail_ = segment;
+            tail_index_ = 0;
+        }
+
+        new (tail_->slot(tail_index_)) T(std::forward<Args>(args)...);
+
+        ++tail_index_;
+        ++size_;
+    }
+
+    T& front() {
+        assert(size_ > 0);
+        return *head_->slot(head_index_);
+    }
+
+    const T& front() const {
+        assert(size_ > 0);
+        return *head_->slot(head_index_);
+    }
+
+    void pop_front() {
+        assert(size_ > 0);
+
+        head_->slot(head_index_)->~T();
+
+        ++head_index_;
+        --size_;
+
+        if(size_ == 0){
+            // 只剩下一个段，原地复用
+            assert(head_ == tail_);
+            head_index_ = 0;
+            tail_index_ = 0;
+        }
+        else if(head_index_ == SegmentSize){
+            Segment* segment = head_;
+            head_ = head_->next;
+            head_index_ = 0;
+
+            recycle(segment);
+        }
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    void clear() {
+        while(size_ > 0){
+            pop_front();
+        }
+    }
+
+    // O(1)，连同空闲池一起交换
+    void swap(SegmentQueue& other) {
+        std::swap(head_, other.head_);
+        std::swap(tail_, other.tail_);
+        std::swap(head_index_, other.head_index_);
+        std::swap(tail_index_, other.tail_index_);
+        std::swap(size_, other.size_);
+        std::swap(free_list_, other.free_list_);
+        std::swap(free_count_, other.free_count_);
+        std::swap(max_free_segments_, other.max_free_segments_);
+    }
+
+    // 空闲池中的段数
+    size_t free_segments() const {
+        return free_count_;
+    }
+
+    // 进程内所有SegmentQueue<T, SegmentSize>累计分配的段数，用于观察稳定状态下是否还在分配内存
+    static uint64_t total_segment_allocations() {
+        return allocation_counter().load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Segment {
+        typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type slots[SegmentSize];
+        Segment* next = nullptr;
+
+        T* slot(size_t index) {
+            return reinterpret_cast<T*>(&slots[index]);
+        }
+    };
+
+    static std::atomic<uint64_t>& allocation_counter() {
+        static std::atomic<uint64_t> counter(0);
+        return counter;
+    }
+
+    Segment* acquire() {
+        if(free_list_){
+            Segment* segment = free_list_;
+            free_list_ = segment->next;
+            --free_count_;
+
+            segment->next = nullptr;
+            return segment;
+        }
+
+        allocation_counter().fetch_add(1, std::memory_order_relaxed);
+
+        return new Segment;
+    }
+
+    void recycle(Segment* segment) {
+        if(free_count_ >= max_free_segments_){
+            release(segment);
+            return;
+        }
+
+        segment->next = free_list_;
+        free_list_ = segment;
+        ++free_count_;
+    }
+
+    static void release(Segment* segment) {
+        delete segment;
+    }
+
+    Segment* head_ = nullptr;
+    Segment* tail_ = nullptr;
+
+    // 头部的段中第一个元素的位置
+    size_t head_index_ = 0;
+
+    // 尾部的段中下一个写入的位置
+    size_t tail_index_ = 0;
+
+    size_t size_ = 0;
+
+    // 空闲池
+    Segment* free_list_ = nullptr;
+    size_t free_count_ = 0;
+    size_t max_free_segments_ = 0;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(SegmentQueue);
+};
+
+}
+
+#endif /* __LAZY_SEGMENT_QUEUE_H__2024__ */
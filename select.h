@@ -0,0 +1,185 @@
+//
+//  select.h
+//
+
+#ifndef __LAZY_SELECT_H__2024__
+#define __LAZY_SELECT_H__2024__
+
+#include <stdint.h>
+#include <vector>
+#include <chrono>
+#include <functional>
+
+#include "lazy_base_common.h"
+
+#include "notifier.h"
+#include "data_queue.h"
+#include "event.h"
+
+namespace lazy {
+
+/*
+** 同时等待多个DataQueue和Event，类似select/epoll
+** 用法：
+**   Selector selector;
+**   int q = selector.add(data_queue);
+**   int e = selector.add(event);
+**   while(true){
+**       int index = selector.wait();
+**       if(index == q){ data_queue.try_pop(val); ... }
+**       else if(index == e){ event.wait(); ... }
+**   }
+** 1、DataQueue中有数据，或者已经stop，就算就绪；Event被wake_up之后（还没有被wait）就算就绪
+** 2、wait只返回哪个数据源就绪了，不取数据，数据由调用者自己取（多个消费者时可能已经被别人取走了，要用try_xxx）
+** 3、多个数据源同时就绪时轮流返回，避免一个繁忙的数据源饿死其他的
+** 4、stop了的DataQueue会一直就绪，调用者发现pop失败之后应该remove掉
+** 5、数据源必须在Selector之前remove或者比Selector活得久；Selector本身只能在一个线程中使用
+*/
+class Selector {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    Selector() {
+    }
+
+    ~Selector() {
+        for(size_t i = 0; i < sources_.size(); ++i){
+            remove((int)i);
+        }
+    }
+
+    // 返回数据源的编号，wait返回的就是这个编号
+    template<class T, class Container>
+    int add(DataQueue<T, Container>& queue) {
+        DataQueue<T, Container>* q = &queue;
+
+        Source source;
+        source.ready = [q]{
+            return q->readable();
+        };
+        source.detach = [q](Notifier* notifier){
+            q->detach_notifier(notifier);
+        };
+
+        queue.attach_notifier(&notifier_);
+
+        return add_source(source);
+    }
+
+    int add(Event& event) {
+        Event* e = &event;
+
+        Source source;
+        source.ready = [e]{
+            return e->is_set();
+        };
+        source.detach = [e](Notifier* notifier){
+            e->detach_notifier(notifier);
+        };
+
+        event.attach_notifier(&notifier_);
+
+        return add_source(source);
+    }
+
+    // 不再等待这个数据源，编号不会被复用
+    void remove(int index) {
+        if(index < 0 || index >= (int)sources_.size() || !sources_[index].ready){
+            return;
+        }
+
+        sources_[index].detach(&notifier_);
+        sources_[index] = Source();
+    }
+
+    // 等待任意一个数据源就绪，返回它的编号；没有数据源时返回-1
+    int wait() {
+        return wait_impl(nullptr);
+    }
+
+    // 不等待，没有就绪的数据源时返回-1
+    int poll() {
+        return find_ready();
+    }
+
+    // 最多等待timeout，超时返回-1
+    template<class Rep, class Period>
+    int wait_for(const std::chrono::duration<Rep, Period>& timeout) {
+        Clock::time_point deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(timeout);
+        return wait_impl(&deadline);
+    }
+
+    int wait_until(const Clock::time_point& deadline) {
+        return wait_impl(&deadline);
+    }
+
+private:
+    struct Source {
+        std::function<bool()> ready;
+        std::function<void(Notifier*)> detach;
+    };
+
+    int add_source(const Source& source) {
+        sources_.push_back(source);
+        return (int)sources_.size() - 1;
+    }
+
+    int wait_impl(const Clock::time_point* deadline) {
+        while(true){
+            // 先读计数再检查，检查之后的变化会让wait立即返回
+            uint64_t epoch = notifier_.epoch();
+
+            int index = find_ready();
+            if(index >= 0){
+                return index;
+            }
+
+            if(!has_sources()){
+                return -1;
+            }
+
+            if(!notifier_.wait(epoch, deadline)){
+                return find_ready();
+            }
+        }
+    }
+
+    // 从上次返回的下一个开始找，轮流返回
+    int find_ready() {
+        size_t n = sources_.size();
+
+        for(size_t i = 0; i < n; ++i){
+            size_t index = (next_ + i) % n;
+
+            if(sources_[index].ready && sources_[index].ready()){
+                next_ = index + 1;
+                return (int)index;
+            }
+        }
+
+        return -1;
+    }
+
+    bool has_sources() const {
+        for(const Source& source : sources_){
+            if(source.ready){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Notifier notifier_;
+
+    // remove之后的位置留空
+    std::vector<Source> sources_;
+
+    // 下一次从哪个数据源开始检查
+    size_t next_ = 0;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(Selector);
+};
+
+}
+
+#endif /* __LAZY_SELECT_H__2024__ */
@@ -0,0 +1,153 @@
+//
+//  seqlock.h
+//
+
+#ifndef __LAZY_SEQLOCK_H__2024__
+#define __LAZY_SEQLOCK_H__2024__
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+#include "lazy_base_common.h"
+
+namespace lazy {
+
+/*
+** 顺序锁：保护一个小的POD数据，适合读多写少、读的一方只需要一份一致快照的场景
+** 1、写的一方把序号加一（变成奇数），写数据，再把序号加一（变成偶数），写者之间用互斥锁串行
+** 2、读的一方不写任何共享变量：读序号、拷贝数据、再读序号，两次序号相同并且是偶数，拷贝的就是一致的快照，否则重读
+** 3、读者之间、读者和写者之间都没有缓存行的争抢，读的吞吐随线程数线性增长；代价是写得频繁时读者会反复重试
+** 4、数据按8字节分成原子变量，用relaxed读写，读者和写者并发时没有数据竞争（不是未定义行为）
+** 5、T必须是可以按位拷贝的类型，并且应该比较小（几十个字节），大的数据用读写锁
+*/
+template<class T>
+class SeqLock {
+public:
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock only supports trivially copyable types");
+
+    explicit SeqLock(const T& value = T()) : seq_(0) {
+        write_words(value);
+    }
+
+    // 读一份一致的快照，和写者冲突时重试
+    T load() const {
+        T value;
+
+        for(uint32_t i = 1; !try_load(value); ++i){
+            // 写者可能在临界区内被切走，重试太多次就让出CPU
+            if((i & 127) == 0){
+                std::this_thread::yield();
+            }
+            else {
+                LAZY_CPU_RELAX();
+            }
+        }
+
+        return value;
+    }
+
+    // 只读一次，和写者冲突时返回false，value的内容不确定
+    bool try_load(T& value) const {
+        uint32_t seq1 = seq_.load(std::memory_order_acquire);
+
+        if(seq1 & 1){
+            return false;
+        }
+
+        uint64_t words[kWords];
+        for(size_t i = 0; i < kWords; ++i){
+            words[i] = words_[i].load(std::memory_order_relaxed);
+        }
+
+        // 数据的读取不能排到第二次读序号之后
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if(seq_.load(std::memory_order_relaxed) != seq1){
+            return false;
+        }
+
+        memcpy(&value, words, sizeof(T));
+
+        return true;
+    }
+
+    void store(const T& value) {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        begin_write();
+        write_words(value);
+        end_write();
+    }
+
+    // 在写锁内修改：f(T&)，读者看到的是修改之前或者之后的完整数据
+    template<class F>
+    void update(F f) {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        T value = load_locked();
+        f(value);
+
+        begin_write();
+        write_words(value);
+        end_write();
+    }
+
+    // 当前的序号，每次写加2
+    uint32_t sequence() const {
+        return seq_.load(std::memory_order_acquire);
+    }
+
+private:
+    static const size_t kWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    void begin_write() {
+        uint32_t seq = seq_.load(std::memory_order_relaxed);
+
+        seq_.store(seq + 1, std::memory_order_relaxed);
+
+        // 数据的写入不能排到序号变成奇数之前
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void end_write() {
+        seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    void write_words(const T& value) {
+        uint64_t words[kWords] = {0};
+        memcpy(words, &value, sizeof(T));
+
+        for(size_t i = 0; i < kWords; ++i){
+            words_[i].store(words[i], std::memory_order_relaxed);
+        }
+    }
+
+    // 持有写锁时数据不会变化，直接读
+    T load_locked() const {
+        uint64_t words[kWords];
+        for(size_t i = 0; i < kWords; ++i){
+            words[i] = words_[i].load(std::memory_order_relaxed);
+        }
+
+        T value;
+        memcpy(&value, words, sizeof(T));
+        return value;
+    }
+
+    // 读者只读这两个成员，放在一起
+    std::atomic<uint32_t> seq_;
+    std::atomic<uint64_t> words_[kWords];
+
+    // 写者之间互斥
+    std::mutex mutex_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(SeqLock);
+};
+
+}
+
+#endif /* __LAZY_SEQLOCK_H__2024__ */
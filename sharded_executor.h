@@ -0,0 +1,354 @@
+//
+//  sharded_executor.h
+//
+
+#ifndef __LAZY_SHARDED_EXECUTOR_H__2024__
+#define __LAZY_SHARDED_EXECUTOR_H__2024__
+
+#include <stdint.h>
+#include <assert.h>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+#include "lazy_base_common.h"
+
+#include "task_queue.h"
+
+namespace lazy {
+
+/*
+** 按key分片的执行器
+** 1、内部有N个TaskQueue，同一个key的任务总是投递到同一个TaskQueue（同一个线程）执行，
+**    因此每个key对应的状态只会被一个线程访问，不需要加锁，缓存也更友好
+** 2、路由使用一致性哈希，每个分片在环上有若干个虚拟节点，
+**    分片数变化（比如重启后调整了线程数）时只有大约1/N的key会换分片
+** 3、每个分片单独统计投递/执行的任务数，并采样统计热点key（Space-Saving算法），
+**    统计只用分片自己的锁，不存在全局锁
+*/
+template<class Key, class Hash = std::hash<Key>>
+class ShardedExecutor {
+public:
+    struct HotKey {
+        Key key;
+
+        // 估算的投递次数（已经乘上了采样率）
+        uint64_t count = 0;
+    };
+
+    struct ShardStats {
+        size_t shard = 0;
+
+        // 投递到该分片的任务数
+        uint64_t posted = 0;
+
+        // 已经执行完的任务数
+        uint64_t executed = 0;
+
+        // 还在队列中等待执行的任务数
+        uint64_t pending = 0;
+
+        // 热点统计窗口内（上次reset_hot_keys之后）投递到该分片的任务数
+        uint64_t hot_key_window = 0;
+
+        // 该分片上最热的key，按count从大到小排列
+        std::vector<HotKey> hot_keys;
+    };
+
+    /* shard_num: 分片（线程）数
+     * virtual_nodes: 每个分片在哈希环上的虚拟节点数，越多分布越均匀
+     * name: 线程名的前缀，第i个分片的名字为 name_i
+     */
+    explicit ShardedExecutor(size_t shard_num, size_t virtual_nodes = 64, const std::string& name = "shard") {
+        assert(shard_num > 0 && virtual_nodes > 0);
+
+        for(size_t i = 0; i < shard_num; ++i){
+            std::unique_ptr<Shard> shard(new Shard());
+            shard->queue.set_name(name + "_" + std::to_string(i));
+            shards_.push_back(std::move(shard));
+
+            for(size_t j = 0; j < virtual_nodes; ++j){
+                // 虚拟节点和key的哈希值不能落在同一个区间（比如都是小整数），所以这里混淆两次
+                uint64_t h = mix(mix(i + 1) + j);
+                ring_.push_back(std::make_pair(h, static_cast<uint32_t>(i)));
+            }
+        }
+
+        std::sort(ring_.begin(), ring_.end());
+    }
+
+    ~ShardedExecutor() {
+    }
+
+    void start() {
+        for(auto& shard : shards_){
+            shard->queue.start();
+        }
+    }
+
+    void stop() {
+        for(auto& shard : shards_){
+            shard->queue.stop();
+        }
+    }
+
+    size_t shard_num() const {
+        return shards_.size();
+    }
+
+    // key所在的分片，对于同一个key，返回值永远不变
+    size_t shard_of(const Key& key) const {
+        uint64_t h = mix(static_cast<uint64_t>(hash_(key)));
+
+        auto it = std::lower_bound(ring_.begin(), ring_.end(), std::make_pair(h, static_cast<uint32_t>(0)));
+
+        if(it == ring_.end()){
+            it = ring_.begin();
+        }
+
+        return it->second;
+    }
+
+    // key所在分片的任务队列，可以用来判断is_current，或者投递定时器
+    TaskQueue& queue_of(const Key& key) {
+        return shards_[shard_of(key)]->queue;
+    }
+
+    // 添加异步任务，同一个key的任务按投递的顺序执行
+    template <class Closure>
+    void post(const Key& key, Closure&& closure) {
+        Shard* shard = route(key);
+        shard->queue.post(CountedClosure<Closure>(std::forward<Closure>(closure), &shard->executed));
+    }
+
+    // 添加带延迟的异步任务
+    template <class Closure>
+    void post_delayed(const Key& key, Closure&& closure, uint32_t delay_ms) {
+        Shard* shard = route(key);
+        shard->queue.post_delayed(CountedClosure<Closure>(std::forward<Closure>(closure), &shard->executed), delay_ms);
+    }
+
+    // 在key所在的分片上执行同步任务
+    template <class ReturnT, class Closure>
+    ReturnT invoke(const Key& key, Closure&& closure) {
+        Shard* shard = route(key);
+
+        if(shard->queue.is_current()){
+            shard->executed.fetch_add(1, std::memory_order_relaxed);
+            return closure();
+        }
+
+        return shard->queue.template invoke<ReturnT>(CountedClosure<Closure>(std::forward<Closure>(closure), &shard->executed));
+    }
+
+    /* 设置热点key的统计参数
+     * sample_rate: 每sample_rate次投递采样一次，等于1表示每次都统计
+     * capacity: 每个分片最多跟踪的key的个数
+     */
+    void set_hot_key_tracking(uint32_t sample_rate, size_t capacity) {
+        if(sample_rate == 0 || capacity == 0){
+            return;
+        }
+
+        for(auto& shard : shards_){
+            std::unique_lock<std::mutex> lock(shard->mutex);
+            shard->sample_rate.store(sample_rate, std::memory_order_relaxed);
+            shard->capacity = capacity;
+            shard->counters.clear();
+            shard->window_start = shard->posted.load(std::memory_order_relaxed);
+        }
+    }
+
+    ShardStats stats(size_t index) const {
+        ShardStats st;
+
+        if(index >= shards_.size()){
+            return st;
+        }
+
+        const Shard* shard = shards_[index].get();
+
+        st.shard = index;
+
+        // 先读executed再读posted，保证pending不会小于0
+        st.executed = shard->executed.load(std::memory_order_acquire);
+        st.posted = shard->posted.load(std::memory_order_acquire);
+        st.pending = st.posted > st.executed ? st.posted - st.executed : 0;
+
+        {
+            std::unique_lock<std::mutex> lock(shard->mutex);
+            st.hot_key_window = st.posted > shard->window_start ? st.posted - shard->window_start : 0;
+            st.hot_keys = shard->counters;
+            for(auto& hk : st.hot_keys){
+                hk.count *= shard->sample_rate.load(std::memory_order_relaxed);
+            }
+        }
+
+        std::sort(st.hot_keys.begin(), st.hot_keys.end(), [](const HotKey& a, const HotKey& b){
+            return a.count > b.count;
+        });
+
+        return st;
+    }
+
+    std::vector<ShardStats> stats() const {
+        std::vector<ShardStats> all;
+        for(size_t i = 0; i < shards_.size(); ++i){
+            all.push_back(stats(i));
+        }
+        return all;
+    }
+
+    /* 热点key检测
+     * 返回投递次数超过所在分片投递总数ratio倍的key，按count从大到小排列
+     * 投递总数和key的计数一样，从上次reset_hot_keys开始算
+     * 例如ratio等于0.2表示一个key占了所在分片20%以上的任务
+     */
+    std::vector<HotKey> hot_keys(double ratio) const {
+        std::vector<HotKey> result;
+
+        for(size_t i = 0; i < shards_.size(); ++i){
+            ShardStats st = stats(i);
+
+            for(auto& hk : st.hot_keys){
+                if(st.hot_key_window > 0 && hk.count >= ratio * st.hot_key_window){
+                    result.push_back(hk);
+                }
+            }
+        }
+
+        std::sort(result.begin(), result.end(), [](const HotKey& a, const HotKey& b){
+            return a.count > b.count;
+        });
+
+        return result;
+    }
+
+    // 清空统计信息（不影响正在排队的任务的pending统计）
+    void reset_hot_keys() {
+        for(auto& shard : shards_){
+            std::unique_lock<std::mutex> lock(shard->mutex);
+            shard->counters.clear();
+            shard->window_start = shard->posted.load(std::memory_order_relaxed);
+        }
+    }
+
+private:
+    struct Shard {
+        std::atomic<uint64_t> posted;
+        std::atomic<uint64_t> executed;
+
+        std::atomic<uint32_t> sample_rate;
+
+        // 下面的成员由mutex保护
+        mutable std::mutex mutex;
+        size_t capacity = 16;
+        std::vector<HotKey> counters;
+        // 上次清空统计时的posted，热点占比的分母是这之后的投递数
+        uint64_t window_start = 0;
+
+        // TaskQueue析构时会执行完队列中剩余的任务，这些任务还会修改executed，
+        // 所以queue要放在最后，保证最先析构
+        TaskQueue queue;
+
+        Shard() : posted(0), executed(0), sample_rate(16) {}
+    };
+
+    // 执行结束之后增加计数的闭包
+    template <class Closure>
+    class CountedClosure {
+    public:
+        typedef typename std::decay<Closure>::type ClosureType;
+
+        CountedClosure(Closure&& closure, std::atomic<uint64_t>* counter)
+        : closure_(std::forward<Closure>(closure)), counter_(counter) {}
+
+        auto operator()() -> decltype(std::declval<ClosureType&>()()) {
+            Finisher finisher(counter_);
+            return closure_();
+        }
+
+    private:
+        struct Finisher {
+            explicit Finisher(std::atomic<uint64_t>* c) : counter(c) {}
+            ~Finisher() { counter->fetch_add(1, std::memory_order_release); }
+            std::atomic<uint64_t>* counter;
+        };
+
+        ClosureType closure_;
+        std::atomic<uint64_t>* counter_;
+    };
+
+    Shard* route(const Key& key) {
+        Shard* shard = shards_[shard_of(key)].get();
+
+        uint64_t seq = shard->posted.fetch_add(1, std::memory_order_relaxed);
+
+        if(seq % shard->sample_rate.load(std::memory_order_relaxed) == 0){
+            sample(shard, key);
+        }
+
+        return shard;
+    }
+
+    // Space-Saving算法：计数器满了之后，替换掉计数最小的key，并继承它的计数
+    void sample(Shard* shard, const Key& key) {
+        std::unique_lock<std::mutex> lock(shard->mutex);
+
+        auto& counters = shard->counters;
+
+        size_t min_index = 0;
+
+        for(size_t i = 0; i < counters.size(); ++i){
+            if(counters[i].key == key){
+                ++counters[i].count;
+                return;
+            }
+
+            if(counters[i].count < counters[min_index].count){
+                min_index = i;
+            }
+        }
+
+        if(counters.size() < shard->capacity){
+            HotKey hk;
+            hk.key = key;
+            hk.count = 1;
+            counters.push_back(hk);
+            return;
+        }
+
+        counters[min_index].key = key;
+        ++counters[min_index].count;
+    }
+
+    // splitmix64，std::hash对整数是恒等映射，需要打散
+    static uint64_t mix(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ULL;
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    }
+
+    Hash hash_;
+
+    // 哈希环，构造之后不再修改，读的时候不需要加锁
+    std::vector<std::pair<uint64_t, uint32_t>> ring_;
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(ShardedExecutor);
+};
+
+}
+
+#endif /* __LAZY_SHARDED_EXECUTOR_H__2024__ */
@@ -0,0 +1,491 @@
+//
+//  shm_queue.h
+//
+
+#ifndef __LAZY_SHM_QUEUE_H__2024__
+#define __LAZY_SHM_QUEUE_H__2024__
+
+#if defined(__linux__)
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <type_traits>
+
+#include "lazy_base_common.h"
+
+#include "futex.h"
+#include "wait_strategy.h"
+
+namespace lazy {
+
+/*
+** 进程间的有界队列，放在shm_open/mmap的共享内存中（仅Linux），接口和DataQueue一样
+** 用法：
+**   // 一个进程创建
+**   ShmQueue<Msg> queue;
+**   queue.create("/my_queue", 1024);
+**   // 另一个进程打开同一个名字
+**   ShmQueue<Msg> queue;
+**   queue.open("/my_queue");
+** 1、T必须是可以直接拷贝内存的类型（不能有指针指向进程自己的内存），元素直接拷贝到共享内存中
+** 2、环形缓冲区用Vyukov的算法（和MpmcQueue一样），单生产者/多生产者、单消费者/多消费者都不需要锁
+** 3、满了/空了需要等待时用futex挂起在共享内存中的字上，对方只有在有人挂起时才调用futex唤醒，
+**    两端都在忙的时候push/pop没有系统调用
+** 4、stop是队列的状态，保存在共享内存中，任何一端调用都会让两端的等待返回
+** 5、某个进程在写入/读取的中途崩溃，那个槽位会一直处于未完成的状态，队列需要重建
+*/
+template<class T>
+class ShmQueue {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    ShmQueue() {
+        static_assert(std::is_trivially_copyable<T>::value, "ShmQueue only supports trivially copyable types");
+        static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+                      "ShmQueue needs address-free atomics");
+    }
+
+    ~ShmQueue() {
+        close();
+    }
+
+    /* 创建共享内存并初始化队列
+     * name: 共享内存的名字，以'/'开头，比如"/my_queue"
+     * capacity: 能容纳的元素个数，向上取整到2的幂
+     * 同名的共享内存已经存在时返回false，残留的旧队列需要先unlink
+     */
+    bool create(const std::string& name, size_t capacity) {
+        close();
+
+        uint64_t cap = 2;
+        while(cap < capacity){
+            cap <<= 1;
+        }
+
+        size_t size = mapping_size(cap);
+
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if(fd < 0){
+            return false;
+        }
+
+        if(ftruncate(fd, (off_t)size) != 0 || !map(fd, size)){
+            ::close(fd);
+            shm_unlink(name.c_str());
+            return false;
+        }
+
+        ::close(fd);
+
+        header_ = new (base_) Header();
+        header_->capacity = cap;
+        header_->element_size = sizeof(T);
+
+        cells_ = reinterpret_cast<Cell*>(static_cast<char*>(base_) + cells_offset());
+        for(uint64_t i = 0; i < cap; ++i){
+            Cell* cell = new (&cells_[i]) Cell();
+            cell->sequence.store(i, std::memory_order_relaxed);
+        }
+
+        mask_ = cap - 1;
+
+        // 最后写入magic，打开的一方看到magic就说明初始化完成了
+        header_->magic.store(kMagic, std::memory_order_release);
+
+        return true;
+    }
+
+    // 打开其他进程创建的队列，不存在、还没有初始化完成或者元素类型的大小不一致时返回false
+    bool open(const std::string& name) {
+        close();
+
+        int fd = shm_open(name.c_str(), O_RDWR, 0600);
+        if(fd < 0){
+            return false;
+        }
+
+        struct stat st;
+        if(fstat(fd, &st) != 0 || (size_t)st.st_size < cells_offset() || !map(fd, (size_t)st.st_size)){
+            ::close(fd);
+            return false;
+        }
+
+        ::close(fd);
+
+        header_ = reinterpret_cast<Header*>(base_);
+
+        if(header_->magic.load(std::memory_order_acquire) != kMagic
+           || header_->element_size != sizeof(T)
+           || mapping_size(header_->capacity) != size_){
+            close();
+            return false;
+        }
+
+        cells_ = reinterpret_cast<Cell*>(static_cast<char*>(base_) + cells_offset());
+        mask_ = header_->capacity - 1;
+
+        return true;
+    }
+
+    // 解除映射，不删除共享内存，其他进程可以继续使用
+    void close() {
+        if(base_){
+            munmap(base_, size_);
+        }
+
+        base_ = nullptr;
+        size_ = 0;
+        header_ = nullptr;
+        cells_ = nullptr;
+        mask_ = 0;
+    }
+
+    // 删除共享内存的名字，已经打开的进程不受影响，都close之后内存才释放
+    static bool unlink(const std::string& name) {
+        return shm_unlink(name.c_str()) == 0;
+    }
+
+    bool is_open() const {
+        return header_ != nullptr;
+    }
+
+    bool start() {
+        header_->stop.store(0, std::memory_order_release);
+        return true;
+    }
+
+    // 两端的等待都会返回
+    void stop() {
+        header_->stop.store(1, std::memory_order_release);
+
+        wake_all(header_->not_empty);
+        wake_all(header_->not_full);
+    }
+
+    bool stopped() const {
+        return header_->stop.load(std::memory_order_acquire) != 0;
+    }
+
+    // 只影响本进程中的等待：挂起之前先自旋一会
+    void set_wait_strategy(WaitStrategy strategy, uint32_t max_spin_us = 50) {
+        spin_waiter_.set_strategy(strategy, max_spin_us);
+    }
+
+    // 满了就等待，stop之后返回false
+    bool push_back(const T& val) {
+        return push_impl(val, true, nullptr);
+    }
+
+    // 非阻塞，满了返回false
+    bool try_push(const T& val) {
+        return push_impl(val, false, nullptr);
+    }
+
+    template<class Rep, class Period>
+    bool push_back_for(const T& val, const std::chrono::duration<Rep, Period>& timeout) {
+        Clock::time_point deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(timeout);
+        return push_impl(val, true, &deadline);
+    }
+
+    bool push_back_until(const T& val, const Clock::time_point& deadline) {
+        return push_impl(val, true, &deadline);
+    }
+
+    // 空了就等待，stop之后返回false
+    bool pop_front(T& val) {
+        return pop_impl(val, true, nullptr);
+    }
+
+    // 非阻塞，空了返回false
+    bool try_pop(T& val) {
+        return pop_impl(val, false, nullptr);
+    }
+
+    template<class Rep, class Period>
+    bool pop_for(T& val, const std::chrono::duration<Rep, Period>& timeout) {
+        Clock::time_point deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(timeout);
+        return pop_impl(val, true, &deadline);
+    }
+
+    bool pop_until(T& val, const Clock::time_point& deadline) {
+        return pop_impl(val, true, &deadline);
+    }
+
+    // 近似值
+    size_t size() const {
+        uint64_t enqueue_pos = header_->enqueue_pos.load(std::memory_order_acquire);
+        uint64_t dequeue_pos = header_->dequeue_pos.load(std::memory_order_acquire);
+        return enqueue_pos > dequeue_pos ? (size_t)(enqueue_pos - dequeue_pos) : 0;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    size_t capacity() const {
+        return (size_t)header_->capacity;
+    }
+
+private:
+    static const uint32_t kMagic = 0x4c5a5351; // "LZSQ"
+
+    // 共享内存的头部，各个进程映射的地址可能不同，里面不能放指针
+    struct Header {
+        Header() : magic(0), enqueue_pos(0), dequeue_pos(0),
+                   not_empty(0), consumers_waiting(0), not_full(0), producers_waiting(0), stop(0) {
+        }
+
+        std::atomic<uint32_t> magic;
+        uint64_t capacity = 0;
+        uint64_t element_size = 0;
+
+        char pad0[LAZY_CACHE_LINE_SIZE];
+
+        std::atomic<uint64_t> enqueue_pos;
+
+        char pad1[LAZY_CACHE_LINE_SIZE];
+
+        std::atomic<uint64_t> dequeue_pos;
+
+        char pad2[LAZY_CACHE_LINE_SIZE];
+
+        // futex字：消费者挂起在上面，生产者发现有消费者挂起时加一再唤醒
+        std::atomic<uint32_t> not_empty;
+        std::atomic<uint32_t> consumers_waiting;
+
+        char pad3[LAZY_CACHE_LINE_SIZE];
+
+        std::atomic<uint32_t> not_full;
+        std::atomic<uint32_t> producers_waiting;
+
+        char pad4[LAZY_CACHE_LINE_SIZE];
+
+        std::atomic<uint32_t> stop;
+    };
+
+    struct Cell {
+        Cell() : sequence(0) {
+        }
+
+        std::atomic<uint64_t> sequence;
+        T data;
+    };
+
+    static size_t cells_offset() {
+        return (sizeof(Header) + LAZY_CACHE_LINE_SIZE - 1) / LAZY_CACHE_LINE_SIZE * LAZY_CACHE_LINE_SIZE;
+    }
+
+    static size_t mapping_size(uint64_t capacity) {
+        return cells_offset() + (size_t)capacity * sizeof(Cell);
+    }
+
+    bool map(int fd, size_t size) {
+        void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(base == MAP_FAILED){
+            return false;
+        }
+
+        base_ = base;
+        size_ = size;
+
+        return true;
+    }
+
+    bool enqueue(const T& val) {
+        uint64_t pos = header_->enqueue_pos.load(std::memory_order_relaxed);
+        Cell* cell = nullptr;
+
+        while(true){
+            cell = &cells_[pos & mask_];
+
+            uint64_t seq = cell->sequence.load(std::memory_order_acquire);
+
+            int64_t diff = (int64_t)seq - (int64_t)pos;
+
+            if(diff == 0){
+                if(header_->enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                    break;
+                }
+            }
+            else if(diff < 0){
+                return false;
+            }
+            else {
+                pos = header_->enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->data = val;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    bool dequeue(T& val) {
+        uint64_t pos = header_->dequeue_pos.load(std::memory_order_relaxed);
+        Cell* cell = nullptr;
+
+        while(true){
+            cell = &cells_[pos & mask_];
+
+            uint64_t seq = cell->sequence.load(std::memory_order_acquire);
+
+            int64_t diff = (int64_t)seq - (int64_t)(pos + 1);
+
+            if(diff == 0){
+                if(header_->dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                    break;
+                }
+            }
+            else if(diff < 0){
+                return false;
+            }
+            else {
+                pos = header_->dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        val = cell->data;
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // 读位置上的槽位已经写好了（比比较读写位置更准确：写位置先前进，数据后写入）
+    bool readable() const {
+        uint64_t pos = header_->dequeue_pos.load(std::memory_order_relaxed);
+        return cells_[pos & mask_].sequence.load(std::memory_order_relaxed) == pos + 1;
+    }
+
+    // 写位置上的槽位已经被读走了
+    bool writable() const {
+        uint64_t pos = header_->enqueue_pos.load(std::memory_order_relaxed);
+        return cells_[pos & mask_].sequence.load(std::memory_order_relaxed) == pos;
+    }
+
+    bool push_impl(const T& val, bool block, const Clock::time_point* deadline) {
+        while(true){
+            if(stopped()){
+                return false;
+            }
+
+            if(enqueue(val)){
+                wake_one(header_->not_empty, header_->consumers_waiting);
+                return true;
+            }
+
+            if(!block){
+                return false;
+            }
+
+            if(spin_waiter_.spin([&]{ return writable() || stopped(); })){
+                continue;
+            }
+
+            if(!park(header_->not_full, header_->producers_waiting, [&]{ return writable(); }, deadline)){
+                return false;
+            }
+        }
+    }
+
+    bool pop_impl(T& val, bool block, const Clock::time_point* deadline) {
+        while(true){
+            if(stopped()){
+                return false;
+            }
+
+            if(dequeue(val)){
+                // 对方在另一个进程中，用取到数据的时间近似数据到达的时间
+                spin_waiter_.on_arrival();
+
+                wake_one(header_->not_full, header_->producers_waiting);
+                return true;
+            }
+
+            if(!block){
+                return false;
+            }
+
+            if(spin_waiter_.spin([&]{ return readable() || stopped(); })){
+                continue;
+            }
+
+            if(!park(header_->not_empty, header_->consumers_waiting, [&]{ return readable(); }, deadline)){
+                return false;
+            }
+        }
+    }
+
+    // 只有对方有人挂起时才改变futex字并唤醒一个，两端都在忙的时候没有系统调用
+    void wake_one(std::atomic<uint32_t>& word, std::atomic<uint32_t>& waiting) {
+        // 和park中的fence配对：要么这里看到waiting，要么park中看到数据
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if(waiting.load(std::memory_order_relaxed) > 0){
+            word.fetch_add(1, std::memory_order_release);
+            Futex::wake(word, 1, true);
+        }
+    }
+
+    void wake_all(std::atomic<uint32_t>& word) {
+        word.fetch_add(1, std::memory_order_release);
+        Futex::wake_all(word, true);
+    }
+
+    // 挂起一次，返回false表示已经超时；被唤醒之后由调用者重新尝试
+    template<class Ready>
+    bool park(std::atomic<uint32_t>& word, std::atomic<uint32_t>& waiting, Ready ready,
+              const Clock::time_point* deadline) {
+        std::chrono::nanoseconds timeout(0);
+
+        if(deadline){
+            Clock::time_point now = Clock::now();
+            if(now >= *deadline){
+                return false;
+            }
+            timeout = std::chrono::duration_cast<std::chrono::nanoseconds>(*deadline - now);
+        }
+
+        // 先读字的值再检查条件，检查之后对方的唤醒会改变字的值，futex不会挂起
+        uint32_t seq = word.load(std::memory_order_acquire);
+
+        waiting.fetch_add(1, std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if(!ready() && !stopped()){
+            Futex::wait(word, seq, deadline ? &timeout : nullptr, true);
+        }
+
+        waiting.fetch_sub(1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    // 本进程的映射
+    void* base_ = nullptr;
+    size_t size_ = 0;
+
+    Header* header_ = nullptr;
+    Cell* cells_ = nullptr;
+    uint64_t mask_ = 0;
+
+    SpinWaiter spin_waiter_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(ShmQueue);
+};
+
+}
+
+#endif // __linux__
+
+#endif /* __LAZY_SHM_QUEUE_H__2024__ */
@@ -0,0 +1,462 @@
+//
+//  spill_queue.h
+//
+
+#ifndef __LAZY_SPILL_QUEUE_H__2024__
+#define __LAZY_SPILL_QUEUE_H__2024__
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <deque>
+#include <atomic>
+#include <string>
+#include <utility>
+#include <type_traits>
+
+#include "lazy_base_common.h"
+
+namespace lazy {
+
+/*
+** 可以直接拷贝内存的类型的编解码器
+** 自定义的编解码器需要提供同样的两个静态函数
+*/
+template<class T>
+struct PodCodec {
+    // 编码之后追加到out的后面
+    static void encode(const T& val, std::string& out) {
+        static_assert(std::is_trivially_copyable<T>::value, "PodCodec only supports trivially copyable types");
+        out.append(reinterpret_cast<const char*>(&val), sizeof(T));
+    }
+
+    // 返回false表示数据不完整
+    static bool decode(const char* data, size_t size, T& val) {
+        if(size != sizeof(T)){
+            return false;
+        }
+        memcpy(&val, data, sizeof(T));
+        return true;
+    }
+};
+
+/*
+** 内存中的元素超过阈值之后写入磁盘的先进先出队列，可以作为DataQueue的底层容器：
+**   DataQueue<Msg, SpillQueue<Msg, MsgCodec>> queue(container_args, "/data/spill", 100000);
+** 1、内存中最多保留memory_limit个元素，再写入的元素用Codec编码之后追加到磁盘上的段文件中，
+**    段文件写满segment_bytes之后换一个新的，每个段只追加写入，磁盘IO都是顺序的
+** 2、一旦开始写磁盘，之后写入的元素都写磁盘，直到磁盘上的元素全部读回来，保证先进先出
+** 3、内存中的元素取完之后，从最早的段文件中读回最多memory_limit个元素（mmap顺序读），
+**    段文件读完就删除；正在写的段被读到时先封存，之后的元素写入新的段
+** 4、directory为空或者memory_limit为0时不写磁盘，和std::deque一样
+** 5、写磁盘失败或者读回的数据解码失败时，丢掉这些元素并计入spill_errors()
+** 6、段文件只是内存的延伸，不保证持久化，队列析构时删除所有的段文件
+** 7、swap只交换数据，不交换配置：DataQueue的pop_all在没有元素写入磁盘时和drain_buffer_或者临时的容器交换，
+**    交换之后queue_仍然是自己的配置
+** 8、作为DataQueue的底层容器时，pop_all只取出内存中的元素（见drainable_size），不会把磁盘上的积压一次读进内存，
+**    需要分批取的话用pop_up_to
+** 9、不是线程安全的，需要外部加锁；在DataQueue中时写磁盘（每攒够64KB一次write）和读回（mmap并解码最多
+**    memory_limit个元素）都在DataQueue的锁内进行，这期间生产者和消费者都会被挡住，
+**    memory_limit越大，单次读回占用锁的时间越长
+*/
+template<class T, class Codec>
+class SpillQueue {
+public:
+    /* directory: 段文件所在的目录，需要已经存在
+     * memory_limit: 内存中最多保留的元素个数
+     * segment_bytes: 每个段文件的大小
+     */
+    explicit SpillQueue(const std::string& directory = "", size_t memory_limit = 0,
+                        size_t segment_bytes = 64 * 1024 * 1024)
+    : directory_(directory), memory_limit_(memory_limit), segment_bytes_(segment_bytes) {
+        static std::atomic<uint32_t> instance_counter(0);
+        instance_id_ = instance_counter.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ~SpillQueue() {
+        while(!segments_.empty()){
+            remove_head_segment();
+        }
+    }
+
+    void push_back(const T& val) {
+        emplace_back(val);
+    }
+
+    void push_back(T&& val) {
+        emplace_back(std::move(val));
+    }
+
+    template<class... Args>
+    void emplace_back(Args&&... args) {
+        if(spilled_ == 0 && (memory_limit_ == 0 || directory_.empty() || memory_.size() < memory_limit_)){
+            // 写失败之后可能留下没有元素的段
+            while(!segments_.empty()){
+                remove_head_segment();
+            }
+
+            memory_.emplace_back(std::forward<Args>(args)...);
+            return;
+        }
+
+        spill(T(std::forward<Args>(args)...));
+    }
+
+    T& front() {
+        assert(!memory_.empty());
+        return memory_.front();
+    }
+
+    const T& front() const {
+        assert(!memory_.empty());
+        return memory_.front();
+    }
+
+    void pop_front() {
+        assert(!memory_.empty());
+
+        memory_.pop_front();
+
+        // 保证队列不为空时内存中总有元素，front不需要读磁盘
+        while(memory_.empty() && spilled_ > 0){
+            refill();
+        }
+    }
+
+    size_t size() const {
+        return memory_.size() + (size_t)spilled_;
+    }
+
+    // 内存中的元素个数
+    size_t memory_size() const {
+        return memory_.size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    void clear() {
+        memory_.clear();
+
+        while(!segments_.empty()){
+            remove_head_segment();
+        }
+
+        spilled_ = 0;
+    }
+
+    void swap(SpillQueue& other) {
+        memory_.swap(other.memory_);
+        segments_.swap(other.segments_);
+        std::swap(spilled_, other.spilled_);
+        write_buffer_.swap(other.write_buffer_);
+    }
+
+    // 磁盘上的元素个数
+    uint64_t spilled() const {
+        return spilled_;
+    }
+
+    // 累计写入磁盘的元素个数
+    uint64_t total_spilled() const {
+        return total_spilled_;
+    }
+
+    // 写磁盘或者解码失败而丢掉的元素个数
+    uint64_t spill_errors() const {
+        return spill_errors_;
+    }
+
+    size_t segment_count() const {
+        return segments_.size();
+    }
+
+private:
+    struct Segment {
+        std::string path;
+
+        // 写入用的文件，封存之后关闭
+        int fd = -1;
+        uint64_t bytes = 0;
+        uint64_t records = 0;
+
+        // 读取用的映射
+        const char* data = nullptr;
+        size_t mapped = 0;
+        size_t read_offset = 0;
+    };
+
+    // 每条记录：4字节的长度 + 编码之后的数据
+    static const size_t kHeaderSize = sizeof(uint32_t);
+
+    // 攒够这么多再写文件
+    static const size_t kWriteBufferSize = 64 * 1024;
+
+    void spill(const T& val) {
+        if(segments_.empty() || segments_.back().fd < 0 || segments_.back().bytes >= segment_bytes_){
+            if(!open_segment()){
+                ++spill_errors_;
+                return;
+            }
+        }
+
+        Segment& segment = segments_.back();
+
+        size_t offset = write_buffer_.size();
+        write_buffer_.append(kHeaderSize, '\0');
+        Codec::encode(val, write_buffer_);
+
+        uint32_t length = (uint32_t)(write_buffer_.size() - offset - kHeaderSize);
+        memcpy(&write_buffer_[offset], &length, kHeaderSize);
+
+        segment.bytes += kHeaderSize + length;
+        ++segment.records;
+        ++spilled_;
+        ++total_spilled_;
+
+        if(write_buffer_.size() >= kWriteBufferSize){
+            flush();
+        }
+    }
+
+    bool open_segment() {
+        seal_tail();
+
+        Segment segment;
+        segment.path = directory_ + "/lazy_spill_" + std::to_string((long long)getpid()) + "_"
+                       + std::to_string(instance_id_) + "_" + std::to_string(next_segment_id_++) + ".seg";
+
+        segment.fd = ::open(segment.path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0600);
+        if(segment.fd < 0){
+            return false;
+        }
+
+        segments_.push_back(segment);
+
+        return true;
+    }
+
+    // 把缓冲区写入正在写的段，失败时丢掉这个段中还没有写入的元素
+    void flush() {
+        if(write_buffer_.empty()){
+            return;
+        }
+
+        Segment& segment = segments_.back();
+
+        const char* p = write_buffer_.data();
+        size_t left = write_buffer_.size();
+
+        while(left > 0){
+            ssize_t n = ::write(segment.fd, p, left);
+            if(n < 0 && errno == EINTR){
+                continue;
+            }
+            if(n <= 0){
+                break;
+            }
+            p += n;
+            left -= (size_t)n;
+        }
+
+        if(left > 0){
+            drop_unwritten(segment, p, left);
+
+            // 这个段不再写入，之后写入新的段
+            ::close(segment.fd);
+            segment.fd = -1;
+        }
+
+        write_buffer_.clear();
+    }
+
+    // 缓冲区中从p开始的left字节没有写入文件，把这些记录从计数中去掉
+    void drop_unwritten(Segment& segment, const char* p, size_t left) {
+        const char* end = p + left;
+
+        // 找到第一条没有完整写入的记录
+        const char* record = write_buffer_.data();
+        while(record + kHeaderSize <= end){
+            uint32_t length = 0;
+            memcpy(&length, record, kHeaderSize);
+
+            const char* next = record + kHeaderSize + length;
+            if(next > p){
+                break;
+            }
+            record = next;
+        }
+
+        uint64_t lost = 0;
+        while(record + kHeaderSize <= end){
+            uint32_t length = 0;
+            memcpy(&length, record, kHeaderSize);
+            record += kHeaderSize + length;
+            ++lost;
+        }
+
+        // 文件中不完整的记录在读的时候会被识别出来并丢掉，这里按照已经写入的字节数修正
+        segment.bytes -= (uint64_t)left;
+        segment.records -= lost;
+        spilled_ -= lost;
+        spill_errors_ += lost;
+    }
+
+    // 封存正在写的段，之后只读不写
+    void seal_tail() {
+        if(segments_.empty() || segments_.back().fd < 0){
+            return;
+        }
+
+        flush();
+
+        Segment& segment = segments_.back();
+        if(segment.fd >= 0){
+            ::close(segment.fd);
+            segment.fd = -1;
+        }
+    }
+
+    // 从最早的段中读回最多memory_limit_个元素
+    void refill() {
+        Segment& segment = segments_.front();
+
+        if(segment.fd >= 0){
+            seal_tail();
+        }
+
+        if(segment.data == nullptr && !map_segment(segment)){
+            spilled_ -= segment.records;
+            spill_errors_ += segment.records;
+            remove_head_segment();
+            return;
+        }
+
+        size_t limit = memory_limit_ > 0 ? memory_limit_ : 1;
+
+        while(memory_.size() < limit && segment.records > 0){
+            T val;
+            uint32_t length = 0;
+
+            bool ok = (segment.read_offset + kHeaderSize <= segment.mapped);
+            if(ok){
+                memcpy(&length, segment.data + segment.read_offset, kHeaderSize);
+                ok = (segment.read_offset + kHeaderSize + length <= segment.mapped);
+            }
+
+            if(!ok){
+                // 文件被截断了，剩下的记录都读不到了
+                spilled_ -= segment.records;
+                spill_errors_ += segment.records;
+                segment.records = 0;
+                break;
+            }
+
+            const char* payload = segment.data + segment.read_offset + kHeaderSize;
+            segment.read_offset += kHeaderSize + length;
+            --segment.records;
+            --spilled_;
+
+            if(Codec::decode(payload, length, val)){
+                memory_.push_back(std::move(val));
+            }
+            else {
+                ++spill_errors_;
+            }
+        }
+
+        if(segment.records == 0){
+            remove_head_segment();
+        }
+    }
+
+    bool map_segment(Segment& segment) {
+        int fd = ::open(segment.path.c_str(), O_RDONLY);
+        if(fd < 0){
+            return false;
+        }
+
+        struct stat st;
+        if(fstat(fd, &st) != 0 || st.st_size <= 0){
+            ::close(fd);
+            return false;
+        }
+
+        void* data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+
+        if(data == MAP_FAILED){
+            return false;
+        }
+
+        madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+        segment.data = static_cast<const char*>(data);
+        segment.mapped = (size_t)st.st_size;
+
+        return true;
+    }
+
+    void remove_head_segment() {
+        Segment& segment = segments_.front();
+
+        if(segment.fd >= 0){
+            ::close(segment.fd);
+            write_buffer_.clear();
+        }
+
+        if(segment.data){
+            munmap(const_cast<char*>(segment.data), segment.mapped);
+        }
+
+        ::unlink(segment.path.c_str());
+
+        segments_.pop_front();
+    }
+
+    // 配置，swap时不交换
+    std::string directory_;
+    size_t memory_limit_ = 0;
+    size_t segment_bytes_ = 0;
+    uint32_t instance_id_ = 0;
+    uint64_t next_segment_id_ = 0;
+
+    // 统计
+    uint64_t total_spilled_ = 0;
+    uint64_t spill_errors_ = 0;
+
+    // 队列头部在内存中的元素
+    std::deque<T> memory_;
+
+    // 磁盘上的段，最后一个可能正在写
+    std::deque<Segment> segments_;
+
+    // 磁盘上还没有读回的元素个数
+    uint64_t spilled_ = 0;
+
+    // 正在写的段还没有写入文件的数据
+    std::string write_buffer_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(SpillQueue);
+};
+
+// DataQueue的pop_all只取出内存中的元素，见data_queue.h
+template<class T, class Codec>
+size_t drainable_size(const SpillQueue<T, Codec>& queue) {
+    return queue.memory_size();
+}
+
+}
+
+#endif // __linux__ || __APPLE__
+
+#endif /* __LAZY_SPILL_QUEUE_H__2024__ */
@@ -0,0 +1,347 @@
+//
+//  sync.h
+//
+
+#ifndef __LAZY_SYNC_H__2024__
+#define __LAZY_SYNC_H__2024__
+
+#include <stdint.h>
+#include <assert.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+#include "lazy_base_common.h"
+
+#include "futex.h"
+#include "wait_strategy.h"
+
+namespace lazy {
+
+/*
+** 同步原语共用的等待逻辑：在一个32位的原子变量（字）上等待，挂起用futex
+** 1、等待的一方先（可选地）自旋，再登记为等待者，然后在字上挂起，被唤醒之后重新检查
+** 2、修改字的一方只有在有等待者时才调用futex唤醒，没有竞争时不加锁，也没有系统调用
+** 3、等待者登记和修改字都是seq_cst的：要么修改的一方看到等待者，要么等待者挂起之前看到新的值
+*/
+class FutexWaiter {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    FutexWaiter() : waiters_(0) {
+    }
+
+    void set_wait_strategy(WaitStrategy strategy, uint32_t max_spin_us = 50) {
+        spin_waiter_.set_strategy(strategy, max_spin_us);
+    }
+
+    /* 等待直到take(字的值)返回true
+     * take: 用读到的值判断条件是否满足，可以在里面修改字（比如信号量用CAS减一），失败时返回false
+     * deadline: 为nullptr时一直等待
+     * 返回false表示超时
+     */
+    template<class Take>
+    bool wait(std::atomic<uint32_t>& word, Take take, const Clock::time_point* deadline) {
+        if(spin_waiter_.enabled() && spin_waiter_.spin([&]{ return take(word.load(std::memory_order_acquire)); })){
+            return true;
+        }
+
+        waiters_.fetch_add(1);
+
+        bool ok = true;
+
+        while(true){
+            uint32_t value = word.load();
+
+            if(take(value)){
+                break;
+            }
+
+            if(deadline){
+                Clock::time_point now = Clock::now();
+
+                if(now >= *deadline){
+                    ok = false;
+                    break;
+                }
+
+                std::chrono::nanoseconds left = std::chrono::duration_cast<std::chrono::nanoseconds>(*deadline - now);
+
+                Futex::wait(word, value, &left);
+            }
+            else {
+                Futex::wait(word, value);
+            }
+        }
+
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+
+        return ok;
+    }
+
+    // 修改字之后调用，最多唤醒count个等待者
+    void wake(std::atomic<uint32_t>& word, int count) {
+        spin_waiter_.on_arrival();
+
+        if(waiters_.load() > 0){
+            Futex::wake(word, count);
+        }
+    }
+
+    void wake_all(std::atomic<uint32_t>& word) {
+        spin_waiter_.on_arrival();
+
+        if(waiters_.load() > 0){
+            Futex::wake_all(word);
+        }
+    }
+
+private:
+    std::atomic<uint32_t> waiters_;
+
+    SpinWaiter spin_waiter_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(FutexWaiter);
+};
+
+/*
+** 计数信号量
+** 1、acquire：计数大于0时减一，否则等待
+** 2、release：计数加n，唤醒最多n个等待者
+*/
+class Semaphore {
+public:
+    typedef FutexWaiter::Clock Clock;
+
+    explicit Semaphore(uint32_t initial = 0) : count_(initial) {
+    }
+
+    void acquire() {
+        if(try_acquire()){
+            return;
+        }
+
+        waiter_.wait(count_, [&](uint32_t value){ return take(value); }, nullptr);
+    }
+
+    // 不等待，计数为0时返回false
+    bool try_acquire() {
+        return take(count_.load(std::memory_order_relaxed));
+    }
+
+    // 最多等待timeout，超时返回false
+    template<class Rep, class Period>
+    bool acquire_for(const std::chrono::duration<Rep, Period>& timeout) {
+        return acquire_until(Clock::now() + std::chrono::duration_cast<Clock::duration>(timeout));
+    }
+
+    bool acquire_until(const Clock::time_point& deadline) {
+        if(try_acquire()){
+            return true;
+        }
+
+        return waiter_.wait(count_, [&](uint32_t value){ return take(value); }, &deadline);
+    }
+
+    void release(uint32_t n = 1) {
+        count_.fetch_add(n);
+
+        waiter_.wake(count_, (int)n);
+    }
+
+    // 当前的计数，只能作为参考
+    uint32_t available() const {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    // 挂起之前先自旋，见WaitStrategy
+    void set_wait_strategy(WaitStrategy strategy, uint32_t max_spin_us = 50) {
+        waiter_.set_wait_strategy(strategy, max_spin_us);
+    }
+
+private:
+    bool take(uint32_t value) {
+        while(value > 0){
+            if(count_.compare_exchange_weak(value, value - 1, std::memory_order_acquire, std::memory_order_relaxed)){
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::atomic<uint32_t> count_;
+
+    FutexWaiter waiter_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(Semaphore);
+};
+
+/*
+** 一次性的倒计数门闩（类似C++20的std::latch）
+** 1、count_down把计数减n，减到0时唤醒所有的wait，之后的wait立即返回
+** 2、计数不能再增加，需要重复使用的话用Barrier或者WaitGroup
+*/
+class Latch {
+public:
+    typedef FutexWaiter::Clock Clock;
+
+    explicit Latch(uint32_t count) : count_(count) {
+    }
+
+    void count_down(uint32_t n = 1) {
+        uint32_t old = count_.fetch_sub(n);
+
+        assert(old >= n);
+
+        if(old == n){
+            waiter_.wake_all(count_);
+        }
+    }
+
+    bool try_wait() const {
+        return count_.load(std::memory_order_acquire) == 0;
+    }
+
+    void wait() {
+        waiter_.wait(count_, [](uint32_t value){ return value == 0; }, nullptr);
+    }
+
+    // 最多等待timeout，超时返回false
+    template<class Rep, class Period>
+    bool wait_for(const std::chrono::duration<Rep, Period>& timeout) {
+        Clock::time_point deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(timeout);
+        return waiter_.wait(count_, [](uint32_t value){ return value == 0; }, &deadline);
+    }
+
+    void arrive_and_wait(uint32_t n = 1) {
+        count_down(n);
+        wait();
+    }
+
+    void set_wait_strategy(WaitStrategy strategy, uint32_t max_spin_us = 50) {
+        waiter_.set_wait_strategy(strategy, max_spin_us);
+    }
+
+private:
+    std::atomic<uint32_t> count_;
+
+    FutexWaiter waiter_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(Latch);
+};
+
+/*
+** 可以重复使用的屏障（类似pthread_barrier/C++20的std::barrier）
+** 1、每一轮count个线程都调用arrive_and_wait之后，所有的线程一起返回，然后进入下一轮
+** 2、每一轮最后到达的线程先执行completion（如果有），再放行其他线程，它的arrive_and_wait返回true
+** 3、用轮次（generation）作为futex字，放行就是把轮次加一
+*/
+class Barrier {
+public:
+    explicit Barrier(uint32_t count, const std::function<void()>& completion = nullptr)
+    : count_(count), completion_(completion), arrived_(0), generation_(0) {
+        assert(count_ > 0);
+    }
+
+    // 返回true表示是这一轮最后到达的线程
+    bool arrive_and_wait() {
+        uint32_t generation = generation_.load(std::memory_order_acquire);
+
+        if(arrived_.fetch_add(1, std::memory_order_acq_rel) + 1 == count_){
+            if(completion_){
+                completion_();
+            }
+
+            // 下一轮的线程看到新的轮次之后才会到达，先清零
+            arrived_.store(0, std::memory_order_relaxed);
+
+            generation_.fetch_add(1);
+
+            waiter_.wake_all(generation_);
+
+            return true;
+        }
+
+        waiter_.wait(generation_, [generation](uint32_t value){ return value != generation; }, nullptr);
+
+        return false;
+    }
+
+    // 已经完成的轮数（32位回绕）
+    uint32_t generation() const {
+        return generation_.load(std::memory_order_acquire);
+    }
+
+    void set_wait_strategy(WaitStrategy strategy, uint32_t max_spin_us = 50) {
+        waiter_.set_wait_strategy(strategy, max_spin_us);
+    }
+
+private:
+    const uint32_t count_;
+    std::function<void()> completion_;
+
+    std::atomic<uint32_t> arrived_;
+    std::atomic<uint32_t> generation_;
+
+    FutexWaiter waiter_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(Barrier);
+};
+
+/*
+** 等待一组任务完成（类似Go的sync.WaitGroup）
+** 1、启动任务之前add(n)，每个任务结束时done()，wait等待计数回到0
+** 2、计数回到0之后可以再add，重复使用
+*/
+class WaitGroup {
+public:
+    typedef FutexWaiter::Clock Clock;
+
+    WaitGroup() : count_(0) {
+    }
+
+    void add(int32_t delta = 1) {
+        int32_t count = (int32_t)(count_.fetch_add((uint32_t)delta) + (uint32_t)delta);
+
+        assert(count >= 0);
+
+        if(count == 0){
+            waiter_.wake_all(count_);
+        }
+    }
+
+    void done() {
+        add(-1);
+    }
+
+    void wait() {
+        waiter_.wait(count_, [](uint32_t value){ return value == 0; }, nullptr);
+    }
+
+    // 最多等待timeout，超时返回false
+    template<class Rep, class Period>
+    bool wait_for(const std::chrono::duration<Rep, Period>& timeout) {
+        Clock::time_point deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(timeout);
+        return waiter_.wait(count_, [](uint32_t value){ return value == 0; }, &deadline);
+    }
+
+    // 还没有done的任务数
+    int32_t count() const {
+        return (int32_t)count_.load(std::memory_order_acquire);
+    }
+
+    void set_wait_strategy(WaitStrategy strategy, uint32_t max_spin_us = 50) {
+        waiter_.set_wait_strategy(strategy, max_spin_us);
+    }
+
+private:
+    std::atomic<uint32_t> count_;
+
+    FutexWaiter waiter_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(WaitGroup);
+};
+
+}
+
+#endif /* __LAZY_SYNC_H__2024__ */
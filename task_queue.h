@@ -20,6 +20,8 @@
 #include "lazy_base_common.h"
 
 #include "time_utils.h"
+#include "thread_utils.h"
+#include "wait_strategy.h"
 
 namespace lazy {
 
@@ -125,7 +127,7 @@ static SharedClosure MakeSharedClosure(Closure&& closure) {
 */
 class TaskQueue {
 public:
-    TaskQueue() {}
+    TaskQueue() : enqueue_seq_(0) {}
 
     ~TaskQueue() {
         if (thread_.joinable()) {
@@ -136,6 +138,7 @@ public:
 
                 //task_list_.push_back(nullptr);
                 delayed_task_map_.insert(std::make_pair(TimeUtil::NowMs(), nullptr));
+                enqueue_seq_.fetch_add(1, std::memory_order_release);
 
                 cond_.notify_one();
             }
@@ -157,15 +160,52 @@ public:
         return std::this_thread::get_id() == thread_.get_id();
     }
 
+    // 设置名字，同时也会设置为线程的名字（top -H、perf、gdb中可以看到）
+    // 线程还没有创建时，在线程启动的时候设置
     void set_name(const std::string& name) {
-        std::unique_lock<std::mutex> guard(mutex_);
-        name_ = name;
+        bool running = false;
+        {
+            std::unique_lock<std::mutex> guard(mutex_);
+            name_ = name;
+            running = thread_.joinable();
+        }
+        
+        // 有的平台（比如macOS）只能设置当前线程的名字，所以放到任务队列的线程上执行
+        if(running){
+            apply_on_thread([&]{
+                ThreadUtil::SetCurrentName(name);
+            });
+        }
     }
 
     const std::string& name() const {
         return name_;
     }
     
+    // 设置线程的CPU亲和性、NUMA节点、nice值以及调度策略
+    // 线程还没有创建时，在线程启动的时候设置，返回true
+    // 返回false表示有参数设置失败，比如没有权限设置实时调度、CPU编号不存在
+    bool set_thread_options(const ThreadOptions& options) {
+        bool running = false;
+        {
+            std::unique_lock<std::mutex> guard(mutex_);
+            thread_options_ = options;
+            running = thread_.joinable();
+        }
+        
+        if(!running){
+            return true;
+        }
+        
+        // 没有指定的参数恢复成默认值，可以撤销之前的设置
+        bool ok = false;
+        apply_on_thread([&]{
+            ok = ThreadUtil::ApplyToCurrent(options, true);
+        });
+        
+        return ok;
+    }
+    
     // 添加异步任务，和post效果一样
     template <class Closure>
     void add_task(Closure&& closure, uint64_t task_id = INVALID_ID) {
@@ -247,6 +287,14 @@ public:
     void remove_timer(uint64_t task_id) {
         return cancel(task_id);
     }
+    
+    /* 设置任务队列线程等待任务时的策略，默认是直接挂起
+     * 对延迟敏感的队列可以先自旋一段时间，避免挂起/唤醒带来的几十微秒的延迟，代价是消耗CPU
+     * max_spin_us: 挂起之前最多自旋的时间
+     */
+    void set_wait_strategy(WaitStrategy strategy, uint32_t max_spin_us = 50) {
+        spin_waiter_.set_strategy(strategy, max_spin_us);
+    }
 
     // 执行同步任务
     template <class ReturnT, class Closure>
@@ -261,9 +309,12 @@ public:
         task->is_sync = true;
         task->repeat_num = 0;
         
+        spin_waiter_.on_arrival();
+        
         {
             std::unique_lock<std::mutex> guard(mutex_);
             task_list_.push_back(task);
+            enqueue_seq_.fetch_add(1, std::memory_order_release);
             cond_.notify_one();
         }
         {
@@ -279,10 +330,23 @@ public:
         return ptr->move_result();
     }
 private:
+    // 在任务队列的线程上执行，返回时已经执行结束
+    template <class Closure>
+    void apply_on_thread(Closure&& closure) {
+        if(is_current()){
+            closure();
+            return;
+        }
+        
+        invoke<void>(std::forward<Closure>(closure));
+    }
+    
     // 添加异步任务的公共接口
     template <class Closure>
     void post_delayed_internal(Closure&& closure, uint32_t delay_or_interval_ms, uint64_t task_id = INVALID_ID, uint64_t repeat_num = -1) {
         maybe_create_thread();
+        
+        spin_waiter_.on_arrival();
 
         std::unique_lock<std::mutex> guard(mutex_);
         std::shared_ptr<QueuedTask> task = MakeSharedClosure<void, Closure>(std::forward<Closure>(closure));
@@ -298,6 +362,7 @@ private:
         int64_t target_time_ms = task->enqueue_time_ms + task->delay_ms;
         
         delayed_task_map_.insert(std::make_pair(target_time_ms , std::move(task)));
+        enqueue_seq_.fetch_add(1, std::memory_order_release);
         cond_.notify_one();
     }
     
@@ -319,7 +384,33 @@ private:
     
     // 任务队列线程函数
     void run() {
+        std::string name;
+        ThreadOptions options;
+        {
+            std::unique_lock<std::mutex> guard(mutex_);
+            name = name_;
+            options = thread_options_;
+        }
+        
+        if(!name.empty()){
+            ThreadUtil::SetCurrentName(name);
+        }
+        
+        ThreadUtil::ApplyToCurrent(options);
+        
+        // 上一次取任务之后两个队列都空了，以及当时的投递序号
+        bool drained = false;
+        uint64_t drained_seq = 0;
+        
         while (true) {
+            // 队列已经空了，挂起之前先自旋等待新的任务
+            if (drained && spin_waiter_.enabled()) {
+                spin_waiter_.spin([&] {
+                    return enqueue_seq_.load(std::memory_order_acquire) != drained_seq;
+                });
+            }
+            drained = false;
+            
             std::shared_ptr<QueuedTask> task;
 
             bool sleep = false;
@@ -367,6 +458,9 @@ private:
                     task = std::move(task_list_.front());
                     task_list_.pop_front();
                     
+                    drained = task_list_.empty() && delayed_task_map_.empty();
+                    drained_seq = enqueue_seq_.load(std::memory_order_relaxed);
+                    
                     // task等于null是退出的标识
                     if (task == nullptr) {
                         exit_loop = true;
@@ -415,6 +509,7 @@ private:
                     std::unique_lock<std::mutex> guard(mutex_);
                     
                     delayed_task_map_.insert(std::make_pair(target_time_ms, std::move(task)));
+                    enqueue_seq_.fetch_add(1, std::memory_order_release);
                 }
             }
         }
@@ -439,6 +534,13 @@ private:
 
     std::string name_ = "";
     
+    ThreadOptions thread_options_;
+    
+    // 每投递一个任务加1，不加锁就可以读取，用于自旋等待
+    std::atomic<uint64_t> enqueue_seq_;
+    
+    SpinWaiter spin_waiter_;
+    
     LAZY_DISALLOW_COPY_AND_ASSIGN(TaskQueue);
 };
 
@@ -16,7 +16,26 @@
 #include "time_utils.h"
 #include "test_log.h"
 #include "test_global_config.h"
-#include "test_random.h"
+#include "test_ringbuffer.h"
+#include "test_sharded_executor.h"
+#include "test_elastic_executor.h"
+#include "test_thread_utils.h"
+#include "test_reactor_task_queue.h"
+#include "test_wait_strategy.h"
+#include "test_mpmc_queue.h"
+#include "test_priority_data_queue.h"
+#include "test_segment_queue.h"
+#include "test_broadcast_channel.h"
+#include "test_select.h"
+#include "test_shm_queue.h"
+#include "test_spill_queue.h"
+#include "test_batch_consumer.h"
+#include "test_pipeline.h"
+#include "test_sync.h"
+#include "test_seqlock.h"
+#include "test_rw_lock.h"
+#include "test_reclaim.h"
+#include "test_rcu.h"
 
 #include <tuple>
 #include <functional>
@@ -156,6 +175,58 @@ int main(int argc, const char * argv[]) {
     
     //TestRingbuffer();
     
+    //TestShardedExecutor();
+    
+    //TestElasticExecutor();
+    
+    //TestThreadUtils();
+    
+    //TestReactorTaskQueue();
+    
+    //TestWaitStrategy();
+    
+    //TestMpmcQueue();
+    
+    //TestDataQueueBatch();
+    
+    //TestDataQueueTimed();
+    
+    //TestDataQueueBounded();
+    
+    //TestPriorityDataQueue();
+    
+    //TestSegmentQueue();
+    
+    //TestBroadcastChannel();
+    
+    //TestSelect();
+    
+    //TestShmQueue();
+    
+    //TestSpillQueue();
+    
+    //TestBatchConsumer();
+    
+    //TestPipeline();
+    
+    //TestEventSignal();
+    
+    //TestSync();
+    
+    //TestSeqLock();
+    
+    //TestRWLock();
+    
+    //TestReclaim();
+    
+    //TestRcu();
+    
+    //TestGlobalConfigConcurrent();
+    
+    //TestConfigKey();
+    
+    //TestConfigSubscribe();
+    
     
     /*bool use_std = false;
     
@@ -0,0 +1,186 @@
+//
+//  test_batch_consumer.h
+//
+
+#ifndef test_batch_consumer_h
+#define test_batch_consumer_h
+
+#include "batch_consumer.h"
+#include "time_utils.h"
+#include <assert.h>
+#include <stdio.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+
+void TestBatchConsumer(){
+    {
+        // 数据已经攒够了：每一批都是满的，并且保持顺序
+        lazy::DataQueue<int> queue;
+        queue.start();
+
+        for(int i = 0; i < 1000; ++i){
+            queue.push_back(i);
+        }
+
+        lazy::TaskQueue task_queue;
+
+        std::vector<size_t> sizes;
+        int next = 0;
+
+        lazy::BatchConsumer<int>::Config conf;
+        conf.max_batch = 100;
+
+        lazy::BatchConsumer<int> consumer(queue, task_queue, [&](std::vector<int>& batch){
+            sizes.push_back(batch.size());
+            for(int v : batch){
+                assert(v == next);
+                ++next;
+            }
+        }, conf);
+        consumer.start();
+
+        while(consumer.metrics().items < 1000){
+            lazy::TimeUtil::SleepMs(1);
+        }
+        consumer.stop();
+
+        assert(sizes.size() == 10);
+        for(size_t size : sizes){
+            assert(size == 100);
+        }
+
+        // stop之后的数据留在队列中
+        queue.push_back(1000);
+        lazy::TimeUtil::SleepMs(20);
+        assert(queue.size() == 1);
+    }
+
+    {
+        // 数据不够一批时，等到max_wait_us就交给回调
+        lazy::DataQueue<int> queue;
+        queue.start();
+
+        lazy::TaskQueue task_queue;
+
+        std::atomic<int> batches(0);
+        std::atomic<size_t> last_size(0);
+
+        lazy::BatchConsumer<int>::Config conf;
+        conf.max_batch = 100;
+        conf.max_wait_us = 20 * 1000;
+
+        lazy::BatchConsumer<int> consumer(queue, task_queue, [&](std::vector<int>& batch){
+            last_size = batch.size();
+            ++batches;
+        }, conf);
+        consumer.start();
+
+        int64_t t1 = lazy::TimeUtil::MonoNowMs();
+
+        queue.push_back(1);
+        queue.push_back(2);
+        lazy::TimeUtil::SleepMs(5);
+        queue.push_back(3);
+
+        while(batches == 0){
+            lazy::TimeUtil::SleepMs(1);
+        }
+
+        assert(last_size == 3);
+        assert(lazy::TimeUtil::MonoNowMs() - t1 >= 19);
+
+        // 同一个TaskQueue上的其他任务可以执行
+        std::atomic<bool> ran(false);
+        task_queue.post([&]{
+            ran = true;
+        });
+        while(!ran){
+            lazy::TimeUtil::SleepMs(1);
+        }
+
+        // DataQueue被stop之后消费者也退出
+        queue.stop();
+        consumer.stop();
+    }
+
+    {
+        // 攒一批和没有数据的期间都不占用TaskQueue的线程
+        lazy::DataQueue<int> queue;
+        queue.start();
+
+        lazy::TaskQueue task_queue;
+
+        std::atomic<int> batches(0);
+
+        lazy::BatchConsumer<int>::Config conf;
+        conf.max_batch = 100;
+        conf.max_wait_us = 200 * 1000;
+
+        lazy::BatchConsumer<int> consumer(queue, task_queue, [&](std::vector<int>& batch){
+            assert(batch.size() == 1);
+            ++batches;
+        }, conf);
+        consumer.start();
+
+        // 没有数据时其他任务立即执行
+        lazy::TimeUtil::SleepMs(5);
+        int64_t t1 = lazy::TimeUtil::MonoNowUs();
+        task_queue.invoke<void>([]{});
+        assert(lazy::TimeUtil::MonoNowUs() - t1 < 5 * 1000);
+
+        // 这一批还在等max_wait_us，其他任务也不需要等
+        queue.push_back(1);
+        lazy::TimeUtil::SleepMs(5);
+        t1 = lazy::TimeUtil::MonoNowUs();
+        task_queue.invoke<void>([]{});
+        assert(lazy::TimeUtil::MonoNowUs() - t1 < 50 * 1000);
+        assert(batches == 0);
+
+        while(batches == 0){
+            lazy::TimeUtil::SleepMs(1);
+        }
+
+        consumer.stop();
+    }
+
+    {
+        // 处理时间和批量成正比：批量自动减小，延迟保持在目标附近
+        lazy::DataQueue<int> queue;
+        queue.start();
+
+        lazy::TaskQueue task_queue;
+
+        lazy::BatchConsumer<int>::Config conf;
+        conf.max_batch = 1000;
+        conf.max_wait_us = 1000;
+        conf.target_latency_us = 5000;
+
+        lazy::BatchConsumer<int> consumer(queue, task_queue, [&](std::vector<int>& batch){
+            // 每个数据20us
+            lazy::TimeUtil::SleepUs(20 * batch.size());
+        }, conf);
+
+        for(int i = 0; i < 20000; ++i){
+            queue.push_back(i);
+        }
+
+        consumer.start();
+
+        while(consumer.metrics().items < 20000){
+            lazy::TimeUtil::SleepMs(1);
+        }
+        consumer.stop();
+
+        lazy::BatchConsumer<int>::Metrics m = consumer.metrics();
+
+        printf("BatchConsumer target 5000 us: %llu batches, batch_limit %zu, avg latency %llu us, max %llu us, over target %llu \n",
+               (unsigned long long)m.batches, m.batch_limit, (unsigned long long)m.avg_latency_us,
+               (unsigned long long)m.max_latency_us, (unsigned long long)m.over_target);
+
+        assert(m.batch_limit < 1000);
+        assert(m.batches > 20);
+    }
+}
+
+#endif /* test_batch_consumer_h */
@@ -0,0 +1,284 @@
+//
+//  test_broadcast_channel.h
+//
+
+#ifndef test_broadcast_channel_h
+#define test_broadcast_channel_h
+
+#include "broadcast_channel.h"
+#include "data_queue.h"
+#include "time_utils.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// 每条消息复制到三个DataQueue中，三个消费者各读一个，返回耗时（毫秒）
+static int64_t bench_three_data_queues(int count, const std::string& payload){
+    lazy::DataQueue<std::string> queues[3];
+
+    int64_t t1 = lazy::TimeUtil::MonoNowMs();
+
+    std::vector<std::thread> consumers;
+    for(int i = 0; i < 3; ++i){
+        queues[i].set_capacity(1024);
+        queues[i].start();
+
+        lazy::DataQueue<std::string>* queue = &queues[i];
+        consumers.push_back(std::thread([queue, count]{
+            std::string msg;
+            size_t bytes = 0;
+            for(int j = 0; j < count; ++j){
+                queue->pop_front(msg);
+                bytes += msg.size();
+            }
+            assert(bytes > 0);
+        }));
+    }
+
+    for(int i = 0; i < count; ++i){
+        for(int j = 0; j < 3; ++j){
+            queues[j].push_back(payload);
+        }
+    }
+
+    for(auto& t : consumers){
+        t.join();
+    }
+
+    return lazy::TimeUtil::MonoNowMs() - t1;
+}
+
+// 每条消息只发布一次，三个订阅者共享，返回耗时（毫秒）
+static int64_t bench_broadcast_channel(int count, const std::string& payload){
+    lazy::BroadcastChannel<std::string> channel(1024);
+    channel.start();
+
+    int64_t t1 = lazy::TimeUtil::MonoNowMs();
+
+    std::vector<std::thread> consumers;
+    for(int i = 0; i < 3; ++i){
+        std::shared_ptr<lazy::BroadcastChannel<std::string>::Subscriber> subscriber(channel.subscribe().release());
+
+        consumers.push_back(std::thread([subscriber, count]{
+            lazy::BroadcastChannel<std::string>::Message msg;
+            size_t bytes = 0;
+            for(int j = 0; j < count; ++j){
+                subscriber->next(msg);
+                bytes += msg->size();
+            }
+            assert(bytes > 0);
+        }));
+    }
+
+    for(int i = 0; i < count; ++i){
+        channel.publish(payload);
+    }
+
+    for(auto& t : consumers){
+        t.join();
+    }
+
+    return lazy::TimeUtil::MonoNowMs() - t1;
+}
+
+void TestBroadcastChannel(){
+    typedef lazy::BroadcastChannel<int> IntChannel;
+
+    {
+        // 每个订阅者都收到所有的消息，并且是同一个对象
+        IntChannel channel(4);
+        channel.start();
+
+        auto sub1 = channel.subscribe();
+        auto sub2 = channel.subscribe();
+        assert(channel.subscriber_count() == 2);
+
+        IntChannel::Message m1, m2;
+        assert(!sub1->try_next(m1));
+        assert(!sub1->next_for(m1, std::chrono::milliseconds(10)));
+
+        for(int i = 0; i < 4; ++i){
+            assert(channel.publish(i));
+        }
+
+        for(int i = 0; i < 4; ++i){
+            assert(sub1->next(m1) && *m1 == i);
+            assert(sub2->next(m2) && *m2 == i);
+            assert(m1.get() == m2.get());
+        }
+
+        // 订阅之后只能收到之后的消息
+        auto sub3 = channel.subscribe();
+        channel.publish(100);
+        assert(sub3->try_next(m1) && *m1 == 100);
+        assert(sub3->pending() == 0);
+        assert(sub1->pending() == 1);
+
+        sub2.reset();
+        assert(channel.subscriber_count() == 2);
+
+        sub1.reset();
+        sub3.reset();
+    }
+
+    {
+        // BROADCAST_SLOW_BLOCK：最慢的订阅者没有读，生产者等待
+        IntChannel channel(4, lazy::BROADCAST_SLOW_BLOCK);
+        channel.start();
+
+        auto fast = channel.subscribe();
+        auto slow = channel.subscribe();
+
+        std::atomic<int> published(0);
+
+        std::thread producer([&]{
+            for(int i = 0; i < 8; ++i){
+                channel.publish(i);
+                ++published;
+            }
+        });
+
+        IntChannel::Message msg;
+        for(int i = 0; i < 4; ++i){
+            assert(fast->next(msg) && *msg == i);
+        }
+
+        // fast已经读完了，但是slow一条都没有读
+        lazy::TimeUtil::SleepMs(20);
+        assert(published == 4);
+
+        for(int i = 0; i < 8; ++i){
+            assert(slow->next(msg) && *msg == i);
+            if(i >= 4){
+                IntChannel::Message fast_msg;
+                assert(fast->next(fast_msg) && *fast_msg == i);
+            }
+        }
+
+        producer.join();
+        assert(published == 8);
+        assert(slow->lagged() == 0);
+    }
+
+    {
+        // BROADCAST_SLOW_LAP：生产者不等待，慢的订阅者被套圈之后跳到最旧的消息
+        IntChannel channel(8, lazy::BROADCAST_SLOW_LAP);
+        channel.start();
+
+        auto slow = channel.subscribe();
+
+        for(int i = 0; i < 100; ++i){
+            assert(channel.publish(i));
+        }
+
+        IntChannel::Message msg;
+        for(int i = 92; i < 100; ++i){
+            assert(slow->next(msg) && *msg == i);
+        }
+        assert(slow->lagged() == 92);
+        assert(!slow->try_next(msg));
+    }
+
+    {
+        // BROADCAST_SLOW_LAP：生产者一边覆盖槽位，订阅者一边读，读到的消息完整并且递增
+        lazy::BroadcastChannel<std::string> channel(8, lazy::BROADCAST_SLOW_LAP);
+        channel.start();
+
+        auto sub = channel.subscribe();
+
+        const int total = 100000;
+
+        std::thread producer([&]{
+            for(int i = 0; i < total; ++i){
+                channel.publish(std::to_string(i));
+            }
+            channel.publish(std::string("end"));
+        });
+
+        lazy::BroadcastChannel<std::string>::Message msg;
+        int last = -1;
+        int received = 0;
+        while(sub->next(msg) && *msg != "end"){
+            int v = atoi(msg->c_str());
+            assert(v > last);
+            last = v;
+            ++received;
+        }
+
+        producer.join();
+
+        assert((uint64_t)received + sub->lagged() == (uint64_t)total);
+    }
+
+    {
+        // stop唤醒等待的订阅者和生产者
+        IntChannel channel(2);
+        channel.start();
+
+        auto sub = channel.subscribe();
+
+        std::thread stopper([&]{
+            lazy::TimeUtil::SleepMs(10);
+            channel.stop();
+        });
+
+        IntChannel::Message msg;
+        assert(!sub->next(msg));
+        stopper.join();
+
+        assert(!channel.publish(1));
+    }
+
+    {
+        // 多个生产者、多个订阅者，并发地读
+        IntChannel channel(64, lazy::BROADCAST_SLOW_BLOCK);
+        channel.start();
+
+        const int producers = 2;
+        const int per_producer = 50000;
+
+        std::vector<std::unique_ptr<IntChannel::Subscriber>> subs;
+        for(int i = 0; i < 3; ++i){
+            subs.push_back(channel.subscribe());
+        }
+
+        std::vector<std::thread> threads;
+        for(int i = 0; i < 3; ++i){
+            IntChannel::Subscriber* sub = subs[i].get();
+            threads.push_back(std::thread([sub]{
+                IntChannel::Message msg;
+                int64_t sum = 0;
+                for(int j = 0; j < producers * per_producer; ++j){
+                    assert(sub->next(msg));
+                    sum += *msg;
+                }
+                assert(sum == (int64_t)producers * per_producer * (per_producer - 1) / 2);
+            }));
+        }
+
+        for(int i = 0; i < producers; ++i){
+            threads.push_back(std::thread([&]{
+                for(int j = 0; j < per_producer; ++j){
+                    channel.publish(j);
+                }
+            }));
+        }
+
+        for(auto& t : threads){
+            t.join();
+        }
+    }
+
+    const int count = 500000;
+    const std::string payload(256, 'x');
+
+    int64_t dq_ms = bench_three_data_queues(count, payload);
+    int64_t bc_ms = bench_broadcast_channel(count, payload);
+
+    printf("fan out %d messages to 3 consumers: 3 x DataQueue %lld ms, BroadcastChannel %lld ms \n",
+           count, (long long)dq_ms, (long long)bc_ms);
+}
+
+#endif /* test_broadcast_channel_h */
@@ -6,6 +6,10 @@
 #define test_data_queue_h
 
 #include "data_queue.h"
+#include "time_utils.h"
+#include <assert.h>
+#include <string>
+#include <vector>
 
 void TestDataQueue(){
     lazy::DataQueue<int64_t> data_queue;
@@ -85,5 +89,381 @@ void TestDataQueue(){
     
 }
 
+// 模拟日志线程：producers个线程持续写入日志，日志线程每隔1毫秒取出积压的日志
+// batch为true时用pop_all，否则和原来的Logger::write一样逐条pop_front
+// 返回日志线程花在取数据上的总耗时（微秒），写入线程一直在和它抢锁；locks返回日志线程加锁的次数
+static int64_t bench_log_drain(int producers, int per_producer, bool batch, int64_t& locks){
+    lazy::DataQueue<std::string> log_cache;
+    log_cache.start();
+    
+    const int64_t total = (int64_t)producers * per_producer;
+    
+    int64_t drain_us = 0;
+    
+    locks = 0;
+    
+    std::thread writer([&]{
+        int64_t drained = 0;
+        
+        std::vector<std::string> lines;
+        
+        while(drained < total){
+            lazy::TimeUtil::SleepMs(1);
+            
+            if(log_cache.empty()){
+                continue;
+            }
+            
+            int64_t t1 = lazy::TimeUtil::MonoNowUs();
+            
+            if(batch){
+                lines.clear();
+                log_cache.pop_all(lines);
+                drained += lines.size();
+                ++locks;
+            }
+            else {
+                int64_t count = log_cache.size();
+                while(count > 0){
+                    std::string line;
+                    log_cache.pop_front(line);
+                    --count;
+                    ++drained;
+                    ++locks;
+                }
+            }
+            
+            drain_us += lazy::TimeUtil::MonoNowUs() - t1;
+        }
+    });
+    
+    std::vector<std::thread> threads;
+    for(int i = 0; i < producers; ++i){
+        threads.push_back(std::thread([&]{
+            for(int j = 0; j < per_producer; ++j){
+                log_cache.push_back("[20241103 20:30:14.123] (test_data_queue.h:100) : [I] log line " + std::to_string(j));
+            }
+        }));
+    }
+    
+    for(auto& t : threads){
+        t.join();
+    }
+    writer.join();
+    
+    return drain_us;
+}
+
+void TestDataQueueBatch(){
+    {
+        lazy::DataQueue<int> data_queue;
+        data_queue.start();
+        
+        std::vector<int> in = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+        assert(data_queue.push_range(in.begin(), in.end()));
+        assert(data_queue.size() == 10);
+        
+        std::vector<int> out;
+        assert(data_queue.pop_up_to(4, out));
+        assert(out.size() == 4);
+        
+        // 追加到out的后面
+        assert(data_queue.pop_all(out));
+        assert(out == in);
+        assert(data_queue.empty());
+        
+        data_queue.stop();
+        assert(!data_queue.push_range(in.begin(), in.end()));
+        assert(!data_queue.pop_all(out));
+    }
+    
+    {
+        // 队列为空时pop_all等待
+        lazy::DataQueue<int> data_queue;
+        data_queue.start();
+        
+        std::thread consumer([&]{
+            std::vector<int> out;
+            while(out.size() < 100){
+                assert(data_queue.pop_all(out));
+            }
+            for(int i = 0; i < 100; ++i){
+                assert(out[i] == i);
+            }
+        });
+        
+        for(int i = 0; i < 100; ++i){
+            data_queue.push_back(i);
+        }
+        
+        consumer.join();
+    }
+    
+    const int producers = 4;
+    const int per_producer = 200000;
+    
+    {
+        // 底层容器的构造参数需要显式标记，容器中已有的元素计入队列
+        lazy::DataQueue<int> data_queue(lazy::container_args, 3, 7);
+        data_queue.start();
+        
+        assert(data_queue.size() == 3);
+        
+        std::vector<int> out;
+        assert(data_queue.try_pop_all(out));
+        assert(out.size() == 3 && out[0] == 7 && out[2] == 7);
+        
+        data_queue.push_back(42);
+        int val = 0;
+        assert(data_queue.pop_front(val) && val == 42);
+    }
+    
+    int64_t single_locks = 0;
+    int64_t batch_locks = 0;
+    
+    int64_t single_us = bench_log_drain(producers, per_producer, false, single_locks);
+    int64_t batch_us = bench_log_drain(producers, per_producer, true, batch_locks);
+    
+    printf("log drain %d x %d lines: pop_front %lld us (%lld locks), pop_all %lld us (%lld locks) \n",
+           producers, per_producer,
+           (long long)single_us, (long long)single_locks,
+           (long long)batch_us, (long long)batch_locks);
+}
+
+void TestDataQueueTimed(){
+    {
+        lazy::DataQueue<int> data_queue;
+        data_queue.start();
+        
+        int val = 0;
+        std::vector<int> out;
+        
+        // 空队列：try_xxx立即返回，xxx_for等到超时
+        assert(!data_queue.try_pop(val));
+        assert(!data_queue.try_front(val));
+        assert(!data_queue.try_pop_all(out));
+        assert(!data_queue.try_pop_up_to(2, out));
+        
+        int64_t t1 = lazy::TimeUtil::MonoNowMs();
+        assert(!data_queue.pop_for(val, std::chrono::milliseconds(20)));
+        assert(lazy::TimeUtil::MonoNowMs() - t1 >= 20);
+        
+        assert(!data_queue.pop_all_for(out, std::chrono::milliseconds(1)));
+        assert(!data_queue.pop_up_to_for(2, out, std::chrono::milliseconds(1)));
+        assert(!data_queue.front_until(val, lazy::DataQueue<int>::Clock::now()));
+        
+        data_queue.push_back(1);
+        data_queue.push_back(2);
+        data_queue.push_back(3);
+        
+        assert(data_queue.try_front(val) && val == 1);
+        assert(data_queue.front_for(val, std::chrono::milliseconds(1)) && val == 1);
+        assert(data_queue.try_pop(val) && val == 1);
+        assert(data_queue.pop_for(val, std::chrono::seconds(1)) && val == 2);
+        assert(data_queue.try_pop_up_to(5, out) && out.size() == 1 && out[0] == 3);
+        
+        // stop之后都返回false
+        data_queue.push_back(4);
+        data_queue.stop();
+        assert(!data_queue.try_pop(val));
+        assert(!data_queue.pop_for(val, std::chrono::seconds(1)));
+    }
+    
+    {
+        // 等待期间有数据写入，立即返回
+        lazy::DataQueue<int> data_queue;
+        data_queue.start();
+        
+        std::thread producer([&]{
+            lazy::TimeUtil::SleepMs(10);
+            data_queue.push_back(1);
+        });
+        
+        int val = 0;
+        int64_t t1 = lazy::TimeUtil::MonoNowMs();
+        assert(data_queue.pop_for(val, std::chrono::seconds(10)));
+        assert(val == 1);
+        assert(lazy::TimeUtil::MonoNowMs() - t1 < 5000);
+        
+        producer.join();
+    }
+    
+    {
+        // 消费者同时做周期性的工作，不需要额外的线程
+        lazy::DataQueue<int> data_queue;
+        data_queue.start();
+        
+        std::atomic<int> ticks(0);
+        int received = 0;
+        
+        std::thread consumer([&]{
+            int val = 0;
+            auto next_tick = lazy::DataQueue<int>::Clock::now() + std::chrono::milliseconds(5);
+            
+            while(received < 20){
+                if(data_queue.pop_until(val, next_tick)){
+                    ++received;
+                    continue;
+                }
+                
+                ++ticks;
+                next_tick += std::chrono::milliseconds(5);
+            }
+        });
+        
+        for(int i = 0; i < 20; ++i){
+            data_queue.push_back(i);
+            lazy::TimeUtil::SleepMs(2);
+        }
+        
+        consumer.join();
+        
+        assert(received == 20);
+        assert(ticks > 0);
+    }
+    
+    {
+        // front的等待者和pop的等待者同时存在时，都能被唤醒
+        lazy::DataQueue<int> data_queue;
+        data_queue.start();
+        
+        std::atomic<int> done(0);
+        
+        std::thread front_waiter([&]{
+            int val = 0;
+            assert(data_queue.front_for(val, std::chrono::seconds(10)));
+            ++done;
+        });
+        
+        std::thread pop_waiter([&]{
+            int val = 0;
+            assert(data_queue.pop_for(val, std::chrono::seconds(10)));
+            ++done;
+        });
+        
+        // pop的等待者可能先取走第一个，front的等待者看到的是第二个
+        lazy::TimeUtil::SleepMs(20);
+        data_queue.push_back(1);
+        data_queue.push_back(2);
+        
+        front_waiter.join();
+        pop_waiter.join();
+        
+        assert(done == 2);
+    }
+}
+void TestDataQueueBounded(){
+    {
+        lazy::DataQueue<int> data_queue;
+        data_queue.set_capacity(2, lazy::QUEUE_FULL_REJECT);
+        data_queue.start();
+        
+        assert(data_queue.push_back(1));
+        assert(data_queue.push_back(2));
+        assert(!data_queue.push_back(3));
+        assert(data_queue.rejected() == 1);
+        
+        std::vector<int> in = {4, 5, 6};
+        int val = 0;
+        assert(data_queue.try_pop(val) && val == 1);
+        assert(!data_queue.push_range(in.begin(), in.end()));
+        assert(data_queue.rejected() == 3);
+        assert(data_queue.size() == 2);
+        assert(data_queue.high_water_mark() == 2);
+    }
+    
+    {
+        lazy::DataQueue<int> data_queue;
+        data_queue.set_capacity(3, lazy::QUEUE_FULL_DROP_OLDEST);
+        data_queue.start();
+        
+        for(int i = 0; i < 10; ++i){
+            assert(data_queue.push_back(i));
+        }
+        
+        assert(data_queue.size() == 3);
+        assert(data_queue.dropped() == 7);
+        
+        std::vector<int> out;
+        assert(data_queue.try_pop_all(out));
+        assert(out.size() == 3 && out[0] == 7 && out[2] == 9);
+    }
+    
+    {
+        lazy::DataQueue<int> data_queue;
+        data_queue.set_capacity(1);
+        data_queue.start();
+        
+        assert(data_queue.push_back(1));
+        
+        // 满了：超时返回false
+        int64_t t1 = lazy::TimeUtil::MonoNowMs();
+        assert(!data_queue.push_back_for(2, std::chrono::milliseconds(20)));
+        assert(lazy::TimeUtil::MonoNowMs() - t1 >= 20);
+        assert(data_queue.rejected() == 1);
+        
+        // 满了：等待消费者取走数据
+        std::thread consumer([&]{
+            lazy::TimeUtil::SleepMs(10);
+            int val = 0;
+            assert(data_queue.pop_front(val) && val == 1);
+        });
+        
+        assert(data_queue.push_back(2));
+        consumer.join();
+        
+        // stop唤醒等待的生产者
+        std::thread stopper([&]{
+            lazy::TimeUtil::SleepMs(10);
+            data_queue.stop();
+        });
+        
+        assert(!data_queue.push_back(3));
+        stopper.join();
+    }
+    
+    {
+        // 生产者比消费者快得多：内存被限制在容量以内
+        const size_t capacity = 1024;
+        const int count = 100000;
+        
+        lazy::DataQueue<std::string> data_queue;
+        data_queue.set_capacity(capacity);
+        data_queue.start();
+        
+        std::thread consumer([&]{
+            std::vector<std::string> out;
+            int received = 0;
+            while(received < count){
+                out.clear();
+                data_queue.pop_up_to(64, out);
+                received += out.size();
+                std::this_thread::yield();
+            }
+        });
+        
+        int64_t t1 = lazy::TimeUtil::MonoNowMs();
+        
+        std::vector<std::thread> producers;
+        for(int i = 0; i < 4; ++i){
+            producers.push_back(std::thread([&]{
+                for(int j = 0; j < count / 4; ++j){
+                    data_queue.push_back(std::to_string(j));
+                }
+            }));
+        }
+        
+        for(auto& t : producers){
+            t.join();
+        }
+        consumer.join();
+        
+        assert(data_queue.high_water_mark() <= capacity);
+        
+        printf("bounded queue %d items, capacity %zu: high water mark %zu, cost %lld ms \n",
+               count, capacity, data_queue.high_water_mark(),
+               (long long)(lazy::TimeUtil::MonoNowMs() - t1));
+    }
+}
 
 #endif /* test_data_queue_h */
@@ -0,0 +1,156 @@
+//
+//  test_elastic_executor.h
+//
+
+#ifndef test_elastic_executor_h
+#define test_elastic_executor_h
+
+#include "elastic_executor.h"
+#include <assert.h>
+#include <stdio.h>
+
+void TestElasticExecutor(){
+    lazy::ElasticExecutor::Config conf;
+    conf.min_threads = 1;
+    conf.max_threads = 4;
+    conf.target_wait_us = 2000;
+    conf.idle_timeout_ms = 200;
+
+    lazy::ElasticExecutor executor(conf);
+
+    std::atomic<int> resize_events(0);
+    executor.set_resize_callback([&](bool grow, size_t threads){
+        ++resize_events;
+        printf("%s, threads: %zu \n", grow ? "grow" : "shrink", threads);
+    });
+
+    executor.start();
+
+    std::atomic<int> done(0);
+
+    // 突发的负载：每个任务耗时5ms，单线程处理不过来
+    for(int i = 0; i < 200; ++i){
+        executor.post([&]{
+            lazy::TimeUtil::SleepMs(5);
+            ++done;
+        });
+    }
+
+    while(done < 200){
+        lazy::TimeUtil::SleepMs(10);
+    }
+
+    lazy::ElasticExecutor::Metrics m = executor.metrics();
+
+    printf("peak threads: %zu grow: %llu max wait: %llu us avg wait: %llu us \n",
+           m.peak_threads,
+           (unsigned long long)m.grow_count,
+           (unsigned long long)m.max_wait_us,
+           (unsigned long long)m.avg_wait_us);
+
+    assert(m.peak_threads > 1 && m.peak_threads <= conf.max_threads);
+    assert(m.executed == 200);
+
+    // 空闲之后缩容到min_threads
+    lazy::TimeUtil::SleepMs(conf.idle_timeout_ms * 3);
+
+    m = executor.metrics();
+    printf("threads after idle: %zu shrink: %llu \n", m.threads, (unsigned long long)m.shrink_count);
+
+    assert(m.threads == conf.min_threads);
+    assert(m.shrink_count == m.grow_count - conf.min_threads);
+
+    int ret = executor.invoke<int>([]{
+        return 10;
+    });
+    assert(ret == 10);
+
+    executor.stop();
+
+    assert(!executor.post([]{}));
+    assert(resize_events > 0);
+
+    {
+        // 唯一的线程被长任务占住，之后没有新的投递，监控线程按队头的排队时间扩容
+        lazy::ElasticExecutor::Config c;
+        c.min_threads = 1;
+        c.max_threads = 2;
+        c.target_wait_us = 5000;
+
+        lazy::ElasticExecutor e(c);
+        e.start();
+
+        std::atomic<bool> long_done(false);
+        std::atomic<int64_t> quick_start(0);
+
+        int64_t begin = lazy::TimeUtil::MonoNowUs();
+
+        e.post([&]{
+            lazy::TimeUtil::SleepMs(300);
+            long_done = true;
+        });
+        e.post([&]{
+            quick_start = lazy::TimeUtil::MonoNowUs();
+        });
+
+        while(quick_start == 0){
+            lazy::TimeUtil::SleepMs(1);
+        }
+
+        assert(!long_done);
+        assert(quick_start - begin < 200 * 1000);
+        assert(e.metrics().grow_count == 2);
+
+        e.stop();
+    }
+
+    {
+        // 一个长任务占住线程，后面只有一个排队的任务，只增加一个线程，不会一直扩容到max_threads
+        lazy::ElasticExecutor::Config c;
+        c.min_threads = 1;
+        c.max_threads = 8;
+        c.target_wait_us = 2000;
+
+        lazy::ElasticExecutor e(c);
+        e.start();
+
+        std::atomic<int> done(0);
+
+        e.post([&]{
+            lazy::TimeUtil::SleepMs(100);
+            ++done;
+        });
+        e.post([&]{
+            lazy::TimeUtil::SleepMs(100);
+            ++done;
+        });
+
+        while(done < 2){
+            lazy::TimeUtil::SleepMs(1);
+        }
+
+        assert(e.metrics().peak_threads == 2);
+
+        e.stop();
+    }
+
+    {
+        // 在线程池的线程中stop，不会join自己
+        lazy::ElasticExecutor e;
+        e.start();
+
+        std::atomic<bool> stopped(false);
+        e.post([&]{
+            e.stop();
+            stopped = true;
+        });
+
+        while(!stopped){
+            lazy::TimeUtil::SleepMs(1);
+        }
+
+        assert(!e.post([]{}));
+    }
+}
+
+#endif /* test_elastic_executor_h */
@@ -6,6 +6,14 @@
 #define test_event_h
 
 #include "event.h"
+#include "time_utils.h"
+#include <assert.h>
+#include <stdio.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 void TestEvent(){
     std::deque<int64_t> data_queue;
@@ -135,4 +143,183 @@ void TestEvent(){
 }
 
 
+// 两个线程通过一对Event来回传递count次，返回每次往返的耗时（纳秒）
+static int64_t bench_event_ping_pong(int count){
+    lazy::Event ping;
+    lazy::Event pong;
+    
+    std::thread peer([&]{
+        for(int i = 0; i < count; ++i){
+            ping.wait();
+            pong.wake_up();
+        }
+    });
+    
+    int64_t t1 = lazy::TimeUtil::MonoNowNs();
+    
+    for(int i = 0; i < count; ++i){
+        ping.wake_up();
+        pong.wait();
+    }
+    
+    int64_t ns = lazy::TimeUtil::MonoNowNs() - t1;
+    
+    peer.join();
+    
+    return ns / count;
+}
+
+// 同样的往返，用mutex+条件变量实现，作为对比
+static int64_t bench_condvar_ping_pong(int count){
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool ping = false;
+    bool pong = false;
+    
+    std::thread peer([&]{
+        for(int i = 0; i < count; ++i){
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&]{ return ping; });
+            ping = false;
+            pong = true;
+            cond.notify_all();
+        }
+    });
+    
+    int64_t t1 = lazy::TimeUtil::MonoNowNs();
+    
+    for(int i = 0; i < count; ++i){
+        std::unique_lock<std::mutex> lock(mutex);
+        ping = true;
+        cond.notify_all();
+        cond.wait(lock, [&]{ return pong; });
+        pong = false;
+    }
+    
+    int64_t ns = lazy::TimeUtil::MonoNowNs() - t1;
+    
+    peer.join();
+    
+    return ns / count;
+}
+
+void TestEventSignal(){
+    {
+        // 超时返回false，wake_up之后返回true
+        lazy::Event event;
+        
+        int64_t t1 = lazy::TimeUtil::MonoNowMs();
+        assert(!event.wait(20));
+        assert(lazy::TimeUtil::MonoNowMs() - t1 >= 19);
+        assert(!event.wait(0));
+        
+        event.wake_up();
+        assert(event.is_set());
+        
+        // 自动复位：只有一个wait返回true
+        assert(event.wait(0));
+        assert(!event.is_set());
+        assert(!event.wait(10));
+        
+        // 多次wake_up在被wait之前合并成一次
+        event.wake_up();
+        event.wake_up();
+        assert(event.wait());
+        assert(!event.try_wait());
+        
+        // 等待期间被唤醒
+        std::thread waker([&]{
+            lazy::TimeUtil::SleepMs(10);
+            event.wake_up();
+        });
+        assert(event.wait(5000));
+        waker.join();
+    }
+    
+    {
+        // 手动复位：所有的wait都返回，直到reset
+        lazy::Event event(lazy::EVENT_MANUAL_RESET);
+        
+        std::atomic<int> woken(0);
+        
+        std::vector<std::thread> waiters;
+        for(int i = 0; i < 4; ++i){
+            waiters.push_back(std::thread([&]{
+                if(event.wait()){
+                    ++woken;
+                }
+            }));
+        }
+        
+        lazy::TimeUtil::SleepMs(10);
+        event.wake_up();
+        
+        for(auto& t : waiters){
+            t.join();
+        }
+        
+        assert(woken == 4);
+        assert(event.wait(0) && event.wait(0));
+        
+        event.reset();
+        assert(!event.is_set());
+        assert(!event.wait(10));
+    }
+    
+    {
+        // 自动复位，多个等待者：每次wake_up只唤醒一个
+        lazy::Event event;
+        
+        std::atomic<int> woken(0);
+        std::atomic<bool> done(false);
+        
+        std::vector<std::thread> waiters;
+        for(int i = 0; i < 4; ++i){
+            waiters.push_back(std::thread([&]{
+                while(!done){
+                    if(event.wait(5)){
+                        ++woken;
+                    }
+                }
+            }));
+        }
+        
+        for(int i = 0; i < 100; ++i){
+            event.wake_up();
+            
+            // 等待上一次被消费掉，避免合并
+            while(event.is_set()){
+                std::this_thread::yield();
+            }
+        }
+        
+        lazy::TimeUtil::SleepMs(20);
+        done = true;
+        
+        for(auto& t : waiters){
+            t.join();
+        }
+        
+        assert(woken == 100);
+    }
+    
+    {
+        // 没有等待者时wake_up的开销
+        lazy::Event event;
+        
+        const int count = 10000000;
+        
+        int64_t t1 = lazy::TimeUtil::MonoNowNs();
+        for(int i = 0; i < count; ++i){
+            event.wake_up();
+        }
+        int64_t ns = lazy::TimeUtil::MonoNowNs() - t1;
+        
+        const int rounds = 20000;
+        
+        printf("Event wake_up without waiter: %.2f ns, ping-pong round trip: Event %lld ns, mutex+condvar %lld ns \n",
+               (double)ns / count, (long long)bench_event_ping_pong(rounds), (long long)bench_condvar_ping_pong(rounds));
+    }
+}
+
 #endif /* test_event_h */
@@ -9,7 +9,13 @@
 #define test_global_config_h
 
 #include "global_config.h"
+#include "time_utils.h"
 #include <assert.h>
+#include <stdio.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
 
 void TestGlobalConfig(){
     using namespace lazy;
@@ -164,4 +170,245 @@ void TestGlobalConfig(){
     }
 }
 
+// 多线程读、同时写：读到的值只会是写过的值，字符串的拷贝一直有效
+void TestGlobalConfigConcurrent(){
+    using namespace lazy;
+    
+    GlobalConfig config;
+    
+    config.set("qps_limit", (int64_t)0);
+    config.set("route", std::string("v0"));
+    
+    std::atomic<bool> stop(false);
+    
+    std::vector<std::thread> readers;
+    for(int i = 0; i < 4; ++i){
+        readers.push_back(std::thread([&]{
+            int64_t last = 0;
+            while(!stop){
+                int64_t v = config.get("qps_limit", (int64_t)-1);
+                assert(v >= last);
+                last = v;
+                
+                std::string route = config.get("route", "");
+                assert(route.size() >= 2 && route[0] == 'v');
+            }
+        }));
+    }
+    
+    for(int64_t i = 1; i <= 500; ++i){
+        config.set("qps_limit", i);
+        config.set("route", "v" + std::to_string(i));
+    }
+    
+    stop = true;
+    for(auto& t : readers){
+        t.join();
+    }
+    
+    assert(config.get("qps_limit", (int64_t)0) == 500);
+    assert(config.get("route", "") == "v500");
+    
+    // 32个线程读，和原来加锁读的方式对比
+    std::mutex mutex;
+    std::unordered_map<std::string, int64_t> locked_map;
+    locked_map["qps_limit"] = 500;
+    
+    const int threads = 32;
+    const int count = 20000;
+    
+    auto run = [&](bool use_lock){
+        int64_t t1 = TimeUtil::MonoNowMs();
+        
+        std::vector<std::thread> workers;
+        for(int i = 0; i < threads; ++i){
+            workers.push_back(std::thread([&]{
+                int64_t sum = 0;
+                for(int n = 0; n < count; ++n){
+                    if(use_lock){
+                        std::unique_lock<std::mutex> lock(mutex);
+                        sum += locked_map.find("qps_limit")->second;
+                    }
+                    else {
+                        sum += config.get("qps_limit", (int64_t)0);
+                    }
+                }
+                assert(sum == (int64_t)count * 500);
+            }));
+        }
+        
+        for(auto& t : workers){
+            t.join();
+        }
+        
+        return TimeUtil::MonoNowMs() - t1;
+    };
+    
+    int64_t rcu_ms = run(false);
+    int64_t lock_ms = run(true);
+    
+    printf("GlobalConfig %d threads x %d get: rcu %lld ms, mutex %lld ms \n",
+           threads, count, (long long)rcu_ms, (long long)lock_ms);
+}
+
+// 预先解析的配置句柄
+void TestConfigKey(){
+    using namespace lazy;
+    
+    GlobalConfig config;
+    
+    // 没有set过，用注册时的默认值
+    ConfigKey<int> workers = config.key<int>("workers", 8);
+    assert(workers.valid());
+    assert(workers.get() == 8);
+    assert(workers.name() == "workers");
+    
+    // 通过名字set，句柄立即看到
+    config.set("workers", 16);
+    assert(workers.get() == 16);
+    
+    // 通过句柄set，名字也能读到
+    workers.set(32);
+    assert(config.get("workers", 0) == 32);
+    
+    // 先set再注册，用set的值；再次注册得到同一个变量
+    config.set("ratio", 0.25);
+    ConfigKey<double> ratio = config.key<double>("ratio", 1.0);
+    assert(ratio.get() == 0.25);
+    assert(config.key<double>("ratio", 2.0).get() == 0.25);
+    
+    // 同名不同类别的配置互不相干，和按类型分开的get/set一致
+    ConfigKey<bool> workers_flag = config.key<bool>("workers", true);
+    assert(workers_flag.get());
+    assert(workers.get() == 32);
+    
+    ConfigKey<uint64_t> limit = config.key<uint64_t>("limit");
+    assert(limit.get() == 0);
+    config.set("limit", (uint64_t)1 << 40);
+    assert(limit.get() == (uint64_t)1 << 40);
+    
+    ConfigKey<int64_t> offset = config.key<int64_t>("offset", -5);
+    assert(offset.get() == -5);
+    offset.set(-7);
+    assert(config.get("offset", (int64_t)0) == -7);
+    
+    // 32个线程读，句柄和按名字读对比
+    const int threads = 32;
+    const int count = 20000;
+    
+    auto run = [&](bool use_key){
+        int64_t t1 = TimeUtil::MonoNowMs();
+        
+        std::vector<std::thread> readers;
+        for(int i = 0; i < threads; ++i){
+            readers.push_back(std::thread([&]{
+                int64_t sum = 0;
+                for(int n = 0; n < count; ++n){
+                    sum += use_key ? workers.get() : config.get("workers", 0);
+                }
+                assert(sum == (int64_t)count * 32);
+            }));
+        }
+        
+        for(auto& t : readers){
+            t.join();
+        }
+        
+        return TimeUtil::MonoNowMs() - t1;
+    };
+    
+    int64_t key_ms = run(true);
+    int64_t name_ms = run(false);
+    
+    printf("ConfigKey %d threads x %d get: key %lld ms, by name %lld ms \n",
+           threads, count, (long long)key_ms, (long long)name_ms);
+}
+
+// 订阅配置的变化
+void TestConfigSubscribe(){
+    using namespace lazy;
+    
+    GlobalConfig config;
+    TaskQueue queue;
+    
+    std::mutex mutex;
+    std::vector<std::vector<std::string>> exact_calls;
+    std::vector<std::vector<std::string>> prefix_calls;
+    std::vector<int64_t> seen_values;
+    
+    uint64_t exact_id = config.subscribe("qps_limit", queue, [&](const std::vector<std::string>& keys){
+        std::unique_lock<std::mutex> lock(mutex);
+        exact_calls.push_back(keys);
+        // 回调里读到的是最新的值
+        seen_values.push_back(config.get("qps_limit", (int64_t)0));
+    });
+    
+    config.subscribe_prefix("net.", queue, [&](const std::vector<std::string>& keys){
+        std::unique_lock<std::mutex> lock(mutex);
+        prefix_calls.push_back(keys);
+    });
+    
+    // 先把任务队列堵住，期间的多次变化合并成一次回调
+    std::atomic<bool> release(false);
+    queue.post([&]{
+        while(!release){
+            TimeUtil::SleepMs(1);
+        }
+    });
+    
+    for(int64_t i = 1; i <= 10; ++i){
+        config.set("qps_limit", i);
+    }
+    config.set("net.timeout_ms", 200);
+    config.set("net.retries", 3);
+    config.set("net.timeout_ms", 300);
+    config.set("disk.quota", (uint64_t)100);
+    
+    release = true;
+    
+    // 等队列里的任务都执行完
+    std::atomic<bool> drained(false);
+    queue.post([&]{ drained = true; });
+    while(!drained){
+        TimeUtil::SleepMs(1);
+    }
+    
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        
+        assert(exact_calls.size() == 1);
+        assert(exact_calls[0].size() == 1 && exact_calls[0][0] == "qps_limit");
+        assert(seen_values[0] == 10);
+        
+        assert(prefix_calls.size() == 1);
+        assert(prefix_calls[0].size() == 2);
+        assert(prefix_calls[0][0] == "net.retries" && prefix_calls[0][1] == "net.timeout_ms");
+    }
+    
+    // 值没有变化不通知；取消订阅之后不再回调
+    config.set("qps_limit", (int64_t)10);
+    config.set("net.retries", 3);
+    
+    config.unsubscribe(exact_id);
+    config.set("qps_limit", (int64_t)11);
+    
+    // ConfigKey::set同样会通知
+    ConfigKey<int> retries = config.key<int>("net.retries");
+    retries.set(5);
+    
+    drained = false;
+    queue.post([&]{ drained = true; });
+    while(!drained){
+        TimeUtil::SleepMs(1);
+    }
+    
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        
+        assert(exact_calls.size() == 1);
+        assert(prefix_calls.size() == 2);
+        assert(prefix_calls[1].size() == 1 && prefix_calls[1][0] == "net.retries");
+    }
+}
+
 #endif /* test_global_config_h */
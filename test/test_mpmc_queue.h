@@ -0,0 +1,101 @@
+//
+//  test_mpmc_queue.h
+//
+
+#ifndef test_mpmc_queue_h
+#define test_mpmc_queue_h
+
+#include "mpmc_queue.h"
+#include "data_queue.h"
+#include "time_utils.h"
+#include <assert.h>
+#include <stdio.h>
+#include <vector>
+
+// threads个生产者、threads个消费者，每个生产者投递per_producer个元素，返回耗时（毫秒）
+template<class Queue>
+static int64_t bench_mpmc(Queue& queue, int threads, int64_t per_producer){
+    std::atomic<int64_t> sum(0);
+    std::atomic<int64_t> consumed(0);
+
+    const int64_t total = per_producer * threads;
+
+    int64_t t1 = lazy::TimeUtil::MonoNowMs();
+
+    std::vector<std::thread> consumers;
+    for(int i = 0; i < threads; ++i){
+        consumers.push_back(std::thread([&]{
+            int64_t val = 0;
+            int64_t local = 0;
+            while(queue.pop_front(val)){
+                local += val;
+                if(++consumed == total){
+                    queue.stop();
+                }
+            }
+            sum += local;
+        }));
+    }
+
+    std::vector<std::thread> producers;
+    for(int i = 0; i < threads; ++i){
+        producers.push_back(std::thread([&]{
+            for(int64_t j = 1; j <= per_producer; ++j){
+                queue.push_back(j);
+            }
+        }));
+    }
+
+    for(auto& t : producers){
+        t.join();
+    }
+    for(auto& t : consumers){
+        t.join();
+    }
+
+    int64_t cost = lazy::TimeUtil::MonoNowMs() - t1;
+
+    // 每个元素只被消费一次
+    assert(sum == threads * (per_producer * (per_producer + 1) / 2));
+
+    return cost;
+}
+
+void TestMpmcQueue(){
+    {
+        lazy::MpmcQueue<std::string> queue(3);
+        assert(queue.capacity() == 4);
+
+        for(int i = 0; i < 4; ++i){
+            assert(queue.try_push(std::to_string(i)));
+        }
+        assert(!queue.try_push("overflow"));
+
+        std::string val;
+        for(int i = 0; i < 4; ++i){
+            assert(queue.try_pop(val));
+            assert(val == std::to_string(i));
+        }
+        assert(!queue.try_pop(val));
+
+        queue.try_push("left");
+    }
+
+    const int64_t per_producer = 100000;
+    int thread_nums[] = {1, 2, 4, 8, 16};
+
+    for(int threads : thread_nums){
+        lazy::DataQueue<int64_t> data_queue;
+        data_queue.start();
+        int64_t dq_ms = bench_mpmc(data_queue, threads, per_producer);
+
+        lazy::BlockingMpmcQueue<int64_t> mpmc_queue(4096);
+        mpmc_queue.start();
+        int64_t mq_ms = bench_mpmc(mpmc_queue, threads, per_producer);
+
+        printf("%2d producers + %2d consumers: DataQueue %lld ms, BlockingMpmcQueue %lld ms \n",
+               threads, threads, (long long)dq_ms, (long long)mq_ms);
+    }
+}
+
+#endif /* test_mpmc_queue_h */
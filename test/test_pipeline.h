@@ -0,0 +1,181 @@
+//
+//  test_pipeline.h
+//
+
+#ifndef test_pipeline_h
+#define test_pipeline_h
+
+#include "pipeline.h"
+#include "time_utils.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <atomic>
+
+void TestPipeline(){
+    {
+        // 每一级都保持顺序：多个工作线程、处理时间随机，sink看到的顺序和输入一样
+        lazy::Pipeline<int> pipeline;
+
+        lazy::PipelineStageOptions parallel;
+        parallel.workers = 4;
+        parallel.queue_capacity = 16;
+        parallel.preserve_order = true;
+
+        std::vector<std::string> out;
+
+        pipeline.then("square", [](int x){
+                    if(x % 7 == 0){
+                        lazy::TimeUtil::SleepUs(100);
+                    }
+                    return (int64_t)x * x;
+                }, parallel)
+                .then("format", [](int64_t x){
+                    return std::to_string(x);
+                }, parallel)
+                .sink("collect", [&](std::string s){
+                    out.push_back(s);
+                });
+
+        assert(pipeline.start());
+
+        // 已经启动了
+        assert(!pipeline.start());
+
+        const int count = 2000;
+        for(int i = 0; i < count; ++i){
+            assert(pipeline.push(i));
+        }
+
+        pipeline.stop();
+
+        assert(out.size() == (size_t)count);
+        for(int i = 0; i < count; ++i){
+            assert(out[i] == std::to_string((int64_t)i * i));
+        }
+
+        // stop之后不能写入
+        assert(!pipeline.push(1));
+
+        std::vector<lazy::PipelineStageStats> stats = pipeline.stats();
+        assert(stats.size() == 3);
+        for(const lazy::PipelineStageStats& s : stats){
+            assert(s.processed == (uint64_t)count);
+        }
+    }
+
+    {
+        // 不保持顺序：数据一个不少
+        lazy::Pipeline<int> pipeline;
+
+        lazy::PipelineStageOptions parallel;
+        parallel.workers = 3;
+
+        std::atomic<int64_t> sum(0);
+        std::atomic<int> received(0);
+
+        pipeline.then("double", [](int x){ return x * 2; }, parallel)
+                .sink("sum", [&](int x){
+                    sum += x;
+                    ++received;
+                }, parallel);
+
+        // 最后一级不是sink时不能启动
+        lazy::Pipeline<int> incomplete;
+        incomplete.then("noop", [](int x){ return x; });
+        assert(!incomplete.start());
+
+        assert(pipeline.start());
+
+        for(int i = 1; i <= 1000; ++i){
+            pipeline.push(i);
+        }
+
+        pipeline.stop();
+
+        assert(received == 1000);
+        assert(sum == 1000 * 1001);
+    }
+
+    {
+        // 背压：最后一级很慢，前面的队列不会超过容量，瓶颈是最后一级
+        lazy::Pipeline<int> pipeline;
+
+        lazy::PipelineStageOptions small;
+        small.queue_capacity = 4;
+
+        size_t max_depth = 0;
+
+        pipeline.then("fast", [](int x){ return x; }, small)
+                .sink("slow", [&](int x){
+                    (void)x;
+                    lazy::TimeUtil::SleepUs(500);
+                }, small);
+
+        pipeline.start();
+
+        for(int i = 0; i < 200; ++i){
+            pipeline.push(i);
+
+            for(const lazy::PipelineStageStats& s : pipeline.stats()){
+                max_depth = std::max(max_depth, s.queue_depth);
+            }
+        }
+
+        std::vector<lazy::PipelineStageStats> stats = pipeline.stats();
+
+        assert(max_depth <= 4);
+        assert(pipeline.bottleneck() == "slow");
+        assert(stats[0].blocked_us > 0);
+
+        for(const lazy::PipelineStageStats& s : stats){
+            printf("stage %s: workers %zu, processed %llu, avg %llu us, depth %zu/%zu, blocked %llu us, utilization %.2f, %.0f/s \n",
+                   s.name.c_str(), s.workers, (unsigned long long)s.processed, (unsigned long long)s.avg_latency_us,
+                   s.queue_depth, s.queue_capacity, (unsigned long long)s.blocked_us, s.utilization, s.throughput);
+        }
+
+        pipeline.stop();
+    }
+
+    {
+        // abort：丢掉剩下的数据，立即退出
+        lazy::Pipeline<int> pipeline;
+
+        std::atomic<int> received(0);
+
+        lazy::PipelineStageOptions ordered;
+        ordered.workers = 2;
+        ordered.queue_capacity = 8;
+        ordered.preserve_order = true;
+
+        pipeline.then("pass", [](int x){ return x; }, ordered)
+                .sink("slow", [&](int x){
+                    (void)x;
+                    ++received;
+                    lazy::TimeUtil::SleepMs(10);
+                }, ordered);
+
+        pipeline.start();
+
+        std::thread producer([&]{
+            for(int i = 0; i < 1000; ++i){
+                if(!pipeline.push(i)){
+                    break;
+                }
+            }
+        });
+
+        lazy::TimeUtil::SleepMs(50);
+
+        int64_t t1 = lazy::TimeUtil::MonoNowMs();
+        pipeline.abort();
+        producer.join();
+
+        assert(lazy::TimeUtil::MonoNowMs() - t1 < 1000);
+        assert(received < 1000);
+    }
+}
+
+#endif /* test_pipeline_h */
@@ -0,0 +1,237 @@
+//
+//  test_priority_data_queue.h
+//
+
+#ifndef test_priority_data_queue_h
+#define test_priority_data_queue_h
+
+#include "priority_data_queue.h"
+#include "time_utils.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <queue>
+#include <vector>
+#include <string>
+#include <atomic>
+
+// 随机的push/pop序列，返回耗时（毫秒）
+template<class Heap>
+static int64_t bench_heap(Heap& heap, const std::vector<int>& values){
+    int64_t t1 = lazy::TimeUtil::MonoNowMs();
+
+    int64_t sum = 0;
+
+    for(size_t i = 0; i < values.size(); ++i){
+        heap.push(values[i]);
+
+        // 保持堆中有一半左右的数据
+        if(i % 2 == 1){
+            sum += heap.top();
+            heap.pop();
+        }
+    }
+
+    while(!heap.empty()){
+        sum += heap.top();
+        heap.pop();
+    }
+
+    assert(sum != 0);
+
+    return lazy::TimeUtil::MonoNowMs() - t1;
+}
+
+void TestPriorityDataQueue(){
+    {
+        // 和std::priority_queue的结果一致
+        lazy::DaryHeap<int> heap;
+        std::priority_queue<int> expected;
+
+        for(int i = 0; i < 10000; ++i){
+            int v = rand() % 1000;
+            heap.push(v);
+            expected.push(v);
+
+            if(rand() % 3 == 0){
+                assert(heap.top() == expected.top());
+                heap.pop();
+                expected.pop();
+            }
+        }
+
+        while(!expected.empty()){
+            int v = 0;
+            heap.pop(v);
+            assert(v == expected.top());
+            expected.pop();
+        }
+        assert(heap.empty());
+    }
+
+    {
+        // 小的先出
+        lazy::PriorityDataQueue<int, std::greater<int>> queue;
+        queue.start();
+
+        int values[] = {5, 1, 4, 2, 3};
+        for(int v : values){
+            queue.push_back(v);
+        }
+
+        int val = 0;
+        assert(queue.front(val) && val == 1);
+        for(int i = 1; i <= 5; ++i){
+            assert(queue.pop_front(val) && val == i);
+        }
+
+        assert(!queue.try_pop(val));
+        assert(!queue.pop_for(val, std::chrono::milliseconds(10)));
+
+        // 等待期间有数据写入
+        std::thread producer([&]{
+            lazy::TimeUtil::SleepMs(10);
+            queue.push_back(7);
+        });
+        assert(queue.pop_front(val) && val == 7);
+        producer.join();
+
+        // front的等待者和pop的等待者同时存在时，都能被唤醒
+        std::atomic<int> done(0);
+
+        std::thread front_waiter([&]{
+            int v = 0;
+            assert(queue.front(v));
+            ++done;
+        });
+
+        // front的等待者先开始等待，只写入一个元素时notify_one会唤醒它
+        lazy::TimeUtil::SleepMs(10);
+
+        std::thread pop_waiter([&]{
+            int v = 0;
+            assert(queue.pop_for(v, std::chrono::seconds(2)));
+            ++done;
+        });
+
+        lazy::TimeUtil::SleepMs(20);
+        queue.push_back(1);
+        pop_waiter.join();
+
+        // pop的等待者可能先取走了第一个，front的等待者看到的是第二个
+        queue.push_back(2);
+        front_waiter.join();
+
+        assert(done == 2);
+        assert(queue.pop_front(val));
+        assert(queue.empty());
+
+        // stop唤醒等待的消费者
+        std::thread stopper([&]{
+            lazy::TimeUtil::SleepMs(10);
+            queue.stop();
+        });
+        assert(!queue.pop_front(val));
+        stopper.join();
+    }
+
+    {
+        lazy::DelayQueue<std::string> queue;
+        queue.start();
+
+        queue.push_back("c", std::chrono::milliseconds(30));
+        queue.push_back("a", std::chrono::milliseconds(10));
+        queue.push_back("b", std::chrono::milliseconds(10));
+
+        std::string val;
+        assert(!queue.try_pop(val));
+        assert(queue.size() == 3);
+
+        // 按就绪时间出队，就绪时间相同时先进先出
+        int64_t t1 = lazy::TimeUtil::MonoNowMs();
+        assert(queue.pop_front(val) && val == "a");
+        assert(lazy::TimeUtil::MonoNowMs() - t1 >= 9);
+        assert(queue.pop_front(val) && val == "b");
+        assert(queue.pop_front(val) && val == "c");
+        assert(lazy::TimeUtil::MonoNowMs() - t1 >= 29);
+
+        // 超时之前没有元素就绪
+        queue.push_back("late", std::chrono::seconds(10));
+        assert(!queue.pop_for(val, std::chrono::milliseconds(10)));
+
+        // 等待期间写入了更早就绪的元素
+        std::thread producer([&]{
+            lazy::TimeUtil::SleepMs(10);
+            queue.push_back("early", std::chrono::milliseconds(10));
+        });
+        t1 = lazy::TimeUtil::MonoNowMs();
+        assert(queue.pop_front(val) && val == "early");
+        assert(lazy::TimeUtil::MonoNowMs() - t1 < 5000);
+        producer.join();
+
+        queue.stop();
+        assert(!queue.pop_front(val));
+    }
+
+    {
+        // 多个消费者：每个元素只被取出一次，并且不会早于就绪时间
+        lazy::DelayQueue<int64_t> queue;
+        queue.start();
+
+        const int count = 200;
+        std::atomic<int> received(0);
+        std::atomic<int64_t> max_late_us(0);
+
+        std::vector<std::thread> consumers;
+        for(int i = 0; i < 4; ++i){
+            consumers.push_back(std::thread([&]{
+                int64_t ready_us = 0;
+                while(queue.pop_front(ready_us)){
+                    int64_t late_us = lazy::TimeUtil::MonoNowUs() - ready_us;
+                    assert(late_us >= 0);
+
+                    int64_t cur = max_late_us;
+                    while(late_us > cur && !max_late_us.compare_exchange_weak(cur, late_us)){
+                    }
+
+                    if(++received == count){
+                        queue.stop();
+                    }
+                }
+            }));
+        }
+
+        for(int i = 0; i < count; ++i){
+            int64_t delay_us = (rand() % 50) * 1000;
+            auto ready_time = lazy::DelayQueue<int64_t>::Clock::now() + std::chrono::microseconds(delay_us);
+            int64_t ready_us = std::chrono::duration_cast<std::chrono::microseconds>(ready_time.time_since_epoch()).count();
+            queue.push_back_at(ready_us, ready_time);
+        }
+
+        for(auto& t : consumers){
+            t.join();
+        }
+
+        assert(received == count);
+
+        printf("DelayQueue %d items, 4 consumers: max lateness %lld us \n", count, (long long)max_late_us.load());
+    }
+
+    std::vector<int> values;
+    for(int i = 0; i < 2000000; ++i){
+        values.push_back(rand());
+    }
+
+    lazy::DaryHeap<int, std::less<int>, 2> binary_heap;
+    lazy::DaryHeap<int, std::less<int>, 4> dary_heap;
+    std::priority_queue<int> std_heap;
+
+    int64_t std_ms = bench_heap(std_heap, values);
+    int64_t binary_ms = bench_heap(binary_heap, values);
+    int64_t dary_ms = bench_heap(dary_heap, values);
+
+    printf("heap %zu push + pop: std::priority_queue %lld ms, DaryHeap<2> %lld ms, DaryHeap<4> %lld ms \n",
+           values.size(), (long long)std_ms, (long long)binary_ms, (long long)dary_ms);
+}
+
+#endif /* test_priority_data_queue_h */
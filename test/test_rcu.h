@@ -0,0 +1,120 @@
+//
+//  test_rcu.h
+//
+
+#ifndef test_rcu_h
+#define test_rcu_h
+
+#include "rcu.h"
+#include "time_utils.h"
+#include <assert.h>
+#include <stdio.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+
+struct RcuValue {
+    explicit RcuValue(int64_t v) : value(v), alive(true) {
+    }
+
+    ~RcuValue() {
+        alive = false;
+    }
+
+    int64_t value;
+    bool alive;
+};
+
+void TestRcu(){
+    {
+        // synchronize等待已经在临界区里的读者
+        lazy::RcuDomain rcu(4);
+
+        std::atomic<bool> entered(false);
+        std::atomic<bool> leave(false);
+
+        std::thread reader([&]{
+            lazy::RcuReadGuard guard(rcu);
+
+            entered = true;
+            while(!leave){
+                lazy::TimeUtil::SleepMs(1);
+            }
+        });
+
+        while(!entered){
+            lazy::TimeUtil::SleepMs(1);
+        }
+
+        std::atomic<bool> synchronized(false);
+
+        std::thread writer([&]{
+            rcu.synchronize();
+            synchronized = true;
+        });
+
+        lazy::TimeUtil::SleepMs(20);
+        assert(!synchronized);
+
+        leave = true;
+        reader.join();
+        writer.join();
+
+        assert(synchronized);
+
+        // 没有读者时立即返回
+        rcu.synchronize();
+    }
+
+    {
+        // 读者一直在读，写者不停地替换、释放：读到的对象一定还没有被释放
+        lazy::RcuDomain rcu;
+
+        std::atomic<RcuValue*> current(new RcuValue(0));
+        std::atomic<bool> stop(false);
+        std::atomic<uint64_t> reads(0);
+
+        std::vector<std::thread> readers;
+        for(int i = 0; i < 4; ++i){
+            readers.push_back(std::thread([&]{
+                int64_t last = 0;
+                while(!stop){
+                    lazy::RcuReadGuard guard(rcu);
+
+                    RcuValue* v = current.load();
+                    assert(v->alive);
+                    assert(v->value >= last);
+                    last = v->value;
+
+                    ++reads;
+                }
+            }));
+        }
+
+        for(int64_t i = 1; i <= 2000; ++i){
+            RcuValue* old = current.load();
+            current.store(new RcuValue(i));
+
+            rcu.synchronize();
+
+            delete old;
+
+            // 让读者有机会在替换的过程中读
+            if(i % 50 == 0){
+                lazy::TimeUtil::SleepMs(1);
+            }
+        }
+
+        stop = true;
+        for(auto& t : readers){
+            t.join();
+        }
+
+        assert(current.load()->value == 2000);
+        delete current.load();
+
+        printf("Rcu 2000 updates, %llu reads \n", (unsigned long long)reads.load());
+    }
+}
+
+#endif /* test_rcu_h */
@@ -0,0 +1,178 @@
+//
+//  test_reactor_task_queue.h
+//
+
+#ifndef test_reactor_task_queue_h
+#define test_reactor_task_queue_h
+
+#include "reactor_task_queue.h"
+#include <assert.h>
+#include <stdio.h>
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#endif
+
+void TestReactorTaskQueue(){
+#if defined(__linux__)
+    lazy::ReactorTaskQueue reactor;
+
+    reactor.set_name("reactor");
+
+    reactor.start();
+
+    // 投递的任务按顺序执行
+    std::vector<int> order;
+    for(int i = 0; i < 1000; ++i){
+        reactor.post([&, i]{
+            order.push_back(i);
+        });
+    }
+
+    size_t count = reactor.invoke<size_t>([&]{
+        return order.size();
+    });
+    assert(count == 1000);
+    for(int i = 0; i < 1000; ++i){
+        assert(order[i] == i);
+    }
+
+    // 任务里投递的任务，没有其他事件也会执行
+    std::atomic<bool> nested_done(false);
+    reactor.post([&]{
+        reactor.post([&]{
+            nested_done = true;
+        });
+    });
+
+    int64_t nested_begin_ms = lazy::TimeUtil::MonoNowMs();
+    while(!nested_done){
+        assert(lazy::TimeUtil::MonoNowMs() - nested_begin_ms < 1000);
+        lazy::TimeUtil::SleepMs(1);
+    }
+
+    // 延迟任务由timerfd唤醒
+    std::atomic<int64_t> fired_ms(0);
+    int64_t post_ms = lazy::TimeUtil::MonoNowMs();
+    reactor.post_delayed([&]{
+        fired_ms = lazy::TimeUtil::MonoNowMs();
+    }, 50);
+
+    // 定时器
+    std::atomic<int> timer_count(0);
+    reactor.add_timer([&]{
+        ++timer_count;
+    }, 10, 1);
+
+    // fd的事件和任务在同一个线程上
+    int fds[2];
+    int ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds);
+    assert(ret == 0);
+
+    std::atomic<int> received(0);
+    std::atomic<bool> same_thread(true);
+
+    bool ok = reactor.watch_fd(fds[0], EPOLLIN, [&](int fd, uint32_t /*events*/){
+        if(!reactor.is_current()){
+            same_thread = false;
+        }
+
+        char buf[256];
+        while(true){
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if(n <= 0){
+                break;
+            }
+            received += (int)n;
+        }
+    });
+    assert(ok);
+
+    std::thread writer([&]{
+        for(int i = 0; i < 100; ++i){
+            ssize_t n = write(fds[1], "x", 1);
+            (void)n;
+            lazy::TimeUtil::SleepMs(1);
+        }
+    });
+    writer.join();
+
+    while(received < 100){
+        lazy::TimeUtil::SleepMs(1);
+    }
+
+    assert(same_thread);
+
+    ok = reactor.unwatch_fd(fds[0]);
+    assert(ok);
+
+    lazy::TimeUtil::SleepMs(100);
+
+    reactor.remove_timer(1);
+
+    int timer_fired = timer_count;
+    lazy::TimeUtil::SleepMs(50);
+    assert(timer_count == timer_fired);
+
+    printf("delayed task fired after %lld ms, timer fired %d times \n",
+           (long long)(fired_ms - post_ms), timer_fired);
+
+    assert(fired_ms - post_ms >= 50);
+    assert(timer_fired > 0);
+
+    // fd没有unwatch_fd就关闭了，编号被新的fd复用之后仍然可以监听
+    int old_fds[2];
+    ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, old_fds);
+    assert(ret == 0);
+
+    ok = reactor.watch_fd(old_fds[0], EPOLLIN, [](int, uint32_t){
+        assert(false);
+    });
+    assert(ok);
+
+    int reused = old_fds[0];
+    close(old_fds[0]);
+    close(old_fds[1]);
+
+    int new_fds[2];
+    ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, new_fds);
+    assert(ret == 0);
+
+    // 保证编号相同
+    if(new_fds[0] != reused){
+        ret = dup2(new_fds[0], reused);
+        assert(ret == reused);
+        close(new_fds[0]);
+        new_fds[0] = reused;
+    }
+
+    std::atomic<int> reused_received(0);
+    ok = reactor.watch_fd(reused, EPOLLIN, [&](int fd, uint32_t /*events*/){
+        char buf[16];
+        while(read(fd, buf, sizeof(buf)) > 0){
+            ++reused_received;
+        }
+    });
+    assert(ok);
+
+    ssize_t n = write(new_fds[1], "y", 1);
+    (void)n;
+
+    while(reused_received == 0){
+        lazy::TimeUtil::SleepMs(1);
+    }
+
+    ok = reactor.unwatch_fd(reused);
+    assert(ok);
+
+    close(new_fds[0]);
+    close(new_fds[1]);
+
+    reactor.stop();
+
+    close(fds[0]);
+    close(fds[1]);
+#endif
+}
+
+#endif /* test_reactor_task_queue_h */
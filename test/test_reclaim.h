@@ -0,0 +1,297 @@
+//
+//  test_reclaim.h
+//
+
+#ifndef test_reclaim_h
+#define test_reclaim_h
+
+#include "reclaim.h"
+#include "time_utils.h"
+#include <assert.h>
+#include <stdio.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+
+// 被释放时检查是否还有人在用
+struct ReclaimNode {
+    explicit ReclaimNode(int v) : value(v), next(nullptr) {
+    }
+
+    ~ReclaimNode() {
+        value = -1;
+        ++freed;
+    }
+
+    int value;
+    ReclaimNode* next;
+
+    static std::atomic<int64_t> freed;
+};
+
+std::atomic<int64_t> ReclaimNode::freed(0);
+
+// 基于EpochDomain的无锁栈
+class EpochStack {
+public:
+    EpochStack() : head_(nullptr) {
+    }
+
+    ~EpochStack() {
+        ReclaimNode* node = head_.load();
+        while(node){
+            ReclaimNode* next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+
+    void push(int value) {
+        ReclaimNode* node = new ReclaimNode(value);
+        node->next = head_.load();
+        while(!head_.compare_exchange_weak(node->next, node)){
+        }
+    }
+
+    bool pop(lazy::EpochDomain::Handle& handle, int& value) {
+        lazy::EpochDomain::Guard guard(handle);
+
+        ReclaimNode* node = head_.load();
+        // 在临界区内node不会被释放，读node->next是安全的，也不会有ABA
+        while(node && !head_.compare_exchange_weak(node, node->next)){
+        }
+
+        if(!node){
+            return false;
+        }
+
+        value = node->value;
+        assert(value >= 0);
+
+        handle.retire(node);
+
+        return true;
+    }
+
+private:
+    std::atomic<ReclaimNode*> head_;
+};
+
+// 基于HazardPointerDomain的无锁栈
+class HazardStack {
+public:
+    HazardStack() : head_(nullptr) {
+    }
+
+    ~HazardStack() {
+        ReclaimNode* node = head_.load();
+        while(node){
+            ReclaimNode* next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+
+    void push(int value) {
+        ReclaimNode* node = new ReclaimNode(value);
+        node->next = head_.load();
+        while(!head_.compare_exchange_weak(node->next, node)){
+        }
+    }
+
+    bool pop(lazy::HazardPointerDomain::Handle& handle, int& value) {
+        ReclaimNode* node = nullptr;
+
+        while(true){
+            node = handle.protect(0, head_);
+            if(!node){
+                break;
+            }
+
+            // 被保护之后node不会被释放，也不会被复用，读node->next是安全的
+            if(head_.compare_exchange_strong(node, node->next)){
+                break;
+            }
+        }
+
+        handle.clear(0);
+
+        if(!node){
+            return false;
+        }
+
+        value = node->value;
+        assert(value >= 0);
+
+        handle.retire(node);
+
+        return true;
+    }
+
+private:
+    std::atomic<ReclaimNode*> head_;
+};
+
+void TestReclaim(){
+    {
+        // 临界区内的线程会挡住释放，离开之后才释放
+        lazy::EpochDomain domain(4);
+
+        ReclaimNode* node = new ReclaimNode(1);
+
+        std::atomic<bool> entered(false);
+        std::atomic<bool> leave(false);
+
+        std::thread reader([&]{
+            lazy::EpochDomain::Handle handle(domain);
+            lazy::EpochDomain::Guard guard(handle);
+
+            entered = true;
+            while(!leave){
+                // 一直能访问
+                assert(node->value == 1);
+                lazy::TimeUtil::SleepUs(100);
+            }
+        });
+
+        while(!entered){
+            lazy::TimeUtil::SleepUs(100);
+        }
+
+        int64_t freed = ReclaimNode::freed;
+
+        {
+            lazy::EpochDomain::Handle handle(domain);
+            handle.retire(node);
+
+            for(int i = 0; i < 10; ++i){
+                handle.flush();
+            }
+
+            assert(ReclaimNode::freed == freed);
+            assert(handle.pending() == 1);
+
+            leave = true;
+            reader.join();
+
+            handle.flush();
+
+            assert(ReclaimNode::freed == freed + 1);
+            assert(handle.pending() == 0);
+        }
+
+        assert(domain.retired() == 1);
+        assert(domain.reclaimed() == 1);
+    }
+
+    {
+        // 风险指针只挡住被保护的对象
+        lazy::HazardPointerDomain domain(1, 2);
+
+        std::atomic<ReclaimNode*> src(new ReclaimNode(1));
+        ReclaimNode* other = new ReclaimNode(2);
+
+        int64_t freed = ReclaimNode::freed;
+
+        lazy::HazardPointerDomain::Handle reader(domain);
+        ReclaimNode* protected_node = reader.protect(0, src);
+
+        {
+            lazy::HazardPointerDomain::Handle writer(domain);
+
+            src.store(nullptr);
+            writer.retire(protected_node);
+            writer.retire(other);
+            writer.flush();
+
+            assert(ReclaimNode::freed == freed + 1);
+            assert(protected_node->value == 1);
+            assert(writer.pending() == 1);
+
+            reader.clear(0);
+            writer.flush();
+
+            assert(ReclaimNode::freed == freed + 2);
+        }
+    }
+
+    {
+        // 多线程压测：所有的节点最后都被释放，没有泄漏，也没有释放之后访问
+        const int threads = 4;
+        const int count = 50000;
+
+        int64_t freed = ReclaimNode::freed;
+
+        int64_t epoch_ms = 0;
+        int64_t hazard_ms = 0;
+
+        {
+            lazy::EpochDomain domain;
+            EpochStack stack;
+
+            std::atomic<int64_t> popped(0);
+
+            int64_t t1 = lazy::TimeUtil::MonoNowMs();
+
+            std::vector<std::thread> workers;
+            for(int i = 0; i < threads; ++i){
+                workers.push_back(std::thread([&]{
+                    lazy::EpochDomain::Handle handle(domain);
+
+                    int value = 0;
+                    for(int n = 0; n < count; ++n){
+                        stack.push(n);
+                        if(stack.pop(handle, value)){
+                            ++popped;
+                        }
+                    }
+                }));
+            }
+
+            for(auto& t : workers){
+                t.join();
+            }
+
+            epoch_ms = lazy::TimeUtil::MonoNowMs() - t1;
+
+            assert(domain.retired() == (uint64_t)popped);
+        }
+
+        assert(ReclaimNode::freed == freed + threads * count);
+
+        freed = ReclaimNode::freed;
+
+        {
+            lazy::HazardPointerDomain domain;
+            HazardStack stack;
+
+            int64_t t1 = lazy::TimeUtil::MonoNowMs();
+
+            std::vector<std::thread> workers;
+            for(int i = 0; i < threads; ++i){
+                workers.push_back(std::thread([&]{
+                    lazy::HazardPointerDomain::Handle handle(domain);
+
+                    int value = 0;
+                    for(int n = 0; n < count; ++n){
+                        stack.push(n);
+                        stack.pop(handle, value);
+                    }
+                }));
+            }
+
+            for(auto& t : workers){
+                t.join();
+            }
+
+            hazard_ms = lazy::TimeUtil::MonoNowMs() - t1;
+        }
+
+        assert(ReclaimNode::freed == freed + threads * count);
+
+        printf("Reclaim %d threads x %d push/pop: epoch %lld ms, hazard pointer %lld ms \n",
+               threads, count, (long long)epoch_ms, (long long)hazard_ms);
+    }
+}
+
+#endif /* test_reclaim_h */
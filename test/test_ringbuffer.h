@@ -0,0 +1,185 @@
+//
+//  test_ringbuffer.h
+//
+
+#ifndef test_ringbuffer_h
+#define test_ringbuffer_h
+
+#include "ring_buffer.h"
+#include "data_queue.h"
+#include "time_utils.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// 一个生产者、一个消费者传递count个元素，返回耗时（毫秒）
+static int64_t bench_data_queue_spsc(int64_t count){
+    lazy::DataQueue<int64_t> data_queue;
+    data_queue.start();
+
+    int64_t t1 = lazy::TimeUtil::MonoNowMs();
+
+    std::thread consumer([&]{
+        int64_t val = 0;
+        for(int64_t i = 0; i < count; ++i){
+            data_queue.pop_front(val);
+            assert(val == i);
+        }
+    });
+
+    for(int64_t i = 0; i < count; ++i){
+        data_queue.push_back(i);
+    }
+
+    consumer.join();
+
+    return lazy::TimeUtil::MonoNowMs() - t1;
+}
+
+static int64_t bench_ringbuffer_spsc(int64_t count){
+    lazy::BlockingSpscRingBuffer<int64_t> ring(1024);
+    ring.start();
+
+    int64_t t1 = lazy::TimeUtil::MonoNowMs();
+
+    std::thread consumer([&]{
+        int64_t val = 0;
+        for(int64_t i = 0; i < count; ++i){
+            ring.pop_front(val);
+            assert(val == i);
+        }
+    });
+
+    for(int64_t i = 0; i < count; ++i){
+        ring.push_back(i);
+    }
+
+    consumer.join();
+
+    return lazy::TimeUtil::MonoNowMs() - t1;
+}
+
+static int64_t bench_ringbuffer_spsc_bulk(int64_t count){
+    lazy::SpscRingBuffer<int64_t> ring(1024);
+
+    const size_t batch = 64;
+
+    int64_t t1 = lazy::TimeUtil::MonoNowMs();
+
+    std::thread consumer([&]{
+        int64_t buf[batch];
+        int64_t expected = 0;
+        while(expected < count){
+            size_t n = ring.pop_n(buf, batch);
+            for(size_t i = 0; i < n; ++i){
+                assert(buf[i] == expected);
+                ++expected;
+            }
+            if(n == 0){
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    int64_t buf[batch];
+    int64_t next = 0;
+    while(next < count){
+        size_t n = 0;
+        while(n < batch && next + (int64_t)n < count){
+            buf[n] = next + n;
+            ++n;
+        }
+
+        size_t pushed = ring.push_n(buf, n);
+        next += pushed;
+
+        if(pushed == 0){
+            std::this_thread::yield();
+        }
+    }
+
+    consumer.join();
+
+    return lazy::TimeUtil::MonoNowMs() - t1;
+}
+
+void TestRingbuffer(){
+    {
+        // 容量向上取整到2的幂
+        lazy::SpscRingBuffer<std::string> ring(5);
+        assert(ring.capacity() == 8);
+
+        for(int i = 0; i < 8; ++i){
+            assert(ring.push(std::to_string(i)));
+        }
+        assert(ring.full());
+        assert(!ring.push("overflow"));
+
+        std::string val;
+        for(int i = 0; i < 8; ++i){
+            assert(ring.pop(val));
+            assert(val == std::to_string(i));
+        }
+        assert(ring.empty());
+        assert(!ring.pop(val));
+
+        // 析构时释放剩余的元素
+        ring.push("left");
+    }
+
+    {
+        lazy::SpscRingBuffer<int> ring(16);
+        std::vector<int> in(20), out(20);
+        for(int i = 0; i < 20; ++i){
+            in[i] = i;
+        }
+
+        assert(ring.push_n(in.data(), in.size()) == 16);
+        assert(ring.pop_n(out.data(), 10) == 10);
+        assert(ring.push_n(in.data() + 16, 4) == 4);
+        assert(ring.pop_n(out.data() + 10, 20) == 10);
+
+        for(int i = 0; i < 20; ++i){
+            assert(out[i] == i);
+        }
+    }
+
+    {
+        // stop之后pop_front返回false
+        lazy::BlockingSpscRingBuffer<int> ring(4);
+        ring.start();
+
+        std::thread consumer([&]{
+            int val = 0;
+            int count = 0;
+            while(ring.pop_front(val)){
+                assert(val == count);
+                ++count;
+            }
+            assert(count <= 10000);
+        });
+
+        for(int i = 0; i < 10000; ++i){
+            ring.push_back(i);
+        }
+
+        while(!ring.empty()){
+            lazy::TimeUtil::SleepMs(1);
+        }
+
+        ring.stop();
+        consumer.join();
+    }
+
+    const int64_t count = 1000000;
+
+    int64_t dq_ms = bench_data_queue_spsc(count);
+    int64_t rb_ms = bench_ringbuffer_spsc(count);
+    int64_t bulk_ms = bench_ringbuffer_spsc_bulk(count);
+
+    printf("spsc %lld items: DataQueue %lld ms, BlockingSpscRingBuffer %lld ms, SpscRingBuffer push_n/pop_n %lld ms \n",
+           (long long)count, (long long)dq_ms, (long long)rb_ms, (long long)bulk_ms);
+}
+
+#endif /* test_ringbuffer_h */
@@ -0,0 +1,196 @@
+//
+//  test_rw_lock.h
+//
+
+#ifndef test_rw_lock_h
+#define test_rw_lock_h
+
+#include "rw_lock.h"
+#include "time_utils.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <thread>
+#include <mutex>
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
+
+// threads个读者在表里查找duration_ms毫秒，同时一个写者每毫秒修改一次，返回查找的总次数
+template<class ReadLock, class ReadUnlock, class WriteLock, class WriteUnlock>
+static uint64_t bench_table_reads(std::unordered_map<int, int>& table, int threads, int duration_ms,
+                                  ReadLock read_lock, ReadUnlock read_unlock,
+                                  WriteLock write_lock, WriteUnlock write_unlock){
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> total(0);
+
+    std::vector<std::thread> readers;
+    for(int i = 0; i < threads; ++i){
+        readers.push_back(std::thread([&, i]{
+            uint64_t count = 0;
+            int key = i;
+            while(!stop.load(std::memory_order_relaxed)){
+                read_lock();
+                auto it = table.find(key);
+                assert(it != table.end());
+                (void)it;
+                read_unlock();
+
+                key = (key + 7) & 1023;
+                ++count;
+            }
+            total += count;
+        }));
+    }
+
+    std::thread writer([&]{
+        int value = 0;
+        while(!stop){
+            write_lock();
+            table[value & 1023] = value;
+            write_unlock();
+
+            ++value;
+            lazy::TimeUtil::SleepMs(1);
+        }
+    });
+
+    lazy::TimeUtil::SleepMs(duration_ms);
+    stop = true;
+
+    for(auto& t : readers){
+        t.join();
+    }
+    writer.join();
+
+    return total;
+}
+
+void TestRWLock(){
+    {
+        lazy::PerCpuRWLock lock;
+
+        assert(lock.slots() >= 1);
+        assert((lock.slots() & (lock.slots() - 1)) == 0);
+
+        // 读锁可以同时持有多个
+        assert(lock.try_lock_shared());
+        assert(lock.try_lock_shared());
+        assert(!lock.try_lock());
+        lock.unlock_shared();
+        lock.unlock_shared();
+
+        // 写锁排斥读锁和写锁
+        assert(lock.try_lock());
+        assert(!lock.try_lock_shared());
+        assert(!lock.try_lock());
+        lock.unlock();
+
+        {
+            lazy::ReadLockGuard guard(lock);
+        }
+
+        {
+            std::unique_lock<lazy::PerCpuRWLock> guard(lock);
+        }
+    }
+
+    {
+        // 读写并发：写者修改两个变量，读者看到的永远相等；写者之间互斥
+        lazy::PerCpuRWLock lock(4);
+
+        uint64_t a = 0;
+        uint64_t b = 0;
+
+        std::atomic<int> writers_inside(0);
+        std::atomic<int> readers_inside(0);
+        std::atomic<bool> stop(false);
+
+        std::vector<std::thread> threads;
+
+        for(int i = 0; i < 4; ++i){
+            threads.push_back(std::thread([&]{
+                while(!stop){
+                    lazy::ReadLockGuard guard(lock);
+
+                    ++readers_inside;
+                    assert(writers_inside == 0);
+                    assert(a == b);
+                    --readers_inside;
+                }
+            }));
+        }
+
+        for(int i = 0; i < 2; ++i){
+            threads.push_back(std::thread([&]{
+                for(int n = 0; n < 5000; ++n){
+                    std::unique_lock<lazy::PerCpuRWLock> guard(lock);
+
+                    assert(++writers_inside == 1);
+                    assert(readers_inside == 0);
+                    ++a;
+                    ++b;
+                    --writers_inside;
+                }
+            }));
+        }
+
+        threads[4].join();
+        threads[5].join();
+        stop = true;
+        for(int i = 0; i < 4; ++i){
+            threads[i].join();
+        }
+
+        assert(a == 10000 && b == 10000);
+    }
+
+    {
+        // 读的吞吐随线程数的变化
+        std::unordered_map<int, int> table;
+        for(int i = 0; i < 1024; ++i){
+            table[i] = i;
+        }
+
+        lazy::PerCpuRWLock rwlock;
+        std::mutex mutex;
+
+#if !defined(_WIN32)
+        pthread_rwlock_t prwlock;
+        pthread_rwlock_init(&prwlock, nullptr);
+#endif
+
+        const int duration_ms = 50;
+
+        for(int threads = 1; threads <= 64; threads *= 2){
+            uint64_t percpu_reads = bench_table_reads(table, threads, duration_ms,
+                [&]{ rwlock.lock_shared(); }, [&]{ rwlock.unlock_shared(); },
+                [&]{ rwlock.lock(); }, [&]{ rwlock.unlock(); });
+
+            uint64_t mutex_reads = bench_table_reads(table, threads, duration_ms,
+                [&]{ mutex.lock(); }, [&]{ mutex.unlock(); },
+                [&]{ mutex.lock(); }, [&]{ mutex.unlock(); });
+
+            uint64_t pthread_reads = 0;
+#if !defined(_WIN32)
+            pthread_reads = bench_table_reads(table, threads, duration_ms,
+                [&]{ pthread_rwlock_rdlock(&prwlock); }, [&]{ pthread_rwlock_unlock(&prwlock); },
+                [&]{ pthread_rwlock_wrlock(&prwlock); }, [&]{ pthread_rwlock_unlock(&prwlock); });
+#endif
+
+            printf("RWLock %2d readers: per-cpu %.1f M/s, mutex %.1f M/s, pthread_rwlock %.1f M/s \n", threads,
+                   percpu_reads / (duration_ms * 1000.0), mutex_reads / (duration_ms * 1000.0),
+                   pthread_reads / (duration_ms * 1000.0));
+        }
+
+#if !defined(_WIN32)
+        pthread_rwlock_destroy(&prwlock);
+#endif
+    }
+}
+
+#endif /* test_rw_lock_h */
@@ -0,0 +1,164 @@
+//
+//  test_segment_queue.h
+//
+
+#ifndef test_segment_queue_h
+#define test_segment_queue_h
+
+#include "segment_queue.h"
+#include "data_queue.h"
+#include "time_utils.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// 一个生产者、一个消费者，队列深度不超过capacity，返回耗时（毫秒）
+template<class Queue>
+static int64_t bench_steady_depth(Queue& data_queue, int64_t count, size_t capacity){
+    data_queue.set_capacity(capacity);
+    data_queue.start();
+    
+    int64_t t1 = lazy::TimeUtil::MonoNowMs();
+    
+    std::thread consumer([&]{
+        int64_t val = 0;
+        for(int64_t i = 0; i < count; ++i){
+            data_queue.pop_front(val);
+            assert(val == i);
+        }
+    });
+    
+    for(int64_t i = 0; i < count; ++i){
+        data_queue.push_back(i);
+    }
+    
+    consumer.join();
+    
+    return lazy::TimeUtil::MonoNowMs() - t1;
+}
+
+void TestSegmentQueue(){
+    typedef lazy::SegmentQueue<std::string, 4> StringQueue;
+    
+    {
+        // 跨越多个段的先进先出
+        StringQueue queue;
+        
+        for(int round = 0; round < 3; ++round){
+            for(int i = 0; i < 10; ++i){
+                queue.push_back(std::to_string(i));
+            }
+            assert(queue.size() == 10);
+            
+            for(int i = 0; i < 10; ++i){
+                assert(queue.front() == std::to_string(i));
+                queue.pop_front();
+            }
+            assert(queue.empty());
+        }
+        
+        // 析构时释放剩余的元素
+        queue.emplace_back("left");
+        
+        StringQueue other;
+        other.swap(queue);
+        assert(queue.empty());
+        assert(other.size() == 1 && other.front() == "left");
+    }
+    
+    {
+        // 深度稳定之后不再分配
+        StringQueue queue;
+        
+        for(int i = 0; i < 20; ++i){
+            queue.push_back(std::to_string(i));
+        }
+        
+        // 预热：头尾错开之后，最多还需要一个段
+        for(int i = 0; i < 4; ++i){
+            queue.pop_front();
+            queue.push_back(std::to_string(i));
+        }
+        
+        uint64_t allocations = StringQueue::total_segment_allocations();
+        
+        for(int i = 0; i < 100000; ++i){
+            queue.pop_front();
+            queue.push_back(std::to_string(i));
+        }
+        
+        assert(StringQueue::total_segment_allocations() == allocations);
+        assert(queue.size() == 20);
+        
+        // 空闲池有上限
+        lazy::SegmentQueue<int, 4> small_pool(2);
+        for(int i = 0; i < 100; ++i){
+            small_pool.push_back(i);
+        }
+        small_pool.clear();
+        assert(small_pool.free_segments() == 2);
+    }
+    
+    {
+        // 作为DataQueue的底层容器：pop_front/pop_all都在复用段
+        typedef lazy::SegmentQueue<int64_t> Segments;
+        
+        lazy::DataQueue<int64_t, Segments> data_queue;
+        data_queue.start();
+        
+        // 预热：pop_all时queue_和内部的另一个缓冲区交换，两个缓冲区都要分配过
+        std::vector<int64_t> out;
+        for(int round = 0; round < 2; ++round){
+            for(int64_t i = 0; i < 1000; ++i){
+                data_queue.push_back(i);
+            }
+            assert(data_queue.try_pop_all(out));
+        }
+        
+        uint64_t allocations = Segments::total_segment_allocations();
+        
+        for(int round = 0; round < 1000; ++round){
+            for(int64_t i = 0; i < 1000; ++i){
+                data_queue.push_back(i);
+            }
+            
+            out.clear();
+            assert(data_queue.try_pop_all(out));
+            assert(out.size() == 1000 && out[999] == 999);
+            
+            for(int64_t i = 0; i < 100; ++i){
+                data_queue.push_back(i);
+            }
+            int64_t val = 0;
+            for(int64_t i = 0; i < 100; ++i){
+                assert(data_queue.try_pop(val) && val == i);
+            }
+        }
+        
+        assert(Segments::total_segment_allocations() == allocations);
+    }
+    
+    const int64_t count = 2000000;
+    const size_t capacity = 256;
+    
+    // 生产者和消费者在两个线程中，队列深度被容量限制住：分配的段数有上限，和传递的元素个数无关
+    typedef lazy::SegmentQueue<int64_t> Segments;
+    
+    uint64_t allocations = Segments::total_segment_allocations();
+    
+    lazy::DataQueue<int64_t> deque_queue;
+    lazy::DataQueue<int64_t, Segments> segment_queue;
+    
+    int64_t deque_ms = bench_steady_depth(deque_queue, count, capacity);
+    int64_t segment_ms = bench_steady_depth(segment_queue, count, capacity);
+    
+    allocations = Segments::total_segment_allocations() - allocations;
+    
+    assert(allocations <= capacity / 64 + 2);
+    
+    printf("steady depth %lld items: DataQueue<std::deque> %lld ms, DataQueue<SegmentQueue> %lld ms, segment allocations %llu \n",
+           (long long)count, (long long)deque_ms, (long long)segment_ms, (unsigned long long)allocations);
+}
+
+#endif /* test_segment_queue_h */
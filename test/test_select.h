@@ -0,0 +1,153 @@
+//
+//  test_select.h
+//
+
+#ifndef test_select_h
+#define test_select_h
+
+#include "select.h"
+#include "data_queue.h"
+#include "event.h"
+#include "time_utils.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+void TestSelect(){
+    {
+        lazy::DataQueue<int> numbers;
+        lazy::DataQueue<std::string> words;
+        lazy::Event event;
+        
+        numbers.start();
+        words.start();
+        
+        lazy::Selector selector;
+        int n = selector.add(numbers);
+        int w = selector.add(words);
+        int e = selector.add(event);
+        
+        // 都没有就绪
+        assert(selector.poll() == -1);
+        
+        int64_t t1 = lazy::TimeUtil::MonoNowMs();
+        assert(selector.wait_for(std::chrono::milliseconds(20)) == -1);
+        assert(lazy::TimeUtil::MonoNowMs() - t1 >= 20);
+        
+        // 等待期间另一个线程写入
+        std::thread producer([&]{
+            lazy::TimeUtil::SleepMs(10);
+            words.push_back("hello");
+            lazy::TimeUtil::SleepMs(10);
+            event.wake_up();
+            lazy::TimeUtil::SleepMs(10);
+            numbers.push_back(1);
+        });
+        
+        std::string word;
+        int number = 0;
+        
+        assert(selector.wait() == w);
+        assert(words.try_pop(word) && word == "hello");
+        
+        assert(selector.wait() == e);
+        assert(event.is_set());
+        event.wait();
+        assert(!event.is_set());
+        
+        assert(selector.wait() == n);
+        assert(numbers.try_pop(number) && number == 1);
+        
+        producer.join();
+        
+        // 多个数据源同时就绪时轮流返回
+        for(int i = 0; i < 10; ++i){
+            numbers.push_back(i);
+            words.push_back(std::to_string(i));
+        }
+        
+        int from_numbers = 0;
+        int from_words = 0;
+        for(int i = 0; i < 10; ++i){
+            int index = selector.wait();
+            if(index == n){
+                assert(numbers.try_pop(number));
+                ++from_numbers;
+            }
+            else {
+                assert(index == w);
+                assert(words.try_pop(word));
+                ++from_words;
+            }
+        }
+        assert(from_numbers == 5 && from_words == 5);
+        
+        // stop了的DataQueue一直就绪，remove之后不再等待它
+        std::vector<int> rest;
+        numbers.try_pop_all(rest);
+        words.stop();
+        
+        int index = selector.wait();
+        assert(index == w);
+        assert(!words.try_pop(word));
+        selector.remove(w);
+        
+        assert(selector.poll() == -1);
+        
+        selector.remove(n);
+        selector.remove(e);
+        assert(selector.wait() == -1);
+    }
+    
+    {
+        // 一个线程同时服务多个队列：没有轮询，每条数据都被取出
+        const int queue_num = 8;
+        const int per_queue = 20000;
+        
+        std::vector<std::unique_ptr<lazy::DataQueue<int>>> queues;
+        lazy::Selector selector;
+        
+        for(int i = 0; i < queue_num; ++i){
+            queues.push_back(std::unique_ptr<lazy::DataQueue<int>>(new lazy::DataQueue<int>()));
+            queues[i]->start();
+            assert(selector.add(*queues[i]) == i);
+        }
+        
+        int64_t t1 = lazy::TimeUtil::MonoNowMs();
+        
+        std::vector<std::thread> producers;
+        for(int i = 0; i < queue_num; ++i){
+            lazy::DataQueue<int>* queue = queues[i].get();
+            producers.push_back(std::thread([queue]{
+                for(int j = 0; j < per_queue; ++j){
+                    queue->push_back(j);
+                }
+            }));
+        }
+        
+        int64_t received = 0;
+        int64_t wakeups = 0;
+        std::vector<int> batch;
+        
+        while(received < (int64_t)queue_num * per_queue){
+            int index = selector.wait();
+            ++wakeups;
+            
+            batch.clear();
+            if(queues[index]->try_pop_all(batch)){
+                received += batch.size();
+            }
+        }
+        
+        for(auto& t : producers){
+            t.join();
+        }
+        
+        printf("select over %d queues: %lld items, %lld wakeups, cost %lld ms \n",
+               queue_num, (long long)received, (long long)wakeups,
+               (long long)(lazy::TimeUtil::MonoNowMs() - t1));
+    }
+}
+
+#endif /* test_select_h */
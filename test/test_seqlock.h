@@ -0,0 +1,161 @@
+//
+//  test_seqlock.h
+//
+
+#ifndef test_seqlock_h
+#define test_seqlock_h
+
+#include "seqlock.h"
+#include "time_utils.h"
+#include <assert.h>
+#include <stdio.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+
+struct SeqLockRoute {
+    uint64_t version;
+    uint32_t ip;
+    uint16_t port;
+    uint16_t weight;
+    // 和version保持一致，用来检查是否读到了撕裂的数据
+    uint64_t check;
+};
+
+// threads个读者读duration_ms毫秒，同时一个写者每毫秒写一次，返回读的总次数
+template<class Read, class Write>
+static uint64_t bench_snapshot_reads(int threads, int duration_ms, Read read, Write write){
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> total(0);
+
+    std::vector<std::thread> readers;
+    for(int i = 0; i < threads; ++i){
+        readers.push_back(std::thread([&]{
+            uint64_t count = 0;
+            while(!stop.load(std::memory_order_relaxed)){
+                SeqLockRoute r = read();
+                assert(r.check == r.version * 3);
+                (void)r;
+                ++count;
+            }
+            total += count;
+        }));
+    }
+
+    std::thread writer([&]{
+        uint64_t version = 0;
+        while(!stop){
+            ++version;
+            SeqLockRoute r = {version, (uint32_t)version, 80, 1, version * 3};
+            write(r);
+            lazy::TimeUtil::SleepMs(1);
+        }
+    });
+
+    lazy::TimeUtil::SleepMs(duration_ms);
+    stop = true;
+
+    for(auto& t : readers){
+        t.join();
+    }
+    writer.join();
+
+    return total;
+}
+
+void TestSeqLock(){
+    {
+        SeqLockRoute init = {0, 0, 0, 0, 0};
+        lazy::SeqLock<SeqLockRoute> lock(init);
+
+        assert(lock.load().version == 0);
+        assert(lock.sequence() == 0);
+
+        SeqLockRoute r = {1, 0x7f000001, 8080, 10, 3};
+        lock.store(r);
+
+        assert(lock.sequence() == 2);
+
+        SeqLockRoute out;
+        assert(lock.try_load(out));
+        assert(out.ip == 0x7f000001 && out.port == 8080 && out.weight == 10);
+
+        lock.update([](SeqLockRoute& v){
+            v.version = 2;
+            v.check = 6;
+        });
+        assert(lock.load().version == 2);
+        assert(lock.load().port == 8080);
+    }
+
+    {
+        // 读写并发：读到的一定是完整的一份
+        SeqLockRoute init = {0, 0, 0, 0, 0};
+        lazy::SeqLock<SeqLockRoute> lock(init);
+
+        std::atomic<bool> stop(false);
+        std::atomic<uint64_t> reads(0);
+
+        std::vector<std::thread> readers;
+        for(int i = 0; i < 4; ++i){
+            readers.push_back(std::thread([&]{
+                uint64_t last = 0;
+                while(!stop){
+                    SeqLockRoute r = lock.load();
+                    assert(r.check == r.version * 3);
+                    assert(r.ip == (uint32_t)r.version);
+                    // 版本不会倒退
+                    assert(r.version >= last);
+                    last = r.version;
+                    ++reads;
+                }
+            }));
+        }
+
+        for(uint64_t v = 1; v <= 20000; ++v){
+            SeqLockRoute r = {v, (uint32_t)v, 80, 1, v * 3};
+            lock.store(r);
+        }
+
+        stop = true;
+        for(auto& t : readers){
+            t.join();
+        }
+
+        assert(lock.load().version == 20000);
+        assert(reads > 0);
+    }
+
+    {
+        // 读的吞吐随线程数的变化
+        SeqLockRoute init = {0, 0, 0, 0, 0};
+        lazy::SeqLock<SeqLockRoute> seqlock(init);
+
+        std::mutex mutex;
+        SeqLockRoute guarded = init;
+
+        const int duration_ms = 50;
+
+        for(int threads = 1; threads <= 64; threads *= 2){
+            uint64_t seq_reads = bench_snapshot_reads(threads, duration_ms,
+                [&]{ return seqlock.load(); },
+                [&](const SeqLockRoute& r){ seqlock.store(r); });
+
+            uint64_t mutex_reads = bench_snapshot_reads(threads, duration_ms,
+                [&]{
+                    std::unique_lock<std::mutex> lock(mutex);
+                    return guarded;
+                },
+                [&](const SeqLockRoute& r){
+                    std::unique_lock<std::mutex> lock(mutex);
+                    guarded = r;
+                });
+
+            printf("SeqLock %2d readers: seqlock %.1f M/s, mutex %.1f M/s \n", threads,
+                   seq_reads / (duration_ms * 1000.0), mutex_reads / (duration_ms * 1000.0));
+        }
+    }
+}
+
+#endif /* test_seqlock_h */
@@ -0,0 +1,119 @@
+//
+//  test_sharded_executor.h
+//
+
+#ifndef test_sharded_executor_h
+#define test_sharded_executor_h
+
+#include "sharded_executor.h"
+#include <assert.h>
+#include <stdio.h>
+
+void TestShardedExecutor(){
+    const size_t shard_num = 4;
+    const int key_num = 64;
+    const int loop = 1000;
+
+    lazy::ShardedExecutor<int> executor(shard_num);
+
+    executor.set_hot_key_tracking(1, 8);
+
+    executor.start();
+
+    // 每个key的计数只在所在分片的线程上修改，所以不需要加锁
+    std::vector<int> counters(key_num, 0);
+    std::vector<std::thread::id> owners(key_num);
+    std::atomic<int> wrong_thread(0);
+
+    for(int i = 0; i < loop; ++i){
+        for(int key = 0; key < key_num; ++key){
+            executor.post(key, [&, key]{
+                if(owners[key] == std::thread::id()){
+                    owners[key] = std::this_thread::get_id();
+                }
+                else if(owners[key] != std::this_thread::get_id()){
+                    ++wrong_thread;
+                }
+                ++counters[key];
+            });
+        }
+
+        // key 7 是热点key
+        for(int j = 0; j < 8; ++j){
+            executor.post(7, [&]{
+                ++counters[7];
+            });
+        }
+    }
+
+    // 等待所有分片执行完（invoke不保证排在post之后）
+    while(true){
+        uint64_t pending = 0;
+        for(auto& st : executor.stats()){
+            pending += st.pending;
+        }
+        if(pending == 0){
+            break;
+        }
+        lazy::TimeUtil::SleepMs(1);
+    }
+
+    for(int key = 0; key < key_num; ++key){
+        int count = executor.invoke<int>(key, [&, key]{
+            return counters[key];
+        });
+
+        assert(count == (key == 7 ? loop * 9 : loop));
+    }
+
+    assert(wrong_thread == 0);
+
+    // 路由是稳定的：同样配置的另一个执行器算出同样的分片
+    lazy::ShardedExecutor<int> same_config(shard_num);
+    for(int key = 0; key < key_num; ++key){
+        assert(executor.shard_of(key) == same_config.shard_of(key));
+    }
+
+    // shard_of和任务实际执行的线程一致：同一个分片的key在同一个线程上，不同分片的key在不同的线程上
+    for(int a = 0; a < key_num; ++a){
+        for(int b = 0; b < key_num; ++b){
+            assert((executor.shard_of(a) == executor.shard_of(b)) == (owners[a] == owners[b]));
+        }
+    }
+
+    uint64_t total = 0;
+    for(auto& st : executor.stats()){
+        printf("shard %zu posted: %llu executed: %llu pending: %llu \n",
+               st.shard,
+               (unsigned long long)st.posted,
+               (unsigned long long)st.executed,
+               (unsigned long long)st.pending);
+        total += st.posted;
+    }
+    assert(total == (uint64_t)(key_num * loop + 8 * loop + key_num));
+
+    std::vector<lazy::ShardedExecutor<int>::HotKey> hot = executor.hot_keys(0.2);
+    assert(!hot.empty() && hot[0].key == 7);
+
+    printf("hot key: %d count: %llu \n", hot[0].key, (unsigned long long)hot[0].count);
+
+    // 清空之后重新统计，占比按清空之后的投递数计算
+    executor.reset_hot_keys();
+
+    for(int i = 0; i < loop; ++i){
+        executor.post(3, [&]{
+            ++counters[3];
+        });
+    }
+
+    hot = executor.hot_keys(0.9);
+    assert(!hot.empty() && hot[0].key == 3);
+    assert(executor.stats(executor.shard_of(3)).hot_key_window == (uint64_t)loop);
+
+    // 任务引用了counters，执行完再返回
+    while(executor.stats(executor.shard_of(3)).pending > 0){
+        lazy::TimeUtil::SleepMs(1);
+    }
+}
+
+#endif /* test_sharded_executor_h */
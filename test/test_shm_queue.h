@@ -0,0 +1,226 @@
+//
+//  test_shm_queue.h
+//
+
+#ifndef test_shm_queue_h
+#define test_shm_queue_h
+
+#include "shm_queue.h"
+#include "time_utils.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include <string>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+
+struct ShmTestMessage {
+    uint32_t producer;
+    uint32_t seq;
+    char payload[56];
+};
+
+// 子进程用两个线程写入，父进程读出，检查每个生产者的顺序；返回耗时（毫秒）
+static int64_t shm_queue_cross_process(const std::string& name, int per_producer){
+    lazy::ShmQueue<ShmTestMessage>::unlink(name);
+
+    lazy::ShmQueue<ShmTestMessage> queue;
+    bool ok = queue.create(name, 1024);
+    assert(ok);
+
+    int64_t t1 = lazy::TimeUtil::MonoNowMs();
+
+    pid_t pid = fork();
+    if(pid == 0){
+        lazy::ShmQueue<ShmTestMessage> child;
+        if(!child.open(name)){
+            _exit(1);
+        }
+
+        std::vector<std::thread> producers;
+        for(uint32_t p = 0; p < 2; ++p){
+            producers.push_back(std::thread([&child, p, per_producer]{
+                ShmTestMessage msg;
+                memset(&msg, 0, sizeof(msg));
+                msg.producer = p;
+                for(int i = 0; i < per_producer; ++i){
+                    msg.seq = (uint32_t)i;
+                    child.push_back(msg);
+                }
+            }));
+        }
+
+        for(auto& t : producers){
+            t.join();
+        }
+
+        _exit(0);
+    }
+
+    uint32_t next[2] = {0, 0};
+    ShmTestMessage msg;
+    for(int i = 0; i < per_producer * 2; ++i){
+        ok = queue.pop_front(msg);
+        assert(ok);
+        assert(msg.producer < 2 && msg.seq == next[msg.producer]);
+        ++next[msg.producer];
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    int64_t ms = lazy::TimeUtil::MonoNowMs() - t1;
+
+    assert(queue.empty());
+
+    lazy::ShmQueue<ShmTestMessage>::unlink(name);
+
+    return ms;
+}
+
+// 同样大小的消息通过Unix socket传递，作为对比；返回耗时（毫秒）
+static int64_t socket_cross_process(int count){
+    int fds[2];
+    int ret = socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds);
+    assert(ret == 0);
+
+    int64_t t1 = lazy::TimeUtil::MonoNowMs();
+
+    pid_t pid = fork();
+    if(pid == 0){
+        close(fds[0]);
+
+        ShmTestMessage msg;
+        memset(&msg, 0, sizeof(msg));
+        for(int i = 0; i < count; ++i){
+            msg.seq = (uint32_t)i;
+            if(write(fds[1], &msg, sizeof(msg)) != (ssize_t)sizeof(msg)){
+                _exit(1);
+            }
+        }
+
+        _exit(0);
+    }
+
+    close(fds[1]);
+
+    ShmTestMessage msg;
+    for(int i = 0; i < count; ++i){
+        ssize_t n = read(fds[0], &msg, sizeof(msg));
+        assert(n == (ssize_t)sizeof(msg) && msg.seq == (uint32_t)i);
+        (void)n;
+    }
+
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+
+    return lazy::TimeUtil::MonoNowMs() - t1;
+}
+#endif
+
+void TestShmQueue(){
+#if defined(__linux__)
+    const std::string name = "/lazy_test_shm_queue";
+
+    {
+        lazy::ShmQueue<int>::unlink(name);
+
+        lazy::ShmQueue<int> producer;
+        lazy::ShmQueue<int> consumer;
+
+        // 还没有创建
+        assert(!consumer.open(name));
+
+        assert(producer.create(name, 5));
+        assert(producer.capacity() == 8);
+
+        // 已经存在
+        lazy::ShmQueue<int> other;
+        assert(!other.create(name, 8));
+
+        // 元素大小不一致
+        lazy::ShmQueue<int64_t> wrong_type;
+        assert(!wrong_type.open(name));
+
+        // 同一个进程中的两个映射
+        assert(consumer.open(name));
+        assert(consumer.capacity() == 8);
+
+        int val = 0;
+        assert(!consumer.try_pop(val));
+        assert(!consumer.pop_for(val, std::chrono::milliseconds(10)));
+
+        // 写满，多转几圈
+        for(int round = 0; round < 3; ++round){
+            for(int i = 0; i < 8; ++i){
+                assert(producer.try_push(round * 8 + i));
+            }
+            assert(!producer.try_push(-1));
+            assert(!producer.push_back_for(-1, std::chrono::milliseconds(10)));
+            assert(consumer.size() == 8);
+
+            for(int i = 0; i < 8; ++i){
+                assert(consumer.pop_front(val) && val == round * 8 + i);
+            }
+            assert(consumer.empty());
+        }
+
+        // 等待期间另一端写入
+        std::thread writer([&]{
+            lazy::TimeUtil::SleepMs(10);
+            producer.push_back(100);
+        });
+        assert(consumer.pop_front(val) && val == 100);
+        writer.join();
+
+        // 满了等待期间另一端读出
+        for(int i = 0; i < 8; ++i){
+            producer.push_back(i);
+        }
+        std::thread reader([&]{
+            lazy::TimeUtil::SleepMs(10);
+            int v = 0;
+            consumer.pop_front(v);
+        });
+        assert(producer.push_back(8));
+        reader.join();
+
+        // 一端stop，另一端的等待返回
+        while(consumer.try_pop(val)){
+        }
+        std::thread stopper([&]{
+            lazy::TimeUtil::SleepMs(10);
+            producer.stop();
+        });
+        assert(!consumer.pop_front(val));
+        stopper.join();
+        assert(consumer.stopped());
+        assert(!consumer.try_push(1));
+
+        consumer.start();
+        assert(!producer.stopped());
+
+        lazy::ShmQueue<int>::unlink(name);
+    }
+
+    {
+        const int count = 200000;
+
+        int64_t shm_ms = shm_queue_cross_process(name, count / 2);
+        int64_t socket_ms = socket_cross_process(count);
+
+        printf("cross process %d x %zu bytes: ShmQueue %lld ms, unix socket %lld ms \n",
+               count, sizeof(ShmTestMessage), (long long)shm_ms, (long long)socket_ms);
+    }
+#endif
+}
+
+#endif /* test_shm_queue_h */
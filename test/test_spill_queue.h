@@ -0,0 +1,182 @@
+//
+//  test_spill_queue.h
+//
+
+#ifndef test_spill_queue_h
+#define test_spill_queue_h
+
+#include "spill_queue.h"
+#include "data_queue.h"
+#include "time_utils.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <thread>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <dirent.h>
+#include <unistd.h>
+
+struct SpillStringCodec {
+    static void encode(const std::string& val, std::string& out) {
+        out.append(val);
+    }
+
+    static bool decode(const char* data, size_t size, std::string& val) {
+        val.assign(data, size);
+        return true;
+    }
+};
+
+// 目录中的段文件个数
+static int count_spill_files(const std::string& dir){
+    int count = 0;
+
+    DIR* d = opendir(dir.c_str());
+    if(d == nullptr){
+        return -1;
+    }
+
+    while(struct dirent* entry = readdir(d)){
+        if(std::string(entry->d_name).find(".seg") != std::string::npos){
+            ++count;
+        }
+    }
+
+    closedir(d);
+
+    return count;
+}
+#endif
+
+void TestSpillQueue(){
+#if defined(__linux__) || defined(__APPLE__)
+    char dir_template[] = "/tmp/lazy_spill_XXXXXX";
+    char* p = mkdtemp(dir_template);
+    assert(p != nullptr);
+    std::string dir(p);
+
+    {
+        // 内存中最多10个，每个段大约8条记录
+        lazy::SpillQueue<int, lazy::PodCodec<int>> queue(dir, 10, 64);
+
+        int next_push = 0;
+        int next_pop = 0;
+
+        // 一边写一边读，深度在0到1000之间来回变化
+        for(int round = 0; round < 5; ++round){
+            for(int i = 0; i < 1000; ++i){
+                queue.push_back(next_push++);
+            }
+            assert(queue.size() == (size_t)(next_push - next_pop));
+            assert(queue.spilled() > 0);
+            assert(queue.segment_count() > 1);
+
+            size_t keep = (size_t)(rand() % 100);
+            while(queue.size() > keep){
+                assert(queue.front() == next_pop);
+                queue.pop_front();
+                ++next_pop;
+            }
+        }
+
+        while(!queue.empty()){
+            assert(queue.front() == next_pop);
+            queue.pop_front();
+            ++next_pop;
+        }
+
+        assert(next_pop == next_push);
+        assert(queue.spill_errors() == 0);
+
+        // 读完的段已经删除
+        assert(queue.segment_count() == 0);
+        assert(count_spill_files(dir) == 0);
+
+        // 磁盘读空之后重新写内存
+        queue.push_back(1);
+        assert(queue.spilled() == 0);
+
+        // 析构时删除剩下的段
+        for(int i = 0; i < 100; ++i){
+            queue.push_back(i);
+        }
+        assert(count_spill_files(dir) > 0);
+    }
+    assert(count_spill_files(dir) == 0);
+
+    {
+        // DataQueue的底层容器：消费者暂停期间的数据写入磁盘，恢复之后按顺序读回
+        lazy::DataQueue<std::string, lazy::SpillQueue<std::string, SpillStringCodec>> queue(lazy::container_args, dir, 100, 4096);
+        queue.start();
+
+        const int count = 20000;
+
+        std::thread producer([&]{
+            for(int i = 0; i < count; ++i){
+                queue.push_back("message " + std::to_string(i));
+            }
+        });
+
+        producer.join();
+        assert(queue.size() == (size_t)count);
+        assert(count_spill_files(dir) > 0);
+
+        std::string val;
+        for(int i = 0; i < count / 2; ++i){
+            assert(queue.pop_front(val) && val == "message " + std::to_string(i));
+        }
+
+        // pop_all每次只取出内存中的部分，不会把磁盘上的积压一次读进内存
+        std::vector<std::string> rest;
+        while(!queue.empty()){
+            size_t before = rest.size();
+            assert(queue.try_pop_all(rest));
+            assert(rest.size() - before <= 100);
+        }
+        assert(rest.size() == (size_t)(count - count / 2));
+        for(size_t i = 0; i < rest.size(); ++i){
+            assert(rest[i] == "message " + std::to_string(count / 2 + i));
+        }
+
+        assert(queue.empty());
+        assert(count_spill_files(dir) == 0);
+
+        // 交换出去的容器还给了queue_，配置没有变，仍然会写磁盘
+        for(int i = 0; i < 200; ++i){
+            queue.push_back(std::to_string(i));
+        }
+        assert(count_spill_files(dir) > 0);
+
+        queue.stop();
+    }
+
+    {
+        // 内存中的元素个数有上限，写入的速度
+        const int count = 1000000;
+
+        lazy::SpillQueue<int64_t, lazy::PodCodec<int64_t>> queue(dir, 10000);
+
+        int64_t t1 = lazy::TimeUtil::MonoNowMs();
+        for(int64_t i = 0; i < count; ++i){
+            queue.push_back(i);
+        }
+        int64_t t2 = lazy::TimeUtil::MonoNowMs();
+
+        for(int64_t i = 0; i < count; ++i){
+            assert(queue.front() == i);
+            queue.pop_front();
+        }
+        int64_t t3 = lazy::TimeUtil::MonoNowMs();
+
+        printf("SpillQueue %d items, %llu spilled: push %lld ms, pop %lld ms \n",
+               count, (unsigned long long)queue.total_spilled(), (long long)(t2 - t1), (long long)(t3 - t2));
+    }
+
+    rmdir(dir.c_str());
+#endif
+}
+
+#endif /* test_spill_queue_h */
@@ -0,0 +1,288 @@
+//
+//  test_sync.h
+//
+
+#ifndef test_sync_h
+#define test_sync_h
+
+#include "sync.h"
+#include "time_utils.h"
+#include <assert.h>
+#include <stdio.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// mutex+条件变量实现的信号量，作为对比
+class CondVarSemaphore {
+public:
+    explicit CondVarSemaphore(uint32_t count) : count_(count) {
+    }
+
+    void acquire() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [&]{ return count_ > 0; });
+        --count_;
+    }
+
+    void release() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ++count_;
+        cond_.notify_one();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    uint32_t count_;
+};
+
+// mutex+条件变量实现的屏障，作为对比
+class CondVarBarrier {
+public:
+    explicit CondVarBarrier(uint32_t count) : count_(count) {
+    }
+
+    void arrive_and_wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        uint64_t generation = generation_;
+
+        if(++arrived_ == count_){
+            arrived_ = 0;
+            ++generation_;
+            cond_.notify_all();
+            return;
+        }
+
+        cond_.wait(lock, [&]{ return generation_ != generation; });
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    uint32_t count_;
+    uint32_t arrived_ = 0;
+    uint64_t generation_ = 0;
+};
+
+// threads个线程争抢permits个许可，每个线程acquire/release rounds次，返回耗时（毫秒）
+template<class Sem>
+static int64_t bench_semaphore(Sem& sem, int threads, int rounds){
+    std::atomic<int> inside(0);
+    std::atomic<int> max_inside(0);
+
+    int64_t t1 = lazy::TimeUtil::MonoNowMs();
+
+    std::vector<std::thread> workers;
+    for(int i = 0; i < threads; ++i){
+        workers.push_back(std::thread([&]{
+            for(int r = 0; r < rounds; ++r){
+                sem.acquire();
+
+                int n = ++inside;
+                int cur = max_inside;
+                while(n > cur && !max_inside.compare_exchange_weak(cur, n)){
+                }
+                --inside;
+
+                sem.release();
+            }
+        }));
+    }
+
+    for(auto& t : workers){
+        t.join();
+    }
+
+    assert(max_inside <= 2);
+
+    return lazy::TimeUtil::MonoNowMs() - t1;
+}
+
+// threads个线程一起过rounds轮屏障，返回耗时（毫秒）
+template<class B>
+static int64_t bench_barrier(B& barrier, int threads, int rounds){
+    int64_t t1 = lazy::TimeUtil::MonoNowMs();
+
+    std::vector<std::thread> workers;
+    for(int i = 0; i < threads; ++i){
+        workers.push_back(std::thread([&]{
+            for(int r = 0; r < rounds; ++r){
+                barrier.arrive_and_wait();
+            }
+        }));
+    }
+
+    for(auto& t : workers){
+        t.join();
+    }
+
+    return lazy::TimeUtil::MonoNowMs() - t1;
+}
+
+void TestSync(){
+    {
+        lazy::Semaphore sem(2);
+
+        assert(sem.try_acquire());
+        assert(sem.try_acquire());
+        assert(!sem.try_acquire());
+        assert(!sem.acquire_for(std::chrono::milliseconds(10)));
+
+        // 等待期间被release
+        std::thread releaser([&]{
+            lazy::TimeUtil::SleepMs(10);
+            sem.release();
+        });
+        sem.acquire();
+        releaser.join();
+
+        sem.release(2);
+        assert(sem.available() == 2);
+    }
+
+    {
+        lazy::Latch latch(3);
+
+        assert(!latch.try_wait());
+        assert(!latch.wait_for(std::chrono::milliseconds(10)));
+
+        std::atomic<int> passed(0);
+
+        std::vector<std::thread> waiters;
+        for(int i = 0; i < 4; ++i){
+            waiters.push_back(std::thread([&]{
+                latch.wait();
+                ++passed;
+            }));
+        }
+
+        latch.count_down();
+        latch.count_down();
+        lazy::TimeUtil::SleepMs(10);
+        assert(passed == 0);
+
+        latch.count_down();
+
+        for(auto& t : waiters){
+            t.join();
+        }
+
+        assert(passed == 4);
+        assert(latch.try_wait());
+        latch.wait();
+    }
+
+    {
+        // 每一轮所有的线程都到达之后才进入下一轮
+        const int threads = 4;
+        const int rounds = 200;
+
+        std::atomic<int> phase_counter(0);
+        std::atomic<int> completions(0);
+        std::atomic<int> serial(0);
+
+        lazy::Barrier barrier(threads, [&]{
+            // 最后到达的线程执行，这时这一轮所有的线程都已经计数了
+            assert(phase_counter % threads == 0);
+            ++completions;
+        });
+
+        std::vector<std::thread> workers;
+        for(int i = 0; i < threads; ++i){
+            workers.push_back(std::thread([&]{
+                for(int r = 0; r < rounds; ++r){
+                    ++phase_counter;
+
+                    if(barrier.arrive_and_wait()){
+                        ++serial;
+                    }
+
+                    // 放行之后，这一轮的计数一定已经齐了
+                    assert(phase_counter >= (r + 1) * threads);
+                }
+            }));
+        }
+
+        for(auto& t : workers){
+            t.join();
+        }
+
+        assert(completions == rounds);
+        assert(serial == rounds);
+        assert(barrier.generation() == (uint32_t)rounds);
+    }
+
+    {
+        lazy::WaitGroup wg;
+
+        // 计数为0时立即返回
+        wg.wait();
+
+        std::atomic<int> finished(0);
+
+        for(int round = 0; round < 3; ++round){
+            wg.add(5);
+
+            std::vector<std::thread> tasks;
+            for(int i = 0; i < 5; ++i){
+                tasks.push_back(std::thread([&]{
+                    lazy::TimeUtil::SleepMs(2);
+                    ++finished;
+                    wg.done();
+                }));
+            }
+
+            wg.wait();
+            assert(finished == (round + 1) * 5);
+            assert(wg.count() == 0);
+
+            for(auto& t : tasks){
+                t.join();
+            }
+        }
+
+        wg.add();
+        assert(!wg.wait_for(std::chrono::milliseconds(10)));
+        wg.done();
+        assert(wg.wait_for(std::chrono::milliseconds(10)));
+    }
+
+    {
+        // 竞争下的开销
+        const int threads = 8;
+        const int rounds = 20000;
+
+        lazy::Semaphore sem(2);
+        lazy::Semaphore spin_sem(2);
+        spin_sem.set_wait_strategy(lazy::WAIT_STRATEGY_SPIN_YIELD_PARK, 20);
+        CondVarSemaphore cv_sem(2);
+
+        int64_t futex_ms = bench_semaphore(sem, threads, rounds);
+        int64_t spin_ms = bench_semaphore(spin_sem, threads, rounds);
+        int64_t cv_ms = bench_semaphore(cv_sem, threads, rounds);
+
+        printf("Semaphore %d threads x %d, 2 permits: futex %lld ms, futex+spin %lld ms, mutex+condvar %lld ms \n",
+               threads, rounds, (long long)futex_ms, (long long)spin_ms, (long long)cv_ms);
+
+        const int barrier_threads = 4;
+        const int barrier_rounds = 5000;
+
+        lazy::Barrier barrier(barrier_threads);
+        lazy::Barrier spin_barrier(barrier_threads);
+        spin_barrier.set_wait_strategy(lazy::WAIT_STRATEGY_SPIN_YIELD_PARK, 20);
+        CondVarBarrier cv_barrier(barrier_threads);
+
+        futex_ms = bench_barrier(barrier, barrier_threads, barrier_rounds);
+        spin_ms = bench_barrier(spin_barrier, barrier_threads, barrier_rounds);
+        cv_ms = bench_barrier(cv_barrier, barrier_threads, barrier_rounds);
+
+        printf("Barrier %d threads x %d rounds: futex %lld ms, futex+spin %lld ms, mutex+condvar %lld ms \n",
+               barrier_threads, barrier_rounds, (long long)futex_ms, (long long)spin_ms, (long long)cv_ms);
+    }
+}
+
+#endif /* test_sync_h */
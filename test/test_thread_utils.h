@@ -0,0 +1,87 @@
+//
+//  test_thread_utils.h
+//
+
+#ifndef test_thread_utils_h
+#define test_thread_utils_h
+
+#include "task_queue.h"
+#include "thread_utils.h"
+#include <assert.h>
+#include <stdio.h>
+
+void TestThreadUtils(){
+    lazy::TaskQueue task_queue;
+
+    // 线程创建之前设置，启动时生效
+    task_queue.set_name("lazy_test_queue_long_name");
+
+    lazy::ThreadOptions options;
+    options.cpu_affinity.push_back(0);
+    task_queue.set_thread_options(options);
+
+    task_queue.start();
+
+#if defined(__linux__)
+    std::string name = task_queue.invoke<std::string>([]{
+        char buf[32] = {0};
+        pthread_getname_np(pthread_self(), buf, sizeof(buf));
+        return std::string(buf);
+    });
+
+    printf("thread name: %s \n", name.c_str());
+
+    // 超过15个字符的部分被截断
+    assert(name == "lazy_test_queue");
+
+    int cpu = task_queue.invoke<int>([]{
+        return sched_getcpu();
+    });
+
+    printf("running on cpu: %d \n", cpu);
+
+    assert(cpu == 0);
+
+    // 线程运行之后修改名字
+    task_queue.set_name("renamed");
+
+    name = task_queue.invoke<std::string>([]{
+        char buf[32] = {0};
+        pthread_getname_np(pthread_self(), buf, sizeof(buf));
+        return std::string(buf);
+    });
+
+    assert(name == "renamed");
+    assert(task_queue.name() == "renamed");
+
+    // 线程运行之后重新设置：不存在的CPU编号返回失败
+    lazy::ThreadOptions bad;
+    bad.cpu_affinity.push_back(CPU_SETSIZE + 1);
+    assert(!task_queue.set_thread_options(bad));
+
+    // 空的cpu_affinity解除绑定，之前绑定到0号CPU的设置被撤销
+    assert(task_queue.set_thread_options(lazy::ThreadOptions()));
+
+    int allowed = task_queue.invoke<int>([]{
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+        return CPU_COUNT(&set);
+    });
+
+    printf("allowed cpus after reset: %d \n", allowed);
+
+    // 和没有绑定过的主线程一样（进程可能被限制在部分CPU上）
+    cpu_set_t main_set;
+    CPU_ZERO(&main_set);
+    pthread_getaffinity_np(pthread_self(), sizeof(main_set), &main_set);
+    assert(allowed == CPU_COUNT(&main_set));
+
+    std::vector<int> node0 = lazy::ThreadUtil::GetNumaNodeCpus(0);
+    printf("numa node0 cpus: %zu \n", node0.size());
+#endif
+
+    task_queue.stop();
+}
+
+#endif /* test_thread_utils_h */
@@ -0,0 +1,114 @@
+//
+//  test_wait_strategy.h
+//
+
+#ifndef test_wait_strategy_h
+#define test_wait_strategy_h
+
+#include "data_queue.h"
+#include "task_queue.h"
+#include "wait_strategy.h"
+#include <assert.h>
+#include <stdio.h>
+
+// 生产者每隔interval_us投递一个时间戳，消费者统计从投递到取出的平均延迟
+static int64_t data_queue_wakeup_latency_ns(lazy::WaitStrategy strategy, int count, int interval_us){
+    lazy::DataQueue<int64_t> data_queue;
+    data_queue.set_wait_strategy(strategy, 100);
+    data_queue.start();
+
+    int64_t sum_ns = 0;
+    int received = 0;
+
+    std::thread consumer([&]{
+        int64_t ts = 0;
+        while(data_queue.pop_front(ts)){
+            sum_ns += lazy::TimeUtil::MonoNowNs() - ts;
+            if(++received == count){
+                break;
+            }
+        }
+    });
+
+    for(int i = 0; i < count; ++i){
+        data_queue.push_back(lazy::TimeUtil::MonoNowNs());
+        lazy::TimeUtil::SleepUs(interval_us);
+    }
+
+    consumer.join();
+    data_queue.stop();
+
+    assert(received == count);
+
+    return sum_ns / count;
+}
+
+static int64_t task_queue_wakeup_latency_ns(lazy::WaitStrategy strategy, int count, int interval_us){
+    lazy::TaskQueue task_queue;
+    task_queue.set_wait_strategy(strategy, 100);
+    task_queue.start();
+
+    std::atomic<int64_t> sum_ns(0);
+    std::atomic<int> executed(0);
+
+    for(int i = 0; i < count; ++i){
+        int64_t ts = lazy::TimeUtil::MonoNowNs();
+        task_queue.post([&, ts]{
+            sum_ns += lazy::TimeUtil::MonoNowNs() - ts;
+            ++executed;
+        });
+        lazy::TimeUtil::SleepUs(interval_us);
+    }
+
+    while(executed < count){
+        lazy::TimeUtil::SleepMs(1);
+    }
+
+    return sum_ns / count;
+}
+
+void TestWaitStrategy(){
+    const int count = 2000;
+    const int interval_us = 20;
+
+    const char* names[] = {"blocking", "spin_yield_park", "adaptive"};
+    lazy::WaitStrategy strategies[] = {
+        lazy::WAIT_STRATEGY_BLOCKING,
+        lazy::WAIT_STRATEGY_SPIN_YIELD_PARK,
+        lazy::WAIT_STRATEGY_ADAPTIVE,
+    };
+
+    for(int i = 0; i < 3; ++i){
+        int64_t dq_ns = data_queue_wakeup_latency_ns(strategies[i], count, interval_us);
+        int64_t tq_ns = task_queue_wakeup_latency_ns(strategies[i], count, interval_us);
+
+        printf("%s: DataQueue avg latency %lld ns, TaskQueue avg latency %lld ns \n",
+               names[i], (long long)dq_ns, (long long)tq_ns);
+    }
+
+    // 自适应策略：到达间隔远大于自旋上限时，只做很短的自旋
+    lazy::SpinWaiter waiter;
+    waiter.set_strategy(lazy::WAIT_STRATEGY_ADAPTIVE, 50);
+    for(int i = 0; i < 4; ++i){
+        waiter.on_arrival();
+        lazy::TimeUtil::SleepMs(2);
+    }
+    assert(waiter.spin_budget_ns() < 50 * 1000);
+
+    std::atomic<bool> flag(false);
+    assert(!waiter.spin([&]{ return flag.load(); }));
+    flag = true;
+    assert(waiter.spin([&]{ return flag.load(); }));
+
+    // stop之后不在空队列上自旋，pop立即返回false
+    lazy::DataQueue<int> stopped_queue;
+    stopped_queue.set_wait_strategy(lazy::WAIT_STRATEGY_SPIN_YIELD_PARK, 100 * 1000);
+    stopped_queue.stop();
+
+    int64_t begin_us = lazy::TimeUtil::MonoNowUs();
+    int value = 0;
+    assert(!stopped_queue.pop_front(value));
+    assert(lazy::TimeUtil::MonoNowUs() - begin_us < 50 * 1000);
+}
+
+#endif /* test_wait_strategy_h */
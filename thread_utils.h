@@ -0,0 +1,281 @@
+//
+//  thread_utils.h
+//
+
+#ifndef __LAZY_THREAD_UTILS_H_2024__
+#define __LAZY_THREAD_UTILS_H_2024__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "lazy_base_common.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#elif defined(__APPLE__)
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+
+// Thread Utils
+
+namespace lazy {
+
+/* 线程的调度参数，只对调用ThreadUtil::ApplyToCurrent的线程生效
+** 线程启动时只设置指定了的参数，没有指定的保持继承下来的值；
+** 对已经运行的线程重新设置时（reset_unset为true），没有指定的参数恢复成默认值，可以撤销之前的设置
+*/
+struct ThreadOptions {
+    enum SchedPolicy {
+        // 普通的分时调度
+        SCHED_POLICY_OTHER = 0,
+        // 实时调度，先进先出
+        SCHED_POLICY_FIFO = 1,
+        // 实时调度，时间片轮转
+        SCHED_POLICY_RR = 2,
+    };
+
+    // 绑定的CPU编号，为空表示不绑定（重新设置时解除绑定，可以在所有的CPU上运行）
+    std::vector<int> cpu_affinity;
+
+    // 绑定的NUMA节点，线程只在该节点的CPU上运行，并且优先从该节点分配内存；小于0表示不绑定
+    // 同时设置了cpu_affinity时，以cpu_affinity为准
+    int numa_node = -1;
+
+    // nice值（-20 ~ 19，越小优先级越高），线程启动时等于0表示不修改
+    int nice = 0;
+
+    // 调度策略，实时调度一般需要root权限或者CAP_SYS_NICE
+    SchedPolicy policy = SCHED_POLICY_OTHER;
+
+    // 实时调度的优先级（1 ~ 99），policy为SCHED_POLICY_OTHER时忽略
+    int priority = 0;
+};
+
+class ThreadUtil {
+public:
+    // 设置当前线程的名字，Linux下最多15个字符，超出的部分会被截断
+    static bool SetCurrentName(const std::string& name) {
+#if defined(__linux__)
+        std::string short_name = name.substr(0, 15);
+        return pthread_setname_np(pthread_self(), short_name.c_str()) == 0;
+#elif defined(__APPLE__)
+        return pthread_setname_np(name.c_str()) == 0;
+#else
+        (void)name;
+        return false;
+#endif
+    }
+
+    // 把当前线程绑定到指定的CPU上
+    static bool SetCurrentAffinity(const std::vector<int>& cpus) {
+#if defined(__linux__)
+        if(cpus.empty()){
+            return false;
+        }
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+
+        for(int cpu : cpus){
+            if(cpu < 0 || cpu >= CPU_SETSIZE){
+                return false;
+            }
+            CPU_SET(cpu, &set);
+        }
+
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        // macOS只支持affinity tag，不支持绑定到指定的CPU
+        (void)cpus;
+        return false;
+#endif
+    }
+
+    // 解除当前线程的CPU绑定，可以在所有的CPU上运行
+    static bool ResetCurrentAffinity() {
+#if defined(__linux__)
+        long count = sysconf(_SC_NPROCESSORS_CONF);
+        if(count <= 0){
+            return false;
+        }
+
+        if(count > CPU_SETSIZE){
+            count = CPU_SETSIZE;
+        }
+
+        std::vector<int> cpus;
+        for(long cpu = 0; cpu < count; ++cpu){
+            cpus.push_back((int)cpu);
+        }
+
+        return SetCurrentAffinity(cpus);
+#else
+        return false;
+#endif
+    }
+
+    // 获取NUMA节点上的CPU列表，读取失败时返回空
+    static std::vector<int> GetNumaNodeCpus(int node) {
+        std::vector<int> cpus;
+#if defined(__linux__)
+        if(node < 0){
+            return cpus;
+        }
+
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+
+        FILE* fp = fopen(path, "r");
+        if(!fp){
+            return cpus;
+        }
+
+        char buf[4096] = {0};
+        size_t len = fread(buf, 1, sizeof(buf) - 1, fp);
+        fclose(fp);
+        buf[len] = '\0';
+
+        // 格式类似于 0-3,8-11
+        const char* p = buf;
+        while(*p != '\0' && *p != '\n'){
+            char* end = nullptr;
+            long first = strtol(p, &end, 10);
+            if(end == p){
+                break;
+            }
+
+            long last = first;
+            p = end;
+
+            if(*p == '-'){
+                ++p;
+                last = strtol(p, &end, 10);
+                if(end == p){
+                    break;
+                }
+                p = end;
+            }
+
+            for(long cpu = first; cpu <= last; ++cpu){
+                cpus.push_back((int)cpu);
+            }
+
+            if(*p == ','){
+                ++p;
+            }
+        }
+#else
+        (void)node;
+#endif
+        return cpus;
+    }
+
+    // 把当前线程绑定到NUMA节点：只在该节点的CPU上运行，并且优先从该节点分配内存
+    static bool BindCurrentToNumaNode(int node) {
+#if defined(__linux__)
+        std::vector<int> cpus = GetNumaNodeCpus(node);
+
+        if(cpus.empty()){
+            return false;
+        }
+
+        if(!SetCurrentAffinity(cpus)){
+            return false;
+        }
+
+#if defined(SYS_set_mempolicy)
+        // 不依赖libnuma，直接调用set_mempolicy；1就是MPOL_PREFERRED
+        // 设置失败也没有关系，线程固定在该节点上之后，first-touch策略基本也会从本地分配内存
+        if(node < (int)(sizeof(unsigned long) * 8)){
+            unsigned long mask = 1UL << node;
+            syscall(SYS_set_mempolicy, 1, &mask, sizeof(mask) * 8);
+        }
+#endif
+        return true;
+#else
+        (void)node;
+        return false;
+#endif
+    }
+
+    // 设置当前线程的nice值
+    static bool SetCurrentNice(int nice) {
+#if defined(__linux__)
+        // Linux下nice值是线程级别的
+        return setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), nice) == 0;
+#else
+        (void)nice;
+        return false;
+#endif
+    }
+
+    // 设置当前线程的调度策略
+    static bool SetCurrentSchedPolicy(ThreadOptions::SchedPolicy policy, int priority) {
+#if defined(__linux__) || defined(__APPLE__)
+        int native_policy = SCHED_OTHER;
+
+        switch (policy) {
+            case ThreadOptions::SCHED_POLICY_FIFO:
+                native_policy = SCHED_FIFO;
+                break;
+            case ThreadOptions::SCHED_POLICY_RR:
+                native_policy = SCHED_RR;
+                break;
+            default:
+                native_policy = SCHED_OTHER;
+                priority = 0;
+                break;
+        }
+
+        sched_param param;
+        param.sched_priority = priority;
+
+        return pthread_setschedparam(pthread_self(), native_policy, &param) == 0;
+#else
+        (void)policy;
+        (void)priority;
+        return false;
+#endif
+    }
+
+    /* 对当前线程应用所有的参数，全部成功才返回true
+     * reset_unset: 没有指定的参数（空的cpu_affinity、SCHED_POLICY_OTHER、nice为0）也设置，
+     *              用来修改已经运行的线程，撤销之前的绑定、实时调度和nice值
+     */
+    static bool ApplyToCurrent(const ThreadOptions& options, bool reset_unset = false) {
+        bool ok = true;
+
+        if(!options.cpu_affinity.empty()){
+            ok = SetCurrentAffinity(options.cpu_affinity) && ok;
+        }
+        else if(options.numa_node >= 0){
+            ok = BindCurrentToNumaNode(options.numa_node) && ok;
+        }
+        else if(reset_unset){
+            ok = ResetCurrentAffinity() && ok;
+        }
+
+        if(reset_unset || options.policy != ThreadOptions::SCHED_POLICY_OTHER){
+            ok = SetCurrentSchedPolicy(options.policy, options.priority) && ok;
+        }
+
+        if(reset_unset || options.nice != 0){
+            ok = SetCurrentNice(options.nice) && ok;
+        }
+
+        return ok;
+    }
+};
+
+}
+
+#endif /* __LAZY_THREAD_UTILS_H_2024__ */
@@ -48,6 +48,26 @@ public:
         auto duration = std::chrono::system_clock::now().time_since_epoch();
         return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
     }
+    
+    // 单调时钟，不受系统时间调整的影响，只能用来计算时间间隔
+    
+    // milliseconds
+    static int64_t MonoNowMs() {
+        auto duration = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+    }
+    
+    // microseconds
+    static int64_t MonoNowUs() {
+        auto duration = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    }
+    
+    // nanoseconds
+    static int64_t MonoNowNs() {
+        auto duration = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    }
 };
 
 }
@@ -0,0 +1,167 @@
+//
+//  wait_strategy.h
+//
+
+#ifndef __LAZY_WAIT_STRATEGY_H__2024__
+#define __LAZY_WAIT_STRATEGY_H__2024__
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+
+#include "lazy_base_common.h"
+
+#include "time_utils.h"
+
+namespace lazy {
+
+// 消费者等待数据时的策略
+enum WaitStrategy {
+    // 直接挂起（条件变量/futex），CPU占用最低，但是唤醒延迟在几十微秒左右
+    WAIT_STRATEGY_BLOCKING = 0,
+
+    // 先用pause自旋，再yield，最后挂起，自旋的时间固定为max_spin_us
+    WAIT_STRATEGY_SPIN_YIELD_PARK = 1,
+
+    // 和WAIT_STRATEGY_SPIN_YIELD_PARK一样，但是自旋的时间根据最近的数据到达间隔自动调整：
+    // 数据来得快就多自旋一会（很可能在自旋期间就等到了），来得慢就尽快挂起，不浪费CPU
+    WAIT_STRATEGY_ADAPTIVE = 2,
+};
+
+/*
+** 挂起之前的自旋等待
+** 用法：
+**   1、生产者每次投递数据时调用on_arrival()（只有自适应策略会记录）
+**   2、消费者在加锁挂起之前调用spin(ready)，ready是一个不加锁就能判断的条件（比如原子变量），
+**      返回true表示自旋期间条件已经满足
+**   3、spin只是一个优化，返回之后仍然要按原来的方式加锁检查条件，条件不满足再挂起
+*/
+class SpinWaiter {
+public:
+    SpinWaiter() : strategy_(WAIT_STRATEGY_BLOCKING),
+                   max_spin_ns_(50 * 1000),
+                   last_arrival_ns_(0),
+                   avg_interval_ns_(0) {
+    }
+
+    /* strategy: 等待策略
+     * max_spin_us: 挂起之前最多自旋的时间
+     */
+    void set_strategy(WaitStrategy strategy, uint32_t max_spin_us = 50) {
+        max_spin_ns_.store(static_cast<int64_t>(max_spin_us) * 1000, std::memory_order_relaxed);
+        avg_interval_ns_.store(0, std::memory_order_relaxed);
+        last_arrival_ns_.store(0, std::memory_order_relaxed);
+        strategy_.store(strategy, std::memory_order_relaxed);
+    }
+
+    WaitStrategy strategy() const {
+        return static_cast<WaitStrategy>(strategy_.load(std::memory_order_relaxed));
+    }
+
+    bool enabled() const {
+        return strategy_.load(std::memory_order_relaxed) != WAIT_STRATEGY_BLOCKING;
+    }
+
+    // 生产者投递数据时调用
+    void on_arrival() {
+        if(strategy_.load(std::memory_order_relaxed) != WAIT_STRATEGY_ADAPTIVE){
+            return;
+        }
+
+        int64_t now_ns = TimeUtil::MonoNowNs();
+        int64_t last_ns = last_arrival_ns_.exchange(now_ns, std::memory_order_relaxed);
+
+        if(last_ns == 0){
+            return;
+        }
+
+        int64_t interval = now_ns - last_ns;
+
+        // 指数加权平均，新的间隔占1/8；多个生产者并发更新时丢掉一次也没有关系
+        int64_t avg = avg_interval_ns_.load(std::memory_order_relaxed);
+        avg = (avg == 0) ? interval : avg + (interval - avg) / 8;
+        avg_interval_ns_.store(avg, std::memory_order_relaxed);
+    }
+
+    // 当前的自旋时间预算
+    int64_t spin_budget_ns() const {
+        int strategy = strategy_.load(std::memory_order_relaxed);
+
+        int64_t max_spin_ns = max_spin_ns_.load(std::memory_order_relaxed);
+
+        if(strategy == WAIT_STRATEGY_SPIN_YIELD_PARK){
+            return max_spin_ns;
+        }
+
+        if(strategy == WAIT_STRATEGY_ADAPTIVE){
+            int64_t avg = avg_interval_ns_.load(std::memory_order_relaxed);
+
+            // 还没有统计数据，先按最大值自旋
+            if(avg == 0){
+                return max_spin_ns;
+            }
+
+            // 平均间隔比自旋上限还大，自旋大概率等不到，只做很短的自旋
+            if(avg > max_spin_ns){
+                return max_spin_ns / 16;
+            }
+
+            // 自旋两倍的平均间隔，覆盖大部分的到达
+            return avg * 2 < max_spin_ns ? avg * 2 : max_spin_ns;
+        }
+
+        return 0;
+    }
+
+    // 自旋等待ready()为true，先pause再yield，超过预算返回false
+    template <class Ready>
+    bool spin(Ready ready) const {
+        int64_t budget_ns = spin_budget_ns();
+
+        if(budget_ns <= 0){
+            return ready();
+        }
+
+        int64_t start_ns = TimeUtil::MonoNowNs();
+
+        // 前3/4的时间用pause自旋，剩下的时间yield
+        int64_t pause_ns = budget_ns - budget_ns / 4;
+
+        for(uint32_t i = 1; ; ++i){
+            if(ready()){
+                return true;
+            }
+
+            LAZY_CPU_RELAX();
+
+            // 读时钟有开销，每隔一段时间检查一次
+            if((i & 63) == 0 && TimeUtil::MonoNowNs() - start_ns >= pause_ns){
+                break;
+            }
+        }
+
+        while(TimeUtil::MonoNowNs() - start_ns < budget_ns){
+            if(ready()){
+                return true;
+            }
+
+            std::this_thread::yield();
+        }
+
+        return ready();
+    }
+
+private:
+    std::atomic<int> strategy_;
+    std::atomic<int64_t> max_spin_ns_;
+
+    // 自适应策略的统计
+    std::atomic<int64_t> last_arrival_ns_;
+    std::atomic<int64_t> avg_interval_ns_;
+
+    LAZY_DISALLOW_COPY_AND_ASSIGN(SpinWaiter);
+};
+
+}
+
+#endif /* __LAZY_WAIT_STRATEGY_H__2024__ */